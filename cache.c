@@ -1,8 +1,25 @@
 #include "cache.h"
+#include "dram.h"
+#include "nextUse.h"
+#include "simProfile.h"
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 
+#define RRIP_MAX          3       // 2-bit RRPV: 3 = distant re-reference
+#define BRRIP_LONG_EVERY  32      // BRRIP fills at RRIP_MAX-1 once every 32 fills
+#define DRRIP_PSEL_MAX    1023    // 10-bit policy selector
+#define SHIP_SHCT_SIZE    16384   // signature history counter table entries
+#define SHIP_SHCT_MAX     7       // 3-bit counters
+
+#define CACHE_PREFETCH_AHEAD  8     // batch: accesses between a set prefetch and its lookup
+#define CACHE_PREFETCH_BYTES  512   // batch: most of a set's lines prefetched
+
+#if defined(__GNUC__)
+#define PREFETCH(p) __builtin_prefetch(p)
+#else
+#define PREFETCH(p) ((void)(p))
+#endif
 
 static uint32_t log2_int_u32(uint32_t v) {
     uint32_t r = 0;
@@ -10,6 +27,32 @@ static uint32_t log2_int_u32(uint32_t v) {
     return r;
 }
 
+CachePolicy cache_policy_from_string(const char *s)
+{
+    if (strcmp(s, "lr") == 0) return CACHE_LRU;
+    if (strcmp(s, "lf") == 0) return CACHE_LFU;
+    if (strcmp(s, "ra") == 0) return CACHE_RND;
+    if (strcmp(s, "mr") == 0) return CACHE_MRU;
+    if (strcmp(s, "op") == 0) return CACHE_OPT;
+    if (strcmp(s, "sr") == 0) return CACHE_SRRIP;
+    if (strcmp(s, "br") == 0) return CACHE_BRRIP;
+    if (strcmp(s, "dr") == 0) return CACHE_DRRIP;
+    if (strcmp(s, "sh") == 0) return CACHE_SHIP;
+    if (strcmp(s, "ar") == 0) return CACHE_ARC;
+    return CACHE_RR;
+}
+
+// policies whose state is all in the lines, so any way can be a candidate
+static bool perLinePolicy(CachePolicy policy)
+{
+    return policy <= CACHE_MRU;
+}
+
+static bool isRrip(CachePolicy policy)
+{
+    return policy == CACHE_SRRIP || policy == CACHE_BRRIP || policy == CACHE_DRRIP || policy == CACHE_SHIP;
+}
+
 void initCache(struct Cache *c,
                uint32_t cacheSizeBytes,
                uint32_t blockSize,
@@ -34,7 +77,148 @@ void initCache(struct Cache *c,
 
     for (uint32_t i = 0; i < c->numSets; i++) {
         c->sets[i].lines = calloc(associativity, sizeof(struct CacheLine));
+        if (policy == CACHE_OPT) {
+            c->sets[i].optHeap = calloc(associativity, sizeof(uint32_t));
+            c->sets[i].optPos  = calloc(associativity, sizeof(uint32_t));
+            c->sets[i].optNext = calloc(associativity, sizeof(uint64_t));
+        }
+        if (policy == CACHE_ARC) {
+            c->sets[i].arcGhosts = calloc(2 * associativity, sizeof(struct ArcGhost));
+        }
+    }
+    c->setMisses = calloc(c->numSets, sizeof(uint64_t));
+    c->indexing  = SET_INDEX_MOD;
+    c->indexSets = c->numSets;
+
+    c->psel = DRRIP_PSEL_MAX / 2;
+    if (policy == CACHE_SHIP) {
+        c->shct = malloc(SHIP_SHCT_SIZE);
+        memset(c->shct, 1, SHIP_SHCT_SIZE);   // weakly reused
+    }
+
+    initCacheProcStats(c, 1);
+}
+
+bool setCacheSectors(struct Cache *c, uint32_t sectorSize)
+{
+    if (sectorSize == 0 || sectorSize > c->blockSize || c->blockSize % sectorSize != 0) return false;
+    if (c->blockSize / sectorSize > MAX_SECTORS) return false;
+    c->sectorSize     = sectorSize;
+    c->sectorsPerLine = c->blockSize / sectorSize;
+    return true;
+}
+
+static uint32_t countSectors(uint64_t mask)
+{
+    uint32_t n = 0;
+    for (; mask; mask &= mask - 1) n++;
+    return n;
+}
+
+double cacheSectorUtilisation(const struct Cache *c)
+{
+    uint64_t lines = c->evictedLines, sectors = c->evictedSectors;
+    for (uint32_t index = 0; index < c->numSets; index++) {
+        for (uint32_t way = 0; way < c->associativity; way++) {
+            const struct CacheLine *line = &c->sets[index].lines[way];
+            if (!line->valid) continue;
+            lines++;
+            sectors += countSectors(line->sectorValid);
+        }
+    }
+    uint32_t perLine = c->sectorsPerLine ? c->sectorsPerLine : 1;
+    return lines ? (double)sectors / ((double)lines * perLine) : 0.0;
+}
+
+void setCacheIndexing(struct Cache *c, SetIndexing indexing)
+{
+    c->indexing  = indexing;
+    c->indexSets = setIndexSets(indexing, c->numSets);
+}
+
+void setCacheSampling(struct Cache *c, double fraction)
+{
+    if (fraction <= 0.0 || fraction >= 1.0 || c->indexSets < 2) return;
+
+    c->sampleFraction = fraction;
+    c->sampledSet  = calloc(c->numSets, sizeof(uint8_t));
+    c->setAccesses = calloc(c->numSets, sizeof(uint64_t));
+
+    // hash the index so strided sets do not line up with the sample
+    uint32_t cut = (uint32_t)(fraction * 65536.0);
+    uint32_t lowest = 0, lowestHash = UINT32_MAX;
+    for (uint32_t s = 0; s < c->indexSets; s++) {
+        uint32_t h = s * 0x9E3779B1u;
+        h ^= h >> 16;
+        h = (h * 0x85EBCA6Bu) >> 16;
+        if (h < cut) {
+            c->sampledSet[s] = 1;
+            c->sampledSets++;
+        }
+        if (h < lowestHash) { lowestHash = h; lowest = s; }
+    }
+    if (c->sampledSets == 0) {
+        c->sampledSet[lowest] = 1;
+        c->sampledSets = 1;
+    }
+}
+
+uint64_t cacheUsedLines(const struct Cache *c)
+{
+    uint64_t used = 0;
+    for (uint32_t index = 0; index < c->numSets; index++) {
+        for (uint32_t way = 0; way < c->associativity; way++) {
+            if (c->sets[index].lines[way].lastUsed != 0) used++;
+        }
+    }
+    return used;
+}
+
+void initCacheProcStats(struct Cache *c, uint32_t numProcs)
+{
+    if (numProcs == 0) numProcs = 1;
+    free(c->procStats);
+    c->procStats = calloc(numProcs, sizeof(struct CacheProcStats));
+    c->numProcs = numProcs;
+}
+
+bool initCachePartition(struct Cache *c,
+                        CachePartition partition,
+                        const uint32_t *quotas)
+{
+    c->partition = PART_NONE;
+    if (partition == PART_NONE) return true;
+    if (!perLinePolicy(c->policy)) return false;
+
+    // every process needs at least one way
+    if (c->numProcs > c->associativity) return false;
+    if (partition == PART_UCP && c->associativity > UCP_MAX_ASSOC) return false;
+
+    free(c->wayQuota);
+    c->wayQuota = calloc(c->numProcs, sizeof(uint32_t));
+
+    uint32_t total = 0;
+    for (uint32_t p = 0; p < c->numProcs; p++) {
+        c->wayQuota[p] = quotas ? quotas[p] : c->associativity / c->numProcs;
+        if (c->wayQuota[p] == 0) return false;
+        total += c->wayQuota[p];
     }
+    if (total > c->associativity) return false;
+    // leftover ways of an equal split go to the first processes
+    for (uint32_t p = 0; !quotas && total < c->associativity; p = (p + 1) % c->numProcs) {
+        c->wayQuota[p]++;
+        total++;
+    }
+
+    if (partition == PART_UCP) {
+        c->umonSets = (c->numSets + UMON_SET_STRIDE - 1) / UMON_SET_STRIDE;
+        c->umonTags = calloc((uint64_t)c->numProcs * c->umonSets * c->associativity, sizeof(uint64_t));
+        c->umonFill = calloc((uint64_t)c->numProcs * c->umonSets, sizeof(uint32_t));
+        c->umonHits = calloc((uint64_t)c->numProcs * c->associativity, sizeof(uint64_t));
+    }
+
+    c->partition = partition;
+    return true;
 }
 
 void freeCache(struct Cache *c)
@@ -42,9 +226,22 @@ void freeCache(struct Cache *c)
     if (!c->sets) return;
     for (uint32_t i = 0; i < c->numSets; i++) {
         free(c->sets[i].lines);
+        free(c->sets[i].optHeap);
+        free(c->sets[i].optPos);
+        free(c->sets[i].optNext);
+        free(c->sets[i].arcGhosts);
     }
     free(c->sets);
     free(c->rrNext);
+    free(c->setMisses);
+    free(c->sampledSet);
+    free(c->setAccesses);
+    free(c->shct);
+    free(c->procStats);
+    free(c->wayQuota);
+    free(c->umonTags);
+    free(c->umonFill);
+    free(c->umonHits);
     memset(c, 0, sizeof(*c));
 }
 
@@ -60,40 +257,625 @@ static void decodeAddress(struct Cache *c,
     uint64_t offset = addr & offMask;
     (void)offset;
 
+    if (c->indexing != SET_INDEX_MOD) {
+        // hashed index: the low bits no longer identify the block
+        *tag   = addr >> c->offsetBits;
+        *index = setIndexOf(c->indexing, *tag, c->indexBits, c->indexSets, 0);
+        return;
+    }
     *index = (uint32_t)((addr >> c->offsetBits) & indexMask);
     *tag   = addr >> (c->offsetBits + c->indexBits);
 }
 
-uint32_t cacheAccess(struct Cache *c,
-                     uint64_t physAddr,
-                     uint32_t length)
+// line each way would hold the block in; every way shares one set unless skewed
+static void candidateLines(struct Cache *c,
+                           uint64_t tag,
+                           uint32_t index,
+                           struct CacheLine **lines,
+                           uint32_t *sets)
+{
+    if (c->indexing != SET_INDEX_SKEW) {
+        struct CacheLine *row = c->sets[index].lines;
+        for (uint32_t way = 0; way < c->associativity; way++) {
+            sets[way]  = index;
+            lines[way] = &row[way];
+        }
+        return;
+    }
+    for (uint32_t way = 0; way < c->associativity; way++) {
+        sets[way]  = setIndexOf(c->indexing, tag, c->indexBits, c->indexSets, way);
+        lines[way] = &c->sets[sets[way]].lines[way];
+    }
+}
+
+// memory address of the block held by a line of set index
+static uint64_t lineAddress(struct Cache *c, const struct CacheLine *line, uint32_t index)
+{
+    if (c->indexing != SET_INDEX_MOD) return line->tag << c->offsetBits;
+    return ((line->tag << c->indexBits) | index) << c->offsetBits;
+}
+
+// shadow LRU directory of a sampled set, as if the process had the cache alone
+static void umonAccess(struct Cache *c, uint32_t index, uint64_t tag)
+{
+    uint32_t proc = c->pid < c->numProcs ? c->pid : 0;
+    uint64_t slot = (uint64_t)proc * c->umonSets + index / UMON_SET_STRIDE;
+    uint64_t *tags = &c->umonTags[slot * c->associativity];
+    uint32_t fill = c->umonFill[slot];
+
+    uint32_t pos = fill;
+    for (uint32_t i = 0; i < fill; i++) {
+        if (tags[i] == tag) {
+            pos = i;
+            break;
+        }
+    }
+
+    if (pos < fill) {
+        c->umonHits[(uint64_t)proc * c->associativity + pos]++;
+    } else if (fill < c->associativity) {
+        c->umonFill[slot] = ++fill;
+    } else {
+        pos = fill - 1;   // drop the LRU tag
+    }
+
+    // move to MRU
+    for (uint32_t i = pos; i > 0; i--) tags[i] = tags[i - 1];
+    tags[0] = tag;
+}
+
+// lookahead allocation from UCP: hand out ways by best marginal utility
+static void ucpRepartition(struct Cache *c)
+{
+    uint32_t n = c->numProcs;
+    uint32_t assoc = c->associativity;
+    uint32_t balance = assoc - n;
+
+    for (uint32_t p = 0; p < n; p++) c->wayQuota[p] = 1;
+
+    while (balance > 0) {
+        double bestMU = -1.0;
+        uint32_t bestProc = 0, bestWays = 1;
+        for (uint32_t p = 0; p < n; p++) {
+            uint64_t *hits = &c->umonHits[(uint64_t)p * assoc];
+            uint32_t have = c->wayQuota[p];
+            uint64_t gain = 0;
+            for (uint32_t k = 1; k <= balance && have + k <= assoc; k++) {
+                gain += hits[have + k - 1];
+                double mu = (double)gain / (double)k;
+                if (mu > bestMU) {
+                    bestMU = mu;
+                    bestProc = p;
+                    bestWays = k;
+                }
+            }
+        }
+        c->wayQuota[bestProc] += bestWays;
+        balance -= bestWays;
+    }
+
+    // age the monitors so the next epoch can adapt
+    for (uint64_t i = 0; i < (uint64_t)n * assoc; i++) c->umonHits[i] /= 2;
+    c->repartitions++;
+}
+
+// OPT: max-heap of the valid ways of a set, keyed by next use
+static bool optAbove(const struct CacheSet *set, uint32_t a, uint32_t b)
+{
+    uint64_t ka = set->optNext[a], kb = set->optNext[b];
+    return ka > kb || (ka == kb && a < b);
+}
+
+static void optSwap(struct CacheSet *set, uint32_t x, uint32_t y)
+{
+    uint32_t a = set->optHeap[x], b = set->optHeap[y];
+    set->optHeap[x] = b; set->optPos[b] = x;
+    set->optHeap[y] = a; set->optPos[a] = y;
+}
+
+static void optSift(struct CacheSet *set, uint32_t x)
+{
+    while (x > 0 && optAbove(set, set->optHeap[x], set->optHeap[(x - 1) / 2])) {
+        optSwap(set, x, (x - 1) / 2);
+        x = (x - 1) / 2;
+    }
+    for (;;) {
+        uint32_t l = 2 * x + 1, r = l + 1, m = x;
+        if (l < set->optHeapSize && optAbove(set, set->optHeap[l], set->optHeap[m])) m = l;
+        if (r < set->optHeapSize && optAbove(set, set->optHeap[r], set->optHeap[m])) m = r;
+        if (m == x) break;
+        optSwap(set, x, m);
+        x = m;
+    }
+}
+
+// way was just used at block access pos
+static void optTouch(struct Cache *c, struct CacheSet *set, uint32_t way, uint64_t pos, bool isNew)
+{
+    set->optNext[way] = c->nextUse ? nextUseAfter(c->nextUse, pos) : UINT64_MAX;
+    if (isNew) {
+        set->optHeap[set->optHeapSize] = way;
+        set->optPos[way] = set->optHeapSize++;
+    }
+    optSift(set, set->optPos[way]);
+}
+
+// way was invalidated: it leaves the heap
+static void optRemove(struct CacheSet *set, uint32_t way)
+{
+    uint32_t pos = set->optPos[way];
+    if (--set->optHeapSize == pos) return;
+    optSwap(set, pos, set->optHeapSize);
+    optSift(set, pos);
+}
+
+// RRIP family: evict the first line predicted distant, aging the set until one is
+static uint32_t rripVictim(struct Cache *c, struct CacheSet *set)
+{
+    for (;;) {
+        for (uint32_t way = 0; way < c->associativity; way++) {
+            if (set->lines[way].rrpv >= RRIP_MAX) return way;
+        }
+        for (uint32_t way = 0; way < c->associativity; way++) {
+            set->lines[way].rrpv++;
+        }
+    }
+}
+
+// DRRIP set dueling: 1 = SRRIP leader, 2 = BRRIP leader, 0 = follower
+static int drripLeader(uint32_t index)
+{
+    uint32_t lo = index & 31, hi = (index >> 5) & 31;
+    if (lo == hi) return 1;
+    if ((lo ^ 31) == hi) return 2;
+    return 0;
+}
+
+static uint16_t shipSignature(uint64_t pc)
+{
+    return (uint16_t)((pc ^ (pc >> 14)) & (SHIP_SHCT_SIZE - 1));
+}
+
+// RRPV of a newly filled line
+static uint8_t rripFillValue(struct Cache *c, uint32_t index, uint16_t signature)
+{
+    bool bimodal = false;
+    switch (c->policy) {
+        case CACHE_BRRIP:
+            bimodal = true;
+            break;
+        case CACHE_DRRIP: {
+            int leader = drripLeader(index);
+            bimodal = leader == 2 || (leader == 0 && c->psel > DRRIP_PSEL_MAX / 2);
+            break;
+        }
+        case CACHE_SHIP:
+            return c->shct[signature] == 0 ? RRIP_MAX : RRIP_MAX - 1;
+        default:
+            break;
+    }
+    if (bimodal && ++c->brripFills % BRRIP_LONG_EVERY != 0) {
+        return RRIP_MAX;
+    }
+    return RRIP_MAX - 1;
+}
+
+// ARC: least recently used resident line of list T1/T2, associativity if empty
+static uint32_t arcLru(struct Cache *c, struct CacheSet *set, uint8_t list)
+{
+    uint32_t lru = c->associativity;
+    for (uint32_t way = 0; way < c->associativity; way++) {
+        if (set->lines[way].valid && set->lines[way].arcList == list
+            && (lru == c->associativity || set->lines[way].lastUsed < set->lines[lru].lastUsed)) {
+            lru = way;
+        }
+    }
+    return lru;
+}
+
+// ARC: oldest ghost of list B1/B2, -1 if empty
+static int arcGhostLru(struct Cache *c, struct CacheSet *set, uint8_t list)
+{
+    int lru = -1;
+    for (uint32_t g = 0; g < 2 * c->associativity; g++) {
+        if (set->arcGhosts[g].list == list
+            && (lru < 0 || set->arcGhosts[g].tick < set->arcGhosts[lru].tick)) {
+            lru = (int)g;
+        }
+    }
+    return lru;
+}
+
+static void arcGhostAdd(struct Cache *c, struct CacheSet *set, uint64_t tag, uint8_t list)
+{
+    int slot = -1;
+    for (uint32_t g = 0; g < 2 * c->associativity; g++) {
+        if (set->arcGhosts[g].list == 0) { slot = (int)g; break; }
+    }
+    if (slot < 0) {
+        // both ghost lists full: forget the oldest ghost
+        for (uint32_t g = 0; g < 2 * c->associativity; g++) {
+            if (slot < 0 || set->arcGhosts[g].tick < set->arcGhosts[slot].tick) slot = (int)g;
+        }
+    }
+    set->arcGhosts[slot].tag  = tag;
+    set->arcGhosts[slot].tick = c->tick;
+    set->arcGhosts[slot].list = list;
+}
+
+// ARC REPLACE: demote the LRU of T1 or T2 to its ghost list
+static uint32_t arcReplace(struct Cache *c, struct CacheSet *set, uint32_t t1, bool hitInB2)
+{
+    uint8_t from = (t1 >= 1 && ((hitInB2 && t1 == set->arcTarget) || t1 > set->arcTarget)) ? 1 : 2;
+    uint32_t victim = arcLru(c, set, from);
+    if (victim == c->associativity) {
+        from = 3 - from;
+        victim = arcLru(c, set, from);
+    }
+    arcGhostAdd(c, set, set->lines[victim].tag, from);
+    return victim;
+}
+
+// ARC miss: adapt the T1 target from the ghost lists and pick the line to fill
+static uint32_t arcVictim(struct Cache *c, struct CacheSet *set, uint64_t tag, uint8_t *list)
+{
+    uint32_t t1 = 0, t2 = 0, b1 = 0, b2 = 0;
+    uint32_t invalid = c->associativity;
+    int ghostHit = -1;
+    for (uint32_t way = 0; way < c->associativity; way++) {
+        if (!set->lines[way].valid) {
+            if (invalid == c->associativity) invalid = way;
+        } else if (set->lines[way].arcList == 1) {
+            t1++;
+        } else {
+            t2++;
+        }
+    }
+    for (uint32_t g = 0; g < 2 * c->associativity; g++) {
+        struct ArcGhost *ghost = &set->arcGhosts[g];
+        if (ghost->list == 1) b1++;
+        if (ghost->list == 2) b2++;
+        if (ghost->list && ghost->tag == tag) ghostHit = (int)g;
+    }
+
+    if (ghostHit >= 0) {
+        // ghost hit: grow the list that would have kept the block
+        uint8_t ghostList = set->arcGhosts[ghostHit].list;
+        set->arcGhosts[ghostHit].list = 0;
+        if (ghostList == 1) {
+            uint32_t delta = b2 > b1 ? b2 / b1 : 1;
+            set->arcTarget = set->arcTarget + delta < c->associativity
+                           ? set->arcTarget + delta : c->associativity;
+        } else {
+            uint32_t delta = b1 > b2 ? b1 / b2 : 1;
+            set->arcTarget = set->arcTarget > delta ? set->arcTarget - delta : 0;
+        }
+        *list = 2;
+        if (invalid < c->associativity) return invalid;
+        return arcReplace(c, set, t1, ghostList == 2);
+    }
+
+    *list = 1;
+    if (t1 + b1 >= c->associativity) {
+        if (t1 < c->associativity) {
+            set->arcGhosts[arcGhostLru(c, set, 1)].list = 0;
+        } else {
+            // T1 fills the set: drop its LRU without a ghost
+            return arcLru(c, set, 1);
+        }
+    } else if (t1 + t2 + b1 + b2 >= 2 * c->associativity) {
+        int old = arcGhostLru(c, set, 2);
+        if (old >= 0) set->arcGhosts[old].list = 0;
+    }
+    if (invalid < c->associativity) return invalid;
+    return arcReplace(c, set, t1, false);
+}
+
+// way the LRU, LFU or MRU order evicts first among the eligible ones (NULL = all)
+static int rankedWay(struct Cache *c, struct CacheLine **lines, const bool *eligible)
+{
+    int best = -1;
+    for (uint32_t way = 0; way < c->associativity; way++) {
+        if (eligible && !eligible[way]) continue;
+        if (best < 0) {
+            best = (int)way;
+            continue;
+        }
+        const struct CacheLine *line = lines[way], *bestLine = lines[best];
+        bool before = c->policy == CACHE_LFU ? line->useCount < bestLine->useCount
+                    : c->policy == CACHE_MRU ? line->lastUsed > bestLine->lastUsed
+                    :                          line->lastUsed < bestLine->lastUsed;
+        if (before) best = (int)way;
+    }
+    return best;
+}
+
+static int pickWay(struct Cache *c, struct CacheLine **lines, uint32_t index, const bool *eligible)
+{
+    if (c->policy == CACHE_RR) {
+        for (uint32_t k = 0; k < c->associativity; k++) {
+            uint32_t way = (uint32_t)((c->rrNext[index] + k) % c->associativity);
+            if (eligible[way]) {
+                c->rrNext[index] += k + 1;
+                return (int)way;
+            }
+        }
+    } else if (c->policy == CACHE_RND) {
+        uint32_t count = 0;
+        for (uint32_t way = 0; way < c->associativity; way++) count += eligible[way];
+        if (count > 0) {
+            uint32_t pick = (uint32_t)rand() % count;
+            for (uint32_t way = 0; way < c->associativity; way++) {
+                if (eligible[way] && pick-- == 0) return (int)way;
+            }
+        }
+    } else {
+        return rankedWay(c, lines, eligible);
+    }
+    return -1;
+}
+
+// sectors of a block touched by bytes [start, end]; bit 0 when not sectored
+static uint64_t sectorsTouched(struct Cache *c, uint64_t blockBase, uint64_t start, uint64_t end)
+{
+    if (c->sectorsPerLine <= 1) return 1;
+    uint64_t blockEnd = blockBase + c->blockSize - 1;
+    uint32_t first = (uint32_t)(((start > blockBase ? start : blockBase) - blockBase) / c->sectorSize);
+    uint32_t last  = (uint32_t)(((end < blockEnd ? end : blockEnd) - blockBase) / c->sectorSize);
+    uint32_t n = last - first + 1;
+    return (n >= 64 ? ~(uint64_t)0 : (((uint64_t)1 << n) - 1)) << first;
+}
+
+// move the sectors in mask between memory and a line, one transfer per
+// contiguous run; returns the cycles a read stalls for
+static uint32_t memTransfer(struct Cache *c, uint64_t blockBase, uint64_t mask,
+                            bool isWrite, uint64_t now)
+{
+    uint32_t cycles  = 0;
+    uint32_t sectors = c->sectorsPerLine > 1 ? c->sectorsPerLine : 1;
+    uint32_t unit    = c->sectorsPerLine > 1 ? c->sectorSize : c->blockSize;
+
+    for (uint32_t s = 0; s < sectors; ) {
+        if (!((mask >> s) & 1)) { s++; continue; }
+        uint32_t run = s;
+        while (run < sectors && ((mask >> run) & 1)) run++;
+
+        uint32_t bytes = (run - s) * unit;
+        uint64_t addr  = blockBase + (uint64_t)s * unit;
+        if (isWrite) {
+            // writeback goes through the write buffer, only occupies the bank
+            c->writebackBytes += bytes;
+            if (c->dram) dramAccessBytes(c->dram, addr, bytes, true, now);
+        } else {
+            c->fetchBytes += bytes;
+            if (c->dram) {
+                cycles += dramAccessBytes(c->dram, addr, bytes, false, now + cycles);
+            } else {
+                uint32_t memReads = (bytes + 3) / 4; // ceil(bytes / 4)
+                cycles += 4 * memReads;
+            }
+        }
+        s = run;
+    }
+    c->memCycles += cycles;
+    return cycles;
+}
+
+// dirty part of a line, as a sector mask
+static uint64_t dirtySectors(struct Cache *c, const struct CacheLine *line)
+{
+    return c->sectorsPerLine > 1 ? line->sectorDirty : 1;
+}
+
+// victim for a full set; partitions restrict the candidate ways
+static int chooseVictim(struct Cache *c, struct CacheLine **lines, uint32_t index)
+{
+    if (c->partition == PART_NONE) {
+        int victim;
+        switch (c->policy) {
+            case CACHE_RR:
+                victim = (int)(c->rrNext[index] % c->associativity);
+                c->rrNext[index]++;
+                break;
+            case CACHE_RND:
+                victim = rand() % c->associativity;
+                break;
+            case CACHE_OPT:
+                victim = (int)c->sets[index].optHeap[0];
+                break;
+            case CACHE_SRRIP:
+            case CACHE_BRRIP:
+            case CACHE_DRRIP:
+            case CACHE_SHIP:
+                victim = (int)rripVictim(c, &c->sets[index]);
+                break;
+            default:        // ARC picks its victim with the incoming tag, see arcVictim
+                victim = rankedWay(c, lines, NULL);
+                break;
+        }
+        return victim;
+    }
+
+    bool eligible[c->associativity];
+    uint32_t proc = c->pid < c->numProcs ? c->pid : 0;
+    uint32_t held[c->numProcs];
+    memset(held, 0, sizeof(held));
+    for (uint32_t way = 0; way < c->associativity; way++) {
+        uint16_t owner = lines[way]->owner;
+        if (owner < c->numProcs) held[owner]++;
+    }
+
+    // at quota: replace one of our own blocks
+    if (held[proc] >= c->wayQuota[proc]) {
+        for (uint32_t way = 0; way < c->associativity; way++)
+            eligible[way] = lines[way]->owner == proc;
+        int victim = pickWay(c, lines, index, eligible);
+        if (victim >= 0) return victim;
+    }
+
+    // under quota: take a way from a process above its quota
+    for (uint32_t way = 0; way < c->associativity; way++) {
+        uint16_t owner = lines[way]->owner;
+        eligible[way] = owner != proc &&
+                        (owner >= c->numProcs || held[owner] > c->wayQuota[owner]);
+    }
+    int victim = pickWay(c, lines, index, eligible);
+    if (victim >= 0) return victim;
+
+    for (uint32_t way = 0; way < c->associativity; way++) eligible[way] = true;
+    return pickWay(c, lines, index, eligible);
+}
+
+// replacement state of a line accessed again
+static void touchLine(struct Cache *c, struct CacheLine *line, uint32_t index, uint32_t way)
+{
+    line->lastUsed = c->tick;
+    line->useCount++;
+    line->rrpv     = 0;
+    line->arcList  = 2;
+    if (c->policy == CACHE_OPT) optTouch(c, &c->sets[index], way, c->tick - 1, false);
+    if (c->policy == CACHE_SHIP) {
+        line->reused = 1;
+        if (c->shct[line->signature] < SHIP_SHCT_MAX) c->shct[line->signature]++;
+    }
+}
+
+// victim for a miss in set index: an empty way, or the policy's choice
+static int missVictim(struct Cache *c, struct CacheLine **lines, uint32_t index,
+                      uint64_t tag, int emptyLine, uint8_t *arcList)
+{
+    *arcList = 1;
+    if (c->policy == CACHE_DRRIP) {
+        int leader = drripLeader(index);
+        if (leader == 1 && c->psel < DRRIP_PSEL_MAX) c->psel++;
+        if (leader == 2 && c->psel > 0) c->psel--;
+    }
+    // ARC adapts to ghost hits even when an empty way is left
+    if (emptyLine >= 0 && c->policy != CACHE_ARC) return emptyLine;
+
+    PROF_BEGIN(PROF_VICTIM);
+    int victim = c->policy == CACHE_ARC ? (int)arcVictim(c, &c->sets[index], tag, arcList)
+                                        : chooseVictim(c, lines, index);
+    PROF_END();
+
+    struct CacheLine *vline = lines[victim];
+    if (c->policy == CACHE_SHIP && vline->valid && !vline->reused && c->shct[vline->signature] > 0) {
+        c->shct[vline->signature]--;   // evicted without reuse
+    }
+    return victim;
+}
+
+// install the block in a line, replacement state included
+static void fillLine(struct Cache *c, struct CacheLine *line, uint32_t index, uint32_t way,
+                     uint64_t tag, bool isWrite, uint64_t want, uint8_t arcList)
+{
+    bool wasValid = line->valid;
+    line->valid       = 1;
+    line->dirty       = isWrite ? 1 : 0;
+    line->owner       = c->pid;
+    line->tag         = tag;
+    line->sectorValid = want;
+    line->sectorDirty = isWrite ? want : 0;
+    line->lastUsed    = c->tick;
+    line->useCount    = 1;
+    line->reused      = 0;
+    line->arcList     = arcList;
+    line->signature   = shipSignature(c->pc);
+    if (c->policy == CACHE_OPT) optTouch(c, &c->sets[index], way, c->tick - 1, !wasValid);
+    if (isRrip(c->policy)) line->rrpv = rripFillValue(c, index, line->signature);
+}
+
+// a block found in line; returns the cycles, issued at cycle now
+static uint32_t blockHit(struct Cache *c, struct CacheProcStats *ps, struct CacheLine *line,
+                         uint32_t set, uint32_t way, uint64_t blockBase, uint64_t want,
+                         bool isWrite, bool inReload, bool steady, uint64_t now)
+{
+    uint32_t cycles;
+    if (c->sectorsPerLine > 1 && (line->sectorValid & want) != want) {
+        // tag present, sector missing: fetch just the missing sectors. It
+        // evicts nothing, so it counts as a compulsory miss of its set
+        c->misses++;
+        ps->misses++;
+        c->sectorMisses++;
+        c->compulsoryMisses++;
+        ps->compulsoryMisses++;
+        c->setMisses[set]++;
+        if (inReload) ps->reloadMisses++;
+        if (steady) ps->steadyMisses++;
+        cycles = memTransfer(c, blockBase, want & ~line->sectorValid, false, now);
+        line->sectorValid |= want;
+    } else {
+        // HIT
+        c->hits++;
+        ps->hits++;
+        cycles = 1;
+    }
+    touchLine(c, line, set, way);
+    if (isWrite) {
+        line->dirty = 1;
+        line->sectorDirty |= want;
+    }
+    return cycles;
+}
+
+// the blocks of one access; the caller counts the address
+static uint32_t accessBlocks(struct Cache *c,
+                             struct CacheProcStats *ps,
+                             uint64_t physAddr,
+                             uint32_t length,
+                             bool isWrite)
 {
     // each block = cache access
     // iterate per address and detect block change 
 
     uint32_t cycles = 0;
-    c->addresses++;
-
     uint64_t start = physAddr;
     uint64_t end   = physAddr + length - 1;
 
     uint64_t blockMask = ~((uint64_t)c->blockSize - 1);
     uint64_t curBlockBase = start & blockMask;
 
-    while (curBlockBase <= end) {
+    for (; curBlockBase <= end; curBlockBase += c->blockSize) {
         // 1 access per block
         c->accesses++;
+        ps->accesses++;
+        c->tick++;
+
+        bool inReload = c->reloadLeft > 0;
+        bool steady   = !inReload && ps->slices > 1;   // outside the windows, past the cold start
+        if (inReload) {
+            c->reloadLeft--;
+            ps->reloadAccesses++;
+        }
+        if (steady) ps->steadyAccesses++;
 
         uint64_t tag;
         uint32_t index;
         decodeAddress(c, curBlockBase, &tag, &index);
-        struct CacheSet *set = &c->sets[index];
+        if (c->sampledSet) {
+            if (!c->sampledSet[index]) continue;   // unsampled set: no tag work
+            c->sampledAccesses++;
+            c->setAccesses[index]++;
+        }
+        uint64_t want = sectorsTouched(c, curBlockBase, start, end);
+
+        if (c->partition == PART_UCP) {
+            if (index % UMON_SET_STRIDE == 0) umonAccess(c, index, tag);
+            if (++c->ucpAccesses >= UCP_EPOCH) {
+                ucpRepartition(c);
+                c->ucpAccesses = 0;
+            }
+        }
+
+        struct CacheLine *lines[c->associativity];
+        uint32_t sets[c->associativity];
+        candidateLines(c, tag, index, lines, sets);
 
         int emptyLine = -1;
         int hitLine   = -1;
 
         for (uint32_t way = 0; way < c->associativity; way++) {
-            struct CacheLine *line = &set->lines[way];
+            struct CacheLine *line = lines[way];
             if (line->valid && line->tag == tag) {
                 hitLine = (int)way;
                 break;
@@ -104,66 +886,291 @@ uint32_t cacheAccess(struct Cache *c,
         }
 
         if (hitLine >= 0) {
-            // HIT
-            c->hits++;
-            cycles += 1;
+            cycles += blockHit(c, ps, lines[hitLine], sets[hitLine], (uint32_t)hitLine, curBlockBase,
+                               want, isWrite, inReload, steady, c->now + cycles);
         } else {
             // MISS
             c->misses++;
-            uint32_t memReads = (c->blockSize + 3) / 4; // ceil(blockSize / 4)
-            cycles += 4 * memReads;
+            ps->misses++;
+            if (inReload) ps->reloadMisses++;
+            if (steady) ps->steadyMisses++;
+            cycles += memTransfer(c, curBlockBase, want, false, c->now + cycles);
 
-            int victim = emptyLine;
-            if (victim < 0) {
+            uint8_t arcList;
+            int victim = missVictim(c, lines, index, tag, emptyLine, &arcList);
+            struct CacheLine *vline = lines[victim];
+            if (vline->valid) {
                 // not invalid line = conflict miss
                 c->conflictMisses++;
-                if (c->policy == CACHE_RR) {
-                    victim = (int)(c->rrNext[index] % c->associativity);
-                    c->rrNext[index]++;
-                } else {
-                    victim = rand() % c->associativity;
+                ps->conflictMisses++;
+
+                // inter-process conflict: someone else's block goes
+                uint16_t owner = vline->owner;
+                if (owner != c->pid) {
+                    ps->crossEvictions++;
+                    if (owner < c->numProcs) c->procStats[owner].lostToOthers++;
                 }
             } else {
                 // compulsory miss
                 c->compulsoryMisses++;
+                ps->compulsoryMisses++;
             }
 
-            struct CacheLine *vline = &set->lines[victim];
-            vline->valid = 1;
-            vline->tag   = tag;
+            c->setMisses[sets[victim]]++;
+            if (vline->valid) {
+                c->evictedLines++;
+                c->evictedSectors += countSectors(vline->sectorValid);
+            }
+            if (vline->valid && vline->dirty) {
+                c->writebacks++;
+                ps->writebacks++;
+                memTransfer(c, lineAddress(c, vline, sets[victim]), dirtySectors(c, vline),
+                            true, c->now + cycles);
+            }
+            fillLine(c, vline, sets[victim], (uint32_t)victim, tag, isWrite, want, arcList);
         }
+    }
+    return cycles;
+}
 
-        // next block iff in range
-        curBlockBase += c->blockSize;
+uint32_t cacheAccess(struct Cache *c,
+                     uint64_t physAddr,
+                     uint32_t length,
+                     bool isWrite)
+{
+    PROF_BEGIN(PROF_LOOKUP);
+    if (c->record) writeCacheRef(c->record, physAddr, length, isWrite, c->fetch, c->pc);
+
+    c->addresses++;
+    struct CacheProcStats *ps = &c->procStats[c->pid < c->numProcs ? c->pid : 0];
+    ps->addresses++;
+
+    uint32_t cycles = accessBlocks(c, ps, physAddr, length, isWrite);
+    PROF_END();
+    return cycles;
+}
+
+// start pulling in the set an access maps to: the CacheSet first, its
+// lines once that has arrived (skewed sets prefetch way 0's only)
+static void prefetchSet(struct Cache *c, uint64_t physAddr, bool lines)
+{
+    uint64_t tag;
+    uint32_t index;
+    decodeAddress(c, physAddr, &tag, &index);
+    if (!lines) {
+        PREFETCH(&c->sets[index]);
+        return;
+    }
+    const char *p = (const char *)c->sets[index].lines;
+    uint32_t bytes = c->associativity * (uint32_t)sizeof(struct CacheLine);
+    if (bytes > CACHE_PREFETCH_BYTES) bytes = CACHE_PREFETCH_BYTES;
+    for (uint32_t off = 0; off < bytes; off += 64) PREFETCH(p + off);
+}
+
+uint64_t cacheAccessBatch(struct Cache *c,
+                          uint32_t count,
+                          const uint64_t *physAddr,
+                          const uint32_t *length,
+                          const uint8_t *isWrite,
+                          const uint32_t *gap)
+{
+    uint64_t cycles = 0;
+    uint64_t now = c->now;
+    if (c->record) {
+        // recording needs the scalar path's per access state
+        for (uint32_t i = 0; i < count; i++) {
+            now += gap[i];
+            c->now = now;
+            uint32_t cyc = cacheAccess(c, physAddr[i], length[i], isWrite[i]);
+            now += cyc;
+            cycles += cyc;
+        }
+        return cycles;
     }
 
+    PROF_BEGIN(PROF_LOOKUP);
+    struct CacheProcStats *ps = &c->procStats[c->pid < c->numProcs ? c->pid : 0];
+    c->addresses  += count;
+    ps->addresses += count;
+
+    for (uint32_t i = 0; i < count && i < CACHE_PREFETCH_AHEAD; i++) prefetchSet(c, physAddr[i], false);
+    for (uint32_t i = 0; i < count; i++) {
+        if (i + CACHE_PREFETCH_AHEAD < count) prefetchSet(c, physAddr[i + CACHE_PREFETCH_AHEAD], false);
+        if (i + CACHE_PREFETCH_AHEAD / 2 < count) prefetchSet(c, physAddr[i + CACHE_PREFETCH_AHEAD / 2], true);
+
+        now += gap[i];
+        c->now = now;
+        uint32_t cyc = accessBlocks(c, ps, physAddr[i], length[i], isWrite[i]);
+        now += cyc;
+        cycles += cyc;
+    }
+    PROF_END();
     return cycles;
 }
 
+void cacheWarm(struct Cache *c,
+               uint64_t physAddr,
+               uint32_t length,
+               bool isWrite)
+{
+    uint64_t start = physAddr;
+    uint64_t end   = physAddr + length - 1;
+    uint64_t curBlockBase = start & ~((uint64_t)c->blockSize - 1);
+
+    PROF_BEGIN(PROF_LOOKUP);
+    for (; curBlockBase <= end; curBlockBase += c->blockSize) {
+        c->tick++;
+
+        uint64_t tag;
+        uint32_t index;
+        decodeAddress(c, curBlockBase, &tag, &index);
+        if (c->sampledSet && !c->sampledSet[index]) continue;
+        struct CacheLine *lines[c->associativity];
+        uint32_t sets[c->associativity];
+        candidateLines(c, tag, index, lines, sets);
+        uint64_t want = sectorsTouched(c, curBlockBase, start, end);
+
+        int emptyLine = -1;
+        int hitLine   = -1;
+        for (uint32_t way = 0; way < c->associativity; way++) {
+            if (lines[way]->valid && lines[way]->tag == tag) {
+                hitLine = (int)way;
+                break;
+            }
+            if (!lines[way]->valid && emptyLine < 0) emptyLine = (int)way;
+        }
+
+        if (hitLine >= 0) {
+            struct CacheLine *line = lines[hitLine];
+            touchLine(c, line, sets[hitLine], (uint32_t)hitLine);
+            line->sectorValid |= want;
+            if (isWrite) {
+                line->dirty = 1;
+                line->sectorDirty |= want;
+            }
+        } else {
+            uint8_t arcList;
+            int victim = missVictim(c, lines, index, tag, emptyLine, &arcList);
+            fillLine(c, lines[victim], sets[victim], (uint32_t)victim, tag, isWrite, want, arcList);
+        }
+    }
+    PROF_END();
+}
+
+void resetCacheStats(struct Cache *c)
+{
+    c->accesses         = 0;
+    c->hits             = 0;
+    c->misses           = 0;
+    c->compulsoryMisses = 0;
+    c->conflictMisses   = 0;
+    c->instrBytes       = 0;
+    c->srcDstBytes      = 0;
+    c->addresses        = 0;
+    c->writebacks       = 0;
+    c->memCycles        = 0;
+    c->instructions     = 0;
+    c->sectorMisses     = 0;
+    c->fetchBytes       = 0;
+    c->writebackBytes   = 0;
+    c->evictedLines     = 0;
+    c->evictedSectors   = 0;
+    c->flushes          = 0;
+    c->repartitions     = 0;
+    c->sampledAccesses  = 0;
+    memset(c->setMisses, 0, c->numSets * sizeof(uint64_t));
+    if (c->setAccesses) memset(c->setAccesses, 0, c->numSets * sizeof(uint64_t));
+}
+
+void resetCacheProcStats(struct Cache *c, uint16_t pid)
+{
+    if (pid >= c->numProcs) return;
+    uint64_t slices = c->procStats[pid].slices;   // the cold start is still behind it
+    memset(&c->procStats[pid], 0, sizeof(struct CacheProcStats));
+    c->procStats[pid].slices = slices;
+}
+
+// invalidate a valid line of set index, writing its dirty data back first
+static void dropLine(struct Cache *c, struct CacheLine *line, uint32_t index)
+{
+    c->evictedLines++;
+    c->evictedSectors += countSectors(line->sectorValid);
+    if (line->dirty) {
+        c->writebacks++;
+        if (line->owner < c->numProcs) c->procStats[line->owner].writebacks++;
+        memTransfer(c, lineAddress(c, line, index), dirtySectors(c, line), true, c->now);
+    }
+    line->valid = 0;
+    line->dirty = 0;
+    line->sectorDirty = 0;
+}
+
+void cacheFlush(struct Cache *c)
+{
+    if (!c || !c->sets) return;
+
+    PROF_BEGIN(PROF_INVALIDATE);
+    for (uint32_t index = 0; index < c->numSets; index++) {
+        struct CacheSet *set = &c->sets[index];
+        for (uint32_t way = 0; way < c->associativity; way++) {
+            struct CacheLine *line = &set->lines[way];
+            if (line->valid) dropLine(c, line, index);
+            line->dirty = 0;
+        }
+        set->optHeapSize = 0;
+    }
+    c->flushes++;
+    PROF_END();
+}
+
 void cacheInvalidateRange(struct Cache *c,
                           uint64_t physBase,
                           uint64_t pageSize)
 {
     if (!c || !c->sets) return;
 
+    PROF_BEGIN(PROF_INVALIDATE);
+    if (c->record) writeInvalidateRef(c->record, physBase, (uint32_t)pageSize);
+
     uint64_t start = physBase;
     uint64_t end   = physBase + pageSize - 1;
     uint64_t blockMask = ~((uint64_t)c->blockSize - 1);
     uint64_t curBlockBase = start & blockMask;
 
+    if ((end - curBlockBase) / c->blockSize + 1 > c->numSets) {
+        // more blocks than sets (highly associative): one pass over the lines
+        for (uint32_t set = 0; set < c->numSets; set++) {
+            for (uint32_t way = 0; way < c->associativity; way++) {
+                struct CacheLine *line = &c->sets[set].lines[way];
+                if (!line->valid) continue;
+                uint64_t addr = lineAddress(c, line, set);
+                if (addr < curBlockBase || addr > end) continue;
+                dropLine(c, line, set);
+                if (c->policy == CACHE_OPT) optRemove(&c->sets[set], way);
+            }
+        }
+        PROF_END();
+        return;
+    }
+
     while (curBlockBase <= end) {
         uint64_t tag;
         uint32_t index;
         decodeAddress(c, curBlockBase, &tag, &index);
-        struct CacheSet *set = &c->sets[index];
-
         for (uint32_t way = 0; way < c->associativity; way++) {
-            struct CacheLine *line = &set->lines[way];
+            // skewed: each way of the block has its own set
+            uint32_t set = c->indexing == SET_INDEX_SKEW
+                         ? setIndexOf(c->indexing, tag, c->indexBits, c->indexSets, way)
+                         : index;
+            struct CacheLine *line = &c->sets[set].lines[way];
             if (line->valid && line->tag == tag) {
-                line->valid = 0;
+                dropLine(c, line, set);
+                if (c->policy == CACHE_OPT) optRemove(&c->sets[set], way);
+                break;      // a block is in at most one way
             }
         }
 
         curBlockBase += c->blockSize;
     }
+    PROF_END();
 }
@@ -1,22 +1,102 @@
 #ifndef CACHE_H
 #define CACHE_H
 
+#include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include "setIndex.h"
+
+/*
+ * The cache engine shared by cacheSim, ccacheSim and cacheBench. OPT, the
+ * RRIP family and ARC keep state per set, so they cannot be combined with
+ * SET_INDEX_SKEW or way partitioning.
+ */
+
+struct DRAM;
+struct NextUseIndex;
 
 typedef enum {
     CACHE_RR,
-    CACHE_RND
+    CACHE_RND,
+    CACHE_LRU,
+    CACHE_LFU,
+    CACHE_MRU,
+    CACHE_OPT,           // Belady: farthest next use, needs a next-use index
+    CACHE_SRRIP,         // static RRIP, fills predicted "long" re-reference
+    CACHE_BRRIP,         // bimodal RRIP, most fills predicted "distant"
+    CACHE_DRRIP,         // set dueling between SRRIP and BRRIP
+    CACHE_SHIP,          // SRRIP with fills predicted per EIP signature
+    CACHE_ARC            // adaptive replacement cache, per set
 } CachePolicy;
 
+typedef enum {
+    PART_NONE,           // all processes share every way
+    PART_STATIC,         // fixed way quota per process
+    PART_UCP             // quotas recomputed from utility monitors
+} CachePartition;
+
+#define UCP_EPOCH        (1u << 17)  // block accesses between repartitions
+#define UMON_SET_STRIDE  32          // every 32nd set feeds the utility monitors
+#define UCP_MAX_ASSOC    64
+#define MAX_SECTORS      64          // sectors per line, one bit each in the masks
+
 struct CacheLine {
     uint8_t  valid;
+    uint8_t  dirty;
+    uint16_t owner;      // process that brought the block in
+    uint8_t  rrpv;       // RRIP/SHiP: re-reference prediction value
+    uint8_t  reused;     // SHiP: hit since the fill
+    uint8_t  arcList;    // ARC: 1 = T1 (seen once), 2 = T2 (seen again)
+    uint16_t signature;  // SHiP: EIP signature of the fill
+    uint32_t useCount;   // LFU: accesses since the fill
     uint64_t tag;
-    uint64_t lastUsed;   
+    uint64_t lastUsed;     // tick of the last access, 0 = never filled
+    uint64_t sectorValid;  // sectored mode: sectors present
+    uint64_t sectorDirty;  // sectored mode: sectors written
+};
+
+// ARC ghost entry: tag of a recently evicted block
+struct ArcGhost {
+    uint64_t tag;
+    uint64_t tick;       // when it was evicted
+    uint8_t  list;       // 0 = free, 1 = B1, 2 = B2
 };
 
 struct CacheSet {
     struct CacheLine *lines;   // associativity lines
+    uint32_t *optHeap;         // OPT: valid ways, farthest next use on top
+    uint32_t *optPos;          // OPT: [way] slot in the heap
+    uint64_t *optNext;         // OPT: [way] block access of the next use
+    uint32_t optHeapSize;
+    uint32_t arcTarget;        // ARC: target size of T1 (p)
+    struct ArcGhost *arcGhosts;  // ARC: [2 * associativity] B1 and B2
+};
+
+// counters kept for each process sharing the cache
+struct CacheProcStats {
+    uint64_t accesses;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t compulsoryMisses;
+    uint64_t conflictMisses;
+    uint64_t crossEvictions;   // conflict misses that evicted another process' block
+    uint64_t lostToOthers;     // own blocks evicted by another process
+
+    uint64_t addresses;
+    uint64_t writebacks;
+
+    uint64_t reloadAccesses;   // block accesses right after being switched in
+    uint64_t reloadMisses;
+    uint64_t steadyAccesses;   // block accesses outside the windows, past the first slice
+    uint64_t steadyMisses;
+
+    uint64_t instrBytes;       // filled in by the simulator
+    uint64_t srcDstBytes;
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t switchIns;        // times scheduled after another process ran
+    uint64_t switchCycles;     // context switch cost charged to this process
+    uint64_t slices;           // time slices dispatched; survives resetCacheProcStats
 };
 
 struct Cache {
@@ -25,13 +105,19 @@ struct Cache {
     uint32_t associativity;
     uint32_t numSets;
 
-    uint32_t tagBits;
+    uint32_t tagBits;    // 32 bit physical addresses unless the simulator says otherwise
     uint32_t indexBits;
     uint32_t offsetBits;
 
     CachePolicy policy;
 
-    // variables for values to display
+    // set index function; when not SET_INDEX_MOD the tag is the whole block address
+    SetIndexing indexing;
+    uint32_t indexSets;        // sets the index function reaches
+    uint64_t *setMisses;       // [set] misses in each set, sector misses included
+
+    // statistics: these, setMisses and the sector, sampling, flush and
+    // repartition counters are zeroed by resetCacheStats; the rest is state
     uint64_t accesses;
     uint64_t hits;
     uint64_t misses;
@@ -43,12 +129,68 @@ struct Cache {
 
     uint64_t addresses;  
 
+    uint64_t writebacks;
+    uint64_t memCycles;        // cycles read misses waited for memory
+    uint64_t instructions;     // filled in by the simulator
+
+    // sectored lines: only the touched sectors are fetched
+    uint32_t sectorSize;       // 0 = whole block per fill
+    uint32_t sectorsPerLine;
+    uint64_t sectorMisses;     // tag hits that still had to fetch a sector
+    uint64_t fetchBytes;       // bytes read from memory
+    uint64_t writebackBytes;   // bytes written back to memory
+    uint64_t evictedLines;
+    uint64_t evictedSectors;   // valid sectors in the evicted lines
+
     // for RR
     uint64_t *rrNext;    
 
+    uint64_t tick;             // block accesses so far, warming included; never reset
+
+    // set sampling: only sets with sampledSet[set] get tag work
+    double   sampleFraction;
+    uint8_t  *sampledSet;      // NULL = every set simulated
+    uint32_t sampledSets;
+    uint64_t sampledAccesses;  // block accesses that reached a sampled set
+    uint64_t *setAccesses;     // [set] block accesses per sampled set
+
+    // RRIP family and SHiP
+    uint32_t psel;             // DRRIP: high = SRRIP leaders miss more
+    uint32_t brripFills;       // BRRIP: fill counter for the 1-in-32 long insert
+    uint8_t  *shct;            // SHiP: signature reuse counters
+
+    const struct NextUseIndex *nextUse;   // OPT only
+    FILE *record;              // when set, every access and invalidation is appended (see nextUse.h)
+
     struct CacheSet *sets;
+
+    // memory behind the cache (NULL = fixed 4 cycles per 4 bytes)
+    struct DRAM *dram;
+    uint64_t now;        // current cycle, set by the simulator before each access
+    uint64_t pc;         // EIP of the instruction making the access (SHiP, recording)
+    bool     fetch;      // the access is that instruction's fetch (recording)
+
+    // per process counters
+    uint16_t pid;        // process issuing the access, set by the simulator
+    uint32_t reloadLeft; // accesses left in the post-switch window, set by the simulator
+    uint64_t flushes;
+    uint32_t numProcs;
+    struct CacheProcStats *procStats;
+
+    // way partitioning
+    CachePartition partition;
+    uint32_t *wayQuota;        // [proc] ways each process may hold in a set
+    uint32_t umonSets;         // sampled sets per monitor
+    uint64_t *umonTags;        // [proc][sample][way] shadow tags, MRU first
+    uint32_t *umonFill;        // [proc][sample] valid shadow tags
+    uint64_t *umonHits;        // [proc][way] hits per LRU stack position
+    uint64_t ucpAccesses;      // block accesses since the last repartition
+    uint64_t repartitions;
 };
 
+// lr, lf, rr, ra, mr, op, sr, br, dr, sh, ar; anything else is rr
+CachePolicy cache_policy_from_string(const char *s);
+
 // init and free
 void initCache(struct Cache *c,
                uint32_t cacheSizeBytes,
@@ -58,11 +200,67 @@ void initCache(struct Cache *c,
 
 void freeCache(struct Cache *c);
 
-// cache accesses, returns consumed accesses
+// pick the set index function, before any access
+void setCacheIndexing(struct Cache *c, SetIndexing indexing);
+
+// split every line into sectors of sectorSize bytes, before any access.
+// Returns false if the sector size does not divide the block into 1..64 sectors.
+bool setCacheSectors(struct Cache *c, uint32_t sectorSize);
+
+// simulate only about fraction of the sets, picked by hashing the set
+// index; call after setCacheIndexing and before any access
+void setCacheSampling(struct Cache *c, double fraction);
+
+// lines filled at least once
+uint64_t cacheUsedLines(const struct Cache *c);
+
+// valid sectors per line over evicted and resident lines, 0..1
+double cacheSectorUtilisation(const struct Cache *c);
+
+// size the per process counters (one slot per process ID)
+void initCacheProcStats(struct Cache *c, uint32_t numProcs);
+
+// way partitioning, call after initCacheProcStats; quotas may be NULL
+// (equal split). Returns false if the geometry cannot be partitioned or
+// the policy keeps per-set state.
+bool initCachePartition(struct Cache *c,
+                        CachePartition partition,
+                        const uint32_t *quotas);
+
+// cache accesses, returns consumed cycles
 uint32_t cacheAccess(struct Cache *c,
                      uint64_t physAddr,
-                     uint32_t length);  
+                     uint32_t length,
+                     bool isWrite);  
+
+// count accesses in order, the same as cacheAccess on each: access i
+// issues gap[i] cycles after the previous one completed (the first after
+// c->now) and c->now is left at the last one's issue cycle. The sets of
+// upcoming accesses are prefetched. Returns the cycles the accesses took.
+uint64_t cacheAccessBatch(struct Cache *c,
+                          uint32_t count,
+                          const uint64_t *physAddr,
+                          const uint32_t *length,
+                          const uint8_t *isWrite,
+                          const uint32_t *gap);
+
+// functional warming: tags and replacement state follow the access,
+// no stats, no timing, not recorded, dirty victims are dropped
+void cacheWarm(struct Cache *c,
+               uint64_t physAddr,
+               uint32_t length,
+               bool isWrite);
+
+// warm-up: zero the shared counters, lines and replacement state stay
+void resetCacheStats(struct Cache *c);
+
+// zero the counters of one process (the slice count stays)
+void resetCacheProcStats(struct Cache *c, uint16_t pid);
+
+// invalidate every line, dirty lines are written back
+void cacheFlush(struct Cache *c);
 
+// a page leaving memory: its lines are invalidated, dirty ones written back first
 void cacheInvalidateRange(struct Cache *c,
                           uint64_t physBase,
                           uint64_t pageSize);
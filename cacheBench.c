@@ -0,0 +1,393 @@
+#include "sim.h"
+#include "virtualMem.h"
+#include "cache.h"
+#include "scheduler.h"
+#include "tracePool.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <time.h>
+ // gcc -O2 cacheBench.c sim.c cache.c nextUse.c virtualMem.c dram.c scheduler.c tracePool.c setIndex.c checkpoint.c intervalStats.c simProfile.c -o cacheBench -lm -lpthread
+ // ./cacheBench --save bench.sum        (reference checksums)
+ // ./cacheBench --check bench.sum       (after a change: same results, new speed)
+
+/*
+ * Simulator speed benchmark. Writes deterministic synthetic traces in the
+ * trace file format, runs a fixed matrix of configurations through the
+ * same time slice loop as cacheSim and reports throughput and a checksum
+ * of the results of each one. A configuration run by cacheSim on the same
+ * trace files gives the same counts.
+ */
+
+typedef enum {
+    GEN_SEQ,            // sequential read stream, a write every 4th instruction
+    GEN_STRIDE,         // array walked with a page + block stride
+    GEN_RANDOM,         // uniform random words over 256 MB
+    GEN_CHASE,          // pointer chase through 1M 64 byte nodes
+    GEN_NUM_KINDS
+} TraceKind;
+
+static const char *sArrKindNames[GEN_NUM_KINDS] = { "seq", "stride", "random", "chase" };
+
+struct BenchConfig {
+    const char *sName;
+    const char *sTraces;        // comma separated trace kinds, one process each
+    uint32_t   i32CacheKB;
+    uint32_t   i32BlockSize;
+    int        iAssoc;          // -1 => fully associative
+    const char *sPolicy;        // rr, ra, lr, lf, mr
+    uint32_t   i32PhysMB;
+    uint32_t   i32SystemPerc;
+    int32_t    si32Slice;       // -1 => whole trace
+};
+
+static const struct BenchConfig benchMatrix[] = {
+    { "seq-dm",     "seq",                          8,   16,  1, "rr",  256, 25,  100 },
+    { "stride-4w",  "stride",                      64,   32,  4, "rr",  256, 25,  100 },
+    { "random-8w",  "random",                     256,   64,  8, "ra",  512, 25,  100 },
+    { "chase-fa",   "chase",                       32,   64, -1, "rr",  128, 50,  100 },
+    { "chase-16w",  "chase",                     1024,   64, 16, "rr", 1024, 25, 1000 },
+    { "mix3-rr",    "seq,random,chase",           512,   16,  4, "rr",  128, 90,  100 },
+    { "mix4-ra",    "seq,stride,random,chase",    256,   32,  2, "ra",  256, 75,  500 },
+    { "mix4-big",   "seq,stride,random,chase",   8192,   64, 16, "rr", 4096, 10,   -1 },
+    { "stride-lr",  "stride",                     128,   64,  8, "lr",  256, 25,  100 },
+    { "chase-lf",   "chase",                      256,   32,  4, "lf",  512, 25,  500 },
+    { "mix2-mr",    "seq,random",                  64,   32,  8, "mr",  256, 50,  100 },
+};
+enum { NUM_BENCH_CONFIGS = sizeof(benchMatrix) / sizeof(benchMatrix[0]) };
+
+struct BenchResult {
+    uint64_t i64Instructions;
+    uint64_t i64Accesses;
+    uint64_t i64Checksum;
+    double   dSeconds;          // best of the repetitions
+};
+
+static uint64_t xorshift64(uint64_t *pState)
+{
+    uint64_t x = *pState;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *pState = x;
+}
+
+static void writeStep(FILE *fp, uint32_t i32Eip, int iLen, uint32_t i32Dst, uint32_t i32Src)
+{
+    fprintf(fp, "EIP (%02d): %08x  83 ec 08\n", iLen, i32Eip);
+    fprintf(fp, "dstM: %08x %s    srcM: %08x %s\n\n",
+            i32Dst, i32Dst ? "0000abcd" : "--------",
+            i32Src, i32Src ? "00001234" : "--------");
+}
+
+/* same kind and length => byte for byte the same file */
+static void generateTrace(const char *sPath, TraceKind kind, uint64_t i64Steps)
+{
+    FILE *fp = fopen(sPath, "w");
+    if (!fp) {
+        fprintf(stderr, "Error: failed to create trace %s\n", sPath);
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t i64Rand = 0x9E3779B97F4A7C15ULL + (uint64_t)kind;
+    uint32_t i32Eip = 0x00401000;
+    uint32_t i32Node = 0;
+
+    for (uint64_t n = 0; n < i64Steps; n++) {
+        // a 4 KB loop body of 1 - 7 byte instructions
+        int iLen = 1 + (int)(xorshift64(&i64Rand) % 7);
+        uint32_t i32Src = 0, i32Dst = 0;
+
+        switch (kind) {
+            case GEN_SEQ:
+                i32Src = 0x10000000 + (uint32_t)((n * 4) % (8u << 20));
+                if (n % 4 == 3) i32Dst = 0x20000000 + (uint32_t)((n * 4) % (8u << 20));
+                break;
+            case GEN_STRIDE:
+                i32Src = 0x10000000 + (uint32_t)((n * (4096 + 64)) % (64u << 20));
+                if (n % 8 == 7) i32Dst = i32Src;
+                break;
+            case GEN_RANDOM:
+                i32Src = 0x10000000 + (uint32_t)(xorshift64(&i64Rand) % (256u << 20)) / 4 * 4;
+                if (n % 4 == 3) i32Dst = 0x10000000 + (uint32_t)(xorshift64(&i64Rand) % (256u << 20)) / 4 * 4;
+                break;
+            default:
+                // full period LCG over the node numbers: every node once per lap
+                i32Node = (i32Node * 1664525u + 1013904223u) & ((1u << 20) - 1);
+                i32Src = 0x10000000 + i32Node * 64 + 8;
+                if (n % 16 == 15) i32Dst = i32Src - 8;
+                break;
+        }
+
+        writeStep(fp, i32Eip, iLen, i32Dst, i32Src);
+        i32Eip += (uint32_t)iLen;
+        if (i32Eip >= 0x00402000) i32Eip = 0x00401000;
+    }
+
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "Error: failed to write trace %s\n", sPath);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static uint64_t fnv1a(uint64_t i64Hash, uint64_t i64Value)
+{
+    for (int i = 0; i < 8; i++) {
+        i64Hash ^= (i64Value >> (8 * i)) & 0xff;
+        i64Hash *= 0x100000001B3ULL;
+    }
+    return i64Hash;
+}
+
+static double secondsNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the default cacheSim set up: seq frames, global LRU pages, round robin */
+static void runConfig(const struct BenchConfig *cfg, char *sArrPaths[], int iNumTraces,
+                      struct BenchResult *res)
+{
+    struct Cache cache;
+    uint64_t i64CacheSize = (uint64_t)cfg->i32CacheKB * 1024;
+    uint32_t i32NumBlocks = (uint32_t)(i64CacheSize / cfg->i32BlockSize);
+    srand(1);       // the random policy sees the same rand() stream as a fresh cacheSim
+    initCache(&cache, (uint32_t)i64CacheSize, cfg->i32BlockSize,
+              cfg->iAssoc <= 0 ? (int)i32NumBlocks : cfg->iAssoc,
+              cache_policy_from_string(cfg->sPolicy));
+
+    struct PhysicalMemory pm;
+    initPhysicalMemory(&pm, (uint64_t)cfg->i32PhysMB * 1024 * 1024, 4096, cfg->i32SystemPerc / 100.0);
+    pm.cache = &cache;
+    uint32_t i32NumColors = (cache.numSets * cache.blockSize) / 4096;
+    setFrameAllocPolicy(&pm, frame_alloc_from_string("seq"), i32NumColors ? i32NumColors : 1);
+    setPageReplPolicy(&pm, PR_LRU, PR_GLOBAL, 0);
+
+    struct VM *vms = calloc(iNumTraces, sizeof(struct VM));
+    if (!vms) {
+        fprintf(stderr, "Failed to allocate VMs\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < iNumTraces; i++) initVM(&vms[i], i, 32, 4096, &pm);
+    pm.vms = vms;
+    pm.iNumVMs = iNumTraces;
+
+    struct TracePool pool;
+    initTracePool(&pool, sArrPaths, iNumTraces, TRACE_POOL_DEFAULT_OPEN);
+    struct Scheduler sched;
+    initScheduler(&sched, SCHED_RR, iNumTraces, cfg->si32Slice);
+    initCacheProcStats(&cache, iNumTraces);
+    initCachePartition(&cache, PART_NONE, NULL);
+
+    struct SwitchModel sw = { 0, FLUSH_NONE, 1000 };
+    uint64_t i64Cycles = 0, i64Instr = 0;
+    double dStart = secondsNow();
+    runTraces(&pm, vms, &pool, iNumTraces, &sched, &cache, &sw, NULL, NULL, NULL, NULL,
+              &i64Cycles, &i64Instr);
+    double dSeconds = secondsNow() - dStart;
+
+    uint64_t h = 0xCBF29CE484222325ULL;
+    h = fnv1a(h, i64Cycles);
+    h = fnv1a(h, i64Instr);
+    h = fnv1a(h, cache.accesses);
+    h = fnv1a(h, cache.hits);
+    h = fnv1a(h, cache.misses);
+    h = fnv1a(h, cache.compulsoryMisses);
+    h = fnv1a(h, cache.conflictMisses);
+    h = fnv1a(h, cache.writebacks);
+    h = fnv1a(h, pm.i64NumAccesses);
+    h = fnv1a(h, pm.i64PagesFromFree);
+    h = fnv1a(h, pm.i64NumEvictions);
+    for (int i = 0; i < iNumTraces; i++) {
+        h = fnv1a(h, vms[i].i64NumPageFaults);
+        h = fnv1a(h, cache.procStats[i].misses);
+        h = fnv1a(h, cache.procStats[i].cycles);
+    }
+
+    if (res->dSeconds == 0.0 || dSeconds < res->dSeconds) res->dSeconds = dSeconds;
+    if (res->i64Checksum && res->i64Checksum != h)
+        fprintf(stderr, "Warning: %s gave a different checksum on a repeat run\n", cfg->sName);
+    res->i64Checksum     = h;
+    res->i64Instructions = i64Instr;
+    res->i64Accesses     = cache.accesses;
+
+    freeScheduler(&sched);
+    freeTracePool(&pool);
+    for (int i = 0; i < iNumTraces; i++) freeVM(&vms[i]);
+    free(vms);
+    freeCache(&cache);
+    freePhysicalMemory(&pm);
+}
+
+void exitBadParameters(char *msg) {
+    printf("%s\n",msg);
+    printf("Optional parameters:\n");
+    printf("  -i        instructions per generated trace (default 100000)\n");
+    printf("  -o        prefix of the generated trace files (default bench_)\n");
+    printf("  --repeat  runs of each configuration, the fastest is reported (default 3)\n");
+    printf("  --only    run just the configuration with this name\n");
+    printf("  --save    write the checksums to a file\n");
+    printf("  --check   compare the checksums with a file written by --save, exit 1 on a mismatch\n");
+}
+
+int main(int argc, char *argv[]) {
+
+    uint64_t i64Steps = 100000;
+    const char *sPrefix = "bench_";
+    int iRepeat = 3;
+    const char *sOnly = NULL;
+    const char *sSavePath = NULL;
+    const char *sCheckPath = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i],"-i")) {
+            if (i + 1 >= argc || (i64Steps = strtoull(argv[++i], NULL, 10)) == 0) {
+                exitBadParameters("Missing or invalid Trace Length");
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i],"-o")) {
+            if (i + 1 >= argc) {
+                exitBadParameters("Missing or invalid Trace Prefix");
+                return 1;
+            }
+            sPrefix = argv[++i];
+        }
+        else if (!strcmp(argv[i],"--repeat")) {
+            if (i + 1 >= argc || (iRepeat = atoi(argv[++i])) < 1) {
+                exitBadParameters("Missing or invalid Repeat Count");
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i],"--only")) {
+            if (i + 1 >= argc) {
+                exitBadParameters("Missing or invalid Configuration Name");
+                return 1;
+            }
+            sOnly = argv[++i];
+        }
+        else if (!strcmp(argv[i],"--save")) {
+            if (i + 1 >= argc) {
+                exitBadParameters("Missing or invalid Checksum File");
+                return 1;
+            }
+            sSavePath = argv[++i];
+        }
+        else if (!strcmp(argv[i],"--check")) {
+            if (i + 1 >= argc) {
+                exitBadParameters("Missing or invalid Checksum File");
+                return 1;
+            }
+            sCheckPath = argv[++i];
+        }
+        else {
+            exitBadParameters("Unknown parameter");
+            return 1;
+        }
+    }
+
+    // read the reference first: a file saved with another -i fails before the runs
+    uint64_t i64ArrExpected[NUM_BENCH_CONFIGS] = { 0 };
+    bool bArrExpected[NUM_BENCH_CONFIGS] = { false };
+    if (sCheckPath) {
+        FILE *fp = fopen(sCheckPath, "r");
+        if (!fp) {
+            fprintf(stderr, "Error: failed to open checksum file %s\n", sCheckPath);
+            exit(EXIT_FAILURE);
+        }
+        char sName[64], sValue[32];
+        while (fscanf(fp, "%63s %31s", sName, sValue) == 2) {
+            if (strcmp(sName, "instructions") == 0) {
+                if (strtoull(sValue, NULL, 10) != i64Steps) {
+                    fprintf(stderr, "Error: %s was saved with -i %s\n", sCheckPath, sValue);
+                    exit(EXIT_FAILURE);
+                }
+                continue;
+            }
+            for (int c = 0; c < NUM_BENCH_CONFIGS; c++) {
+                if (strcmp(sName, benchMatrix[c].sName) != 0) continue;
+                i64ArrExpected[c] = strtoull(sValue, NULL, 16);
+                bArrExpected[c] = true;
+            }
+        }
+        fclose(fp);
+    }
+
+    // one trace file per kind, shared by every configuration
+    char sArrPathBuf[GEN_NUM_KINDS][512];
+    for (int k = 0; k < GEN_NUM_KINDS; k++) {
+        snprintf(sArrPathBuf[k], sizeof(sArrPathBuf[k]), "%s%s.trc", sPrefix, sArrKindNames[k]);
+        generateTrace(sArrPathBuf[k], (TraceKind)k, i64Steps);
+    }
+
+    printf("Cache Simulator Benchmark - %" PRIu64 " instructions per trace, best of %d\n\n", i64Steps, iRepeat);
+    printf("%-11s %-24s %10s %10s %9s %8s %9s  %-16s\n",
+           "Config", "Traces", "Instr", "Accesses", "Seconds", "MIPS", "M Acc/s", "Checksum");
+
+    struct BenchResult arrResults[NUM_BENCH_CONFIGS];
+    memset(arrResults, 0, sizeof(arrResults));
+    double dTotalSeconds = 0.0;
+    uint64_t i64TotalInstr = 0, i64TotalAccesses = 0;
+
+    for (int c = 0; c < NUM_BENCH_CONFIGS; c++) {
+        const struct BenchConfig *cfg = &benchMatrix[c];
+        if (sOnly && strcmp(sOnly, cfg->sName) != 0) continue;
+
+        char *sArrPaths[GEN_NUM_KINDS];
+        int iNumTraces = 0;
+        char sKinds[64];
+        snprintf(sKinds, sizeof(sKinds), "%s", cfg->sTraces);
+        for (char *sKind = strtok(sKinds, ","); sKind; sKind = strtok(NULL, ",")) {
+            for (int k = 0; k < GEN_NUM_KINDS; k++)
+                if (strcmp(sKind, sArrKindNames[k]) == 0) sArrPaths[iNumTraces++] = sArrPathBuf[k];
+        }
+
+        struct BenchResult *res = &arrResults[c];
+        for (int r = 0; r < iRepeat; r++)
+            runConfig(cfg, sArrPaths, iNumTraces, res);
+
+        double dSec = res->dSeconds > 0 ? res->dSeconds : 1e-9;
+        printf("%-11s %-24s %10" PRIu64 " %10" PRIu64 " %9.3f %8.2f %9.2f  %016" PRIx64 "\n",
+               cfg->sName, cfg->sTraces, res->i64Instructions, res->i64Accesses, res->dSeconds,
+               res->i64Instructions / dSec / 1e6, res->i64Accesses / dSec / 1e6, res->i64Checksum);
+        dTotalSeconds    += res->dSeconds;
+        i64TotalInstr    += res->i64Instructions;
+        i64TotalAccesses += res->i64Accesses;
+    }
+    if (dTotalSeconds > 0)
+        printf("\n%-36s %10" PRIu64 " %10" PRIu64 " %9.3f %8.2f %9.2f\n", "Total", i64TotalInstr, i64TotalAccesses,
+               dTotalSeconds, i64TotalInstr / dTotalSeconds / 1e6, i64TotalAccesses / dTotalSeconds / 1e6);
+
+    if (sSavePath) {
+        FILE *fp = fopen(sSavePath, "w");
+        if (!fp) {
+            fprintf(stderr, "Error: failed to open checksum file %s\n", sSavePath);
+            exit(EXIT_FAILURE);
+        }
+        fprintf(fp, "instructions %" PRIu64 "\n", i64Steps);
+        for (int c = 0; c < NUM_BENCH_CONFIGS; c++)
+            if (arrResults[c].i64Checksum)
+                fprintf(fp, "%s %016" PRIx64 "\n", benchMatrix[c].sName, arrResults[c].i64Checksum);
+        fclose(fp);
+    }
+
+    int iMismatches = 0, iChecked = 0;
+    for (int c = 0; c < NUM_BENCH_CONFIGS && sCheckPath; c++) {
+        if (!bArrExpected[c] || !arrResults[c].i64Checksum) continue;
+        iChecked++;
+        if (arrResults[c].i64Checksum != i64ArrExpected[c]) {
+            printf("MISMATCH %s: %016" PRIx64 ", expected %016" PRIx64 "\n",
+                   benchMatrix[c].sName, arrResults[c].i64Checksum, i64ArrExpected[c]);
+            iMismatches++;
+        }
+    }
+    if (sCheckPath)
+        printf("\n%d of %d checksums match %s\n", iChecked - iMismatches, iChecked, sCheckPath);
+
+    return iMismatches ? 1 : 0;
+}
@@ -1,5 +1,15 @@
 #include "virtualMem.h"
 #include "cache.h"
+#include "dram.h"
+#include "scheduler.h"
+#include "tracePool.h"
+#include "setIndex.h"
+#include "checkpoint.h"
+#include "intervalStats.h"
+#include "resultWriter.h"
+#include "simProfile.h"
+#include "hostCounters.h"
+#include "sim.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -14,96 +24,6 @@
 
 
 
-static bool processTraceStep(struct VM *vm,
-                             FILE *fp,
-                             struct Cache *cache,
-                             uint64_t *pTotalCycles,
-                             uint64_t *pTotalInstr)
-{
-    char lineEIP[256], lineMem[256], blank[8];
-    if (!fgets(lineEIP, sizeof(lineEIP), fp)) return false;   // EOF
-    if (!fgets(lineMem, sizeof(lineMem), fp)) return false;
-    fgets(blank, sizeof(blank), fp); // skip separator (may hit EOF)
-
-    int instrLen = 0;
-    uint64_t eip = 0, src = 0, dst = 0;
-    char srcData[16] = "", dstData[16] = "";
-
-    // Ahora también leemos la longitud de la instrucción
-    sscanf(lineEIP, "EIP (%d): %" SCNx64, &instrLen, &eip);
-    sscanf(lineMem, "dstM: %" SCNx64 " %8s   srcM: %" SCNx64 " %8s",
-           &dst, dstData, &src, srcData);
-
-    // 1) Instrucción (EIP)
-    if (eip && instrLen > 0) {
-        uint64_t physEip = translateAddress(vm, eip, false);   // instrucción = read
-        uint32_t cyclesCache = cacheAccess(cache, physEip, (uint32_t)instrLen);
-        *pTotalCycles += cyclesCache;
-        *pTotalCycles += 2;            // +2 ciclos por ejecutar la instrucción
-        (*pTotalInstr)++;              // contamos una instrucción
-        cache->instrBytes += (uint64_t)instrLen;
-    }
-
-    // 2) srcM (lectura de 4 bytes)
-    if (strcmp(srcData, "--------") != 0 && src != 0) {
-        uint64_t physSrc = translateAddress(vm, src, false);   // read
-        uint32_t cyclesCache = cacheAccess(cache, physSrc, 4);
-        *pTotalCycles += cyclesCache;
-        *pTotalCycles += 1;            // +1 ciclo por dirección efectiva
-        cache->srcDstBytes += 4;
-    }
-
-    // 3) dstM (escritura de 4 bytes)
-    if (strcmp(dstData, "--------") != 0 && dst != 0) {
-        uint64_t physDst = translateAddress(vm, dst, true);    // write
-        uint32_t cyclesCache = cacheAccess(cache, physDst, 4);
-        *pTotalCycles += cyclesCache;
-        *pTotalCycles += 1;            // +1 ciclo por dirección efectiva
-        cache->srcDstBytes += 4;
-    }
-
-    return true;
-}
-
-void runTraces(struct PhysicalMemory *pm,
-               struct VM *vms,
-               FILE **fps,
-               int numFiles,
-               int32_t si32InstructionSize,
-               struct Cache *cache,
-               uint64_t *pTotalCycles,
-               uint64_t *pTotalInstr)
-{
-    bool finished[numFiles];
-    memset(finished, 0, sizeof(finished));
-    int active = numFiles;
-    uint64_t round = 0;
-
-    while (active > 0) {
-        for (int i = 0; i < numFiles; i++) {
-            if (finished[i]) continue;
-
-            uint32_t executed = 0;
-            while (executed < si32InstructionSize || si32InstructionSize == -1) {
-                if (!processTraceStep(&vms[i], fps[i], cache, pTotalCycles, pTotalInstr)) {
-                    finished[i] = true;
-                    active--;
-                    freeFramesForProcess(vms[i].pm, vms[i].i16ProcessId);
-                    break;
-                }
-                executed++;
-                if (si32InstructionSize == -1) {
-                    // -1 = procesa TODO el archivo, sin timeslice
-                    continue;
-                }
-            }
-        }
-        round++;
-    }
-}
-
-
-
 const char* policy_name(char *policy){ 
     if(strcmp(policy, "lr") == 0) return "Least Recent used";
     if(strcmp(policy, "lf") == 0) return "Least Frequent used";
@@ -146,6 +66,56 @@ void exitBadParameters(char *msg) {
     printf("  -u  physical memory used (value range: 0 - 100)\n");
     printf("  -n  Instructions / Time Slice (value range: 1 - inf  | -1 for ALL)\n");
     printf("  -f  File name to parse\n");
+    printf("Optional parameters:\n");
+    printf("  --dram         DRAM timing model behind the cache (open | closed page)\n");
+    printf("  --dram-geom    channels,ranks,banks (default 1,1,8)\n");
+    printf("  --dram-map     address mapping (row : row interleaved | line : line interleaved)\n");
+    printf("  --dram-timing  tCAS,tRCD,tRP in cycles (default 11,11,11)\n");
+    printf("  --frame-alloc  physical frame placement (seq | random | bin | color)\n");
+    printf("  --page-repl    page replacement (lru | fifo | sc : second chance | clock | wsclock | aging | lfu | opt)\n");
+    printf("  --page-scope   page replacement victims (global | local : faulting process only)\n");
+    printf("  --ws-window    WSClock working set window in translations (default 50000)\n");
+    printf("  --minor-fault  cycles to handle any page fault (default 0)\n");
+    printf("  --swap         latency,bytes per cycle of the swap device (default: free)\n");
+    printf("  --partition    way partitioning per process (none | static | ucp)\n");
+    printf("  --way-quota    ways per trace for static partitioning, in -f order (e.g. 2,1,1)\n");
+    printf("  --sector       sector size in bytes; lines fetch only the sectors touched (default: whole block)\n");
+    printf("  --sample       period,unit[,warmup] instructions: detailed units every period, the rest warmed only\n");
+    printf("  --warmup       N | @EIP: counters are zeroed after N instructions or the first EIP\n");
+    printf("  --warmup-trace N | @EIP: same, counted separately for each trace\n");
+    printf("  --interval     instructions per interval record (default: none)\n");
+    printf("  --interval-file  file the interval records go to\n");
+    printf("  --interval-format  interval record format (csv | json : one object per line)\n");
+    printf("  --results      file every parameter, calculated value and result is appended to\n");
+    printf("  --results-format  results record format (json : one object per line | csv)\n");
+    printf("  --host-counters  read the host CPU's perf counters around the simulation (Linux)\n");
+    printf("  --per-process  print cache usage per process (also with --partition or --frame-alloc)\n");
+    printf("  --checkpoint   file to save the simulator state to\n");
+    printf("  --checkpoint-at  instructions to run before saving the checkpoint\n");
+    printf("  --restore      checkpoint file to resume from\n");
+    printf("  --set-index    cache set index function (mod | xor | prime | skew : per-way hash)\n");
+    printf("  --tlb          entries,ways of a shared TLB (default: no TLB)\n");
+    printf("  --cs-cycles    cycles charged per context switch (default 0)\n");
+    printf("  --cs-flush     flush on switch (none | full : cache + TLB | asid : tagged TLB)\n");
+    printf("  --asids        ASIDs available to --cs-flush asid (default 8)\n");
+    printf("  --reload-window  block accesses measured after each switch (default 1000, at most half of -n)\n");
+    printf("  --sched        scheduler (rr | lottery | srt : shortest remaining | cfs)\n");
+    printf("  --quanta       instructions per slice for each trace, in -f order (overrides -n)\n");
+    printf("  --weights      tickets / CFS weight for each trace, in -f order (default 1)\n");
+    printf("  --max-open     trace files kept open at once, others are reopened on demand (default 64)\n");
+}
+
+const char* frame_alloc_name(char *policy){
+    if(strcmp(policy, "random") == 0) return "Random";
+    if(strcmp(policy, "bin") == 0) return "Bin Hopping";
+    if(strcmp(policy, "color") == 0) return "Page Coloring";
+    return "Sequential";
+}
+
+const char* partition_name(char *partition){
+    if(strcmp(partition, "static") == 0) return "Static Way Quotas";
+    if(strcmp(partition, "ucp") == 0) return "Utility-Based (UCP)";
+    return "None (Shared)";
 }
 
 void printSimulationResults(struct PhysicalMemory *pm, 
@@ -176,6 +146,26 @@ void printSimulationResults(struct PhysicalMemory *pm,
     printf("%8sPage Table Hits:       %8llu\n", "", (unsigned long long)i64TotalHits);
     printf("%8sPages from Free:       %8llu\n", "", (unsigned long long)pm->i64PagesFromFree);
     printf("%8sTotal Page Faults:     %8llu\n\n", "", (unsigned long long)i64TotalFaults);
+    if (pm->replPolicy == PR_WSCLOCK)
+        printf("Pages Cleaned (WSClock):       %8llu\n", (unsigned long long)pm->i64PageCleanings);
+    if (pm->replScope == PR_LOCAL)
+        printf("Local Victims From Others:     %8llu\n", (unsigned long long)pm->i64LocalSteals);
+    if (pm->replPolicy == PR_WSCLOCK || pm->replScope == PR_LOCAL)
+        printf("\n");
+
+    const struct FaultModel *fm = &pm->faultModel;
+    if (fm->i32MinorCycles || fm->i32SwapLatency || fm->i32SwapBytesPerCycle) {
+        printf("Page Fault Service:\n");
+        printf("%8sMinor Faults:          %8llu\n", "", (unsigned long long)pm->i64MinorFaults);
+        printf("%8sMajor Faults:          %8llu\n", "", (unsigned long long)pm->i64MajorFaults);
+        printf("%8sSwap Reads:            %8llu\n", "", (unsigned long long)pm->i64SwapReads);
+        printf("%8sSwap Writes:           %8llu\n", "", (unsigned long long)pm->i64SwapWrites);
+        printf("%8sCache Writebacks:      %8llu\n", "", (unsigned long long)pm->i64EvictWritebacks);
+        printf("%8sFault Stall Cycles:    %8llu\n", "", (unsigned long long)pm->i64FaultCycles);
+        printf("%8s--- Fault Handling:    %8llu\n", "", (unsigned long long)pm->i64MinorFaultCycles);
+        printf("%8s--- Swap In Wait:      %8llu\n", "", (unsigned long long)pm->i64SwapInCycles);
+        printf("%8s--- Dirty Write Wait:  %8llu\n\n", "", (unsigned long long)pm->i64SwapOutCycles);
+    }
 
     printf("Page Table Usage Per Process:\n");
     printf("-------------------------------\n\n");
@@ -188,11 +178,7 @@ void printSimulationResults(struct PhysicalMemory *pm,
     for (int i = 0; i < iNumVMs; i++) {
         struct VM *vm = &vms[i];
 
-        uint64_t i64UsedPTEs = 0;
-        for (uint64_t p = 0; p < vm->i64NumVPages; p++) {
-            if (vm->pageTable[p].i8Flags & 0x1)
-                i64UsedPTEs++;
-        }
+        uint64_t i64UsedPTEs = countValidPTEs(vm);
 
         uint64_t i64TableBits = i64LogicalEntries * i32PteBits;
         uint64_t i64UsedBits  = i64UsedPTEs      * i32PteBits;
@@ -203,11 +189,183 @@ void printSimulationResults(struct PhysicalMemory *pm,
         printf("[%d] %s:\n", i, sArrFileNames[i]);
         printf("%8sUsed Page Table Entries: %llu ( %.2f%% )\n",
             "", (unsigned long long)i64UsedPTEs, dUsedPct);
+        if (pm->i64NumEvictions > 0)
+            printf("%8sPages Evicted:      %llu\n", "", (unsigned long long)vm->i64NumEvicted);
         printf("%8sPage Table Wasted: %llu bytes\n\n\n",
             "", (unsigned long long)i64TotalWasted);
     }
 }
 
+void printContextSwitchResults(struct Cache *cache,
+                               struct PhysicalMemory *pm,
+                               char *sArrFileNames[],
+                               int iNumVMs,
+                               const struct SwitchModel *sw)
+{
+    printf("\n***** CONTEXT SWITCH RESULTS *****\n\n");
+    printf("%-32s%u cycles\n", "Cost Per Switch:", sw->i32Cycles);
+    printf("%-32s%s\n", "Flush On Switch:",
+           sw->mode == FLUSH_FULL ? "Cache + TLB" : sw->mode == FLUSH_ASID ? "ASID-tagged TLB" : "None");
+    printf("%-32s%u block accesses\n", "Reload Window:", sw->i32ReloadWindow);
+    printf("%-32s%" PRIu64 "\n", "Cache Flushes:", cache->flushes);
+    if (pm->tlb) {
+        printf("%-32s%" PRIu64 "\n", "TLB Flushes:", pm->tlb->i64Flushes);
+        printf("%-32s%" PRIu64 "\n", "ASID Recycles:", pm->tlb->i64AsidRecycles);
+    }
+    printf("\n");
+
+    for (int i = 0; i < iNumVMs; i++) {
+        struct CacheProcStats *ps = &cache->procStats[i];
+
+        // misses outside the windows and past the cold first slice give the steady state
+        double dReloadRate = ps->reloadAccesses ? (double)ps->reloadMisses / (double)ps->reloadAccesses : 0.0;
+        char sSteady[32] = "n/a";
+        char sExtra[32]  = "n/a";
+        if (ps->steadyAccesses) {
+            double dSteadyRate  = (double)ps->steadyMisses / (double)ps->steadyAccesses;
+            double dExtraMisses = (double)ps->reloadMisses - dSteadyRate * (double)ps->reloadAccesses;
+            if (dExtraMisses < 0.0) dExtraMisses = 0.0;
+            snprintf(sSteady, sizeof(sSteady), "%.4f%%", 100.0 * dSteadyRate);
+            snprintf(sExtra, sizeof(sExtra), "%.2f",
+                     ps->switchIns ? dExtraMisses / (double)ps->switchIns : 0.0);
+        }
+
+        printf("[%d] %s:\n", i, sArrFileNames[i]);
+        printf("%8sSwitches In:             %" PRIu64 "  ( %" PRIu64 " cycles )\n", "", ps->switchIns, ps->switchCycles);
+        printf("%8sReload Miss Rate:        %.4f%%  ( steady state %s )\n", "",
+               100.0 * dReloadRate, sSteady);
+        printf("%8sExtra Misses Per Switch: %s\n\n", "", sExtra);
+    }
+}
+
+void printSampleResults(const struct SampleModel *smp, uint64_t i64TotalInstr)
+{
+    uint64_t n = smp->i64Units;
+    printf("\n***** SAMPLED SIMULATION *****\n\n");
+    printf("%-32s%" PRIu64 " x %u instructions (+%u warming) every %" PRIu64 "\n",
+           "Detailed Units:", n, smp->i32Unit, smp->i32Warmup, smp->i64Period);
+    printf("%-32s%" PRIu64 " ( %.2f%% of instructions )\n", "Instructions In Detail:",
+           smp->i64DetailedInstr, i64TotalInstr ? 100.0 * smp->i64DetailedInstr / i64TotalInstr : 0.0);
+    printf("%-32s%s\n", "Unit Placement:", "random offset per period of each trace (bounds assume unbiased units)");
+    if (n < 2) {
+        printf("%-32s%s\n", "Error Bounds:", "need at least 2 units");
+        return;
+    }
+
+    // unit CPIs are the samples; 95% interval from their spread
+    double dCpi    = smp->dSumCpi / n;
+    double dCpiVar = (smp->dSumCpiSq - n * dCpi * dCpi) / (n - 1);
+    double dCpiHalf = 1.96 * sqrt(dCpiVar > 0 ? dCpiVar : 0) / sqrt((double)n);
+    printf("%-32s%.4f +/- %.4f (95%%, %.2f%%)\n", "CPI Estimate:", dCpi, dCpiHalf,
+           dCpi > 0 ? 100.0 * dCpiHalf / dCpi : 0.0);
+
+    // miss rate as a ratio estimate over the units
+    double dRate = smp->dSumAccesses > 0 ? smp->dSumMisses / smp->dSumAccesses : 0.0;
+    double dResid = smp->dSumMissesSq - 2 * dRate * smp->dSumCross + dRate * dRate * smp->dSumAccessesSq;
+    double dMeanAcc = smp->dSumAccesses / n;
+    double dRateHalf = dMeanAcc > 0
+                     ? 1.96 * sqrt((dResid > 0 ? dResid : 0) / (n - 1) / n) / dMeanAcc
+                     : 0.0;
+    printf("%-32s%.4f%% +/- %.4f%% (95%%)\n", "Miss Rate Estimate:", 100.0 * dRate, 100.0 * dRateHalf);
+}
+
+void printSchedulerResults(struct Scheduler *sched,
+                           struct Cache *cache,
+                           struct VM *vms,
+                           char *sArrFileNames[],
+                           int iNumVMs)
+{
+    printf("\n***** SCHEDULER RESULTS (%s) *****\n\n", sched_name(sched->policy));
+
+    double dSumTurnaround = 0.0;
+    for (int i = 0; i < iNumVMs; i++) {
+        struct SchedProc *p = &sched->procs[i];
+        struct CacheProcStats *ps = &cache->procStats[i];
+        struct VM *vm = &vms[i];
+
+        // every trace arrives at cycle 0
+        uint64_t i64Turnaround = p->i64Finish;
+        uint64_t i64Waiting = i64Turnaround > ps->cycles ? i64Turnaround - ps->cycles : 0;
+        dSumTurnaround += (double)i64Turnaround;
+
+        uint64_t i64TlbLookups = vm->i64TlbHits + vm->i64TlbMisses;
+        printf("[%d] %s:\n", i, sArrFileNames[i]);
+        printf("%8sQuantum / Weight:        %d / %u\n", "", p->si32Quantum, p->i32Weight);
+        printf("%8sSlices:                  %" PRIu64 "  ( %" PRIu64 " instructions )\n", "", p->i64Slices, p->i64Executed);
+        printf("%8sResponse Time:           %" PRIu64 " cycles\n", "", p->i64FirstRun);
+        printf("%8sTurnaround Time:         %" PRIu64 " cycles\n", "", i64Turnaround);
+        printf("%8sWaiting Time:            %" PRIu64 " cycles\n", "", i64Waiting);
+        printf("%8sCache Miss Rate:         %.4f%%\n", "",
+               ps->accesses ? 100.0 * (double)ps->misses / (double)ps->accesses : 0.0);
+        printf("%8sReload Misses:           %" PRIu64 " / %" PRIu64 " ( %" PRIu64 " switches in )\n", "",
+               ps->reloadMisses, ps->reloadAccesses, ps->switchIns);
+        if (vm->pm->tlb)
+            printf("%8sTLB Miss Rate:           %.4f%%\n", "",
+                   i64TlbLookups ? 100.0 * (double)vm->i64TlbMisses / (double)i64TlbLookups : 0.0);
+        printf("\n");
+    }
+    printf("%-32s%.0f cycles\n", "Average Turnaround Time:", iNumVMs ? dSumTurnaround / iNumVMs : 0.0);
+}
+
+void printCacheResultsPerProcess(struct Cache *cache,
+                                 struct VM *vms,
+                                 char *sArrFileNames[],
+                                 int iNumVMs,
+                                 const char *sFrameAlloc,
+                                 uint32_t i32NumColors)
+{
+    printf("\n\nCache Usage Per Process (%s, %u page colors):\n", sFrameAlloc, i32NumColors);
+    printf("-------------------------------\n\n");
+
+    for (int i = 0; i < iNumVMs; i++) {
+        struct CacheProcStats *ps = &cache->procStats[i];
+        struct VM *vm = &vms[i];
+
+        double dHitRate = ps->accesses ? 100.0 * (double)ps->hits / (double)ps->accesses : 0.0;
+        double dConflictPct = ps->misses ? 100.0 * (double)ps->conflictMisses / (double)ps->misses : 0.0;
+        double dProcCpi = ps->instructions ? (double)ps->cycles / (double)ps->instructions : 0.0;
+        double dPTHitRate = vm->i64NumAccesses ? 100.0 * (double)vm->i64PageTableHits / (double)vm->i64NumAccesses : 0.0;
+
+        printf("[%d] %s:\n", i, sArrFileNames[i]);
+        printf("%8sTotal Cache Accesses:    %" PRIu64 " ( %" PRIu64 " addresses )\n", "", ps->accesses, ps->addresses);
+        printf("%8s--- Instruction Bytes:   %" PRIu64 "\n", "", ps->instrBytes);
+        printf("%8s--- SrcDst Bytes:        %" PRIu64 "\n", "", ps->srcDstBytes);
+        printf("%8sCache Hits:              %" PRIu64 "\n", "", ps->hits);
+        printf("%8sCache Misses:            %" PRIu64 "\n", "", ps->misses);
+        printf("%8s--- Compulsory Misses:   %" PRIu64 "\n", "", ps->compulsoryMisses);
+        printf("%8s--- Conflict Misses:     %" PRIu64 " ( %.2f%% of misses )\n", "", ps->conflictMisses, dConflictPct);
+        printf("%8sHit Rate:                %.4f%%\n", "", dHitRate);
+        printf("%8sMiss Rate:               %.4f%%\n", "", ps->accesses ? 100.0 - dHitRate : 0.0);
+        printf("%8sCPI:                     %.2f Cycles/Instruction (%" PRIu64 ")\n", "", dProcCpi, ps->instructions);
+        printf("%8sCycles:                  %" PRIu64 "\n", "", ps->cycles);
+        printf("%8sDirty Writebacks:        %" PRIu64 "\n", "", ps->writebacks);
+        if (cache->partition != PART_NONE)
+            printf("%8sWay Quota:               %u / %u\n", "", cache->wayQuota[i], cache->associativity);
+        printf("%8sEvicted Other Processes: %" PRIu64 "\n", "", ps->crossEvictions);
+        printf("%8sLost To Other Processes: %" PRIu64 "\n", "", ps->lostToOthers);
+        printf("%8sPage Translations:       %" PRIu64 "\n", "", vm->i64NumAccesses);
+        printf("%8s--- Page Table Hits:     %" PRIu64 " ( %.2f%% )\n", "", vm->i64PageTableHits, dPTHitRate);
+        printf("%8s--- Pages from Free:     %" PRIu64 "\n", "", vm->i64PagesFromFree);
+        printf("%8s--- Page Faults:         %" PRIu64 "\n", "", vm->i64NumPageFaults);
+        const struct FaultModel *fm = &vm->pm->faultModel;
+        if (fm->i32MinorCycles || fm->i32SwapLatency || fm->i32SwapBytesPerCycle) {
+            printf("%8sMinor / Major Faults:    %" PRIu64 " / %" PRIu64 "\n", "", vm->i64MinorFaults, vm->i64MajorFaults);
+            printf("%8sFault Stall Cycles:      %" PRIu64 " ( %.2f%% of cycles )\n", "", vm->i64FaultCycles,
+                   ps->cycles ? 100.0 * (double)vm->i64FaultCycles / (double)ps->cycles : 0.0);
+        }
+        if (vm->pm->tlb) {
+            uint64_t i64TlbLookups = vm->i64TlbHits + vm->i64TlbMisses;
+            printf("%8sTLB Hits:                %" PRIu64 " ( %.2f%% )\n", "", vm->i64TlbHits,
+                   i64TlbLookups ? 100.0 * (double)vm->i64TlbHits / (double)i64TlbLookups : 0.0);
+            printf("%8sTLB Misses:              %" PRIu64 "\n", "", vm->i64TlbMisses);
+        }
+        printf("\n\n");
+    }
+
+    if (cache->partition == PART_UCP)
+        printf("UCP Repartitions:        %" PRIu64 "\n", cache->repartitions);
+}
+
 
 int main(int argc, char *argv[]) {
 
@@ -234,15 +392,64 @@ int main(int argc, char *argv[]) {
     uint8_t iAddressBusOffsetSize = 0;
     uint32_t i32CacheSizeOverhead = 0;
 
-    char *sArrFileNames[3];
-
-
-    uint8_t i8FileCount = 0;
-    uint8_t i8FileCountUseable = 0;
+    char **sArrFileNames = NULL;        // grows with each -f
+    int iFileCapacity = 0;
+    int iFileCount = 0;
+    int iFileCountUseable = 0;
+    uint32_t i32MaxOpen = TRACE_POOL_DEFAULT_OPEN;
+    struct TracePool tracePool;
     struct Cache cache;
     uint64_t totalCycles = 0;
     uint64_t totalInstructions = 0;
 
+    char sDramPolicy[8] = "";           // "" => fixed latency memory
+    char sDramMap[8] = "row";
+    uint32_t i32DramChannels = 1, i32DramRanks = 1, i32DramBanks = 8;
+    uint32_t i32tCAS = DRAM_DEFAULT_TCAS, i32tRCD = DRAM_DEFAULT_TRCD, i32tRP = DRAM_DEFAULT_TRP;
+    struct DRAM dram;
+
+    char sFrameAlloc[8] = "seq";        // seq, random, bin (bin hopping), color (page coloring)
+    char sPageRepl[8] = "lru";          // lru, fifo, sc, clock, wsclock, aging, lfu, opt
+    char sPageScope[8] = "global";      // global, local
+    uint64_t i64WsWindow = 0;           // 0 => WSCLOCK_DEFAULT_WINDOW
+    struct FaultModel faultModel = { 0, 0, 0 };
+    char sPartition[8] = "none";        // none, static, ucp (utility-based)
+    char sSetIndex[8] = "mod";          // mod, xor, prime, skew
+    bool bSetIndexGiven = false;        // --set-index given
+    uint32_t i32SectorSize = 0;         // 0 => whole block per fill
+    struct SampleModel sample;
+    memset(&sample, 0, sizeof(sample));
+    struct WarmupModel warmup;
+    memset(&warmup, 0, sizeof(warmup));
+    bool bWarmup = false;
+    uint64_t i64Interval = 0;           // 0 => no interval records
+    char *sIntervalFile = NULL;
+    char sIntervalFormat[8] = "csv";    // csv, json
+    struct IntervalLog intervalLog;
+    char *sResultsFile = NULL;
+    char sResultsFormat[8] = "json";    // json, csv
+    struct ResultWriter results;
+    bool bHostCounters = false;
+    bool bPerProcess = false;
+    struct HostCounters hostCounters;
+    struct CheckpointPlan ckpt = { NULL, 0, false, NULL, -1 };
+    bool bCheckpointAt = false;
+    char *sWayQuota = NULL;             // comma separated ways per trace
+
+    uint32_t i32TlbEntries = 0, i32TlbWays = 4;     // 0 entries => no TLB
+    uint32_t i32NumAsids = 8;
+    char sFlushMode[8] = "none";        // none, full, asid
+    struct SwitchModel switchModel = { 0, FLUSH_NONE, 1000 };
+    bool bReloadWindow = false;         // --reload-window given
+    bool bSwitchModel = false;          // --cs-cycles, --cs-flush or --reload-window given
+    struct TLB tlb;
+
+    char sSched[8] = "rr";              // rr, lottery, srt, cfs
+    char *sQuanta = NULL;               // comma separated, in -f order
+    char *sWeights = NULL;
+    bool bSchedGiven = false;           // --sched given
+    struct Scheduler sched;
+
 
     for (int i = 1; i < argc; i++) {
         if (!strcmp(argv[i],"-s")) {
@@ -292,7 +499,280 @@ int main(int argc, char *argv[]) {
         else if (!strcmp(argv[i],"-f")) {
             //printf("reading -f\n");
             // read a file name
-            sArrFileNames[i8FileCount++] = argv[++i];    // filename, EACH filename follows -f
+            if (i + 1 >= argc) {
+                exitBadParameters("Missing or invalid Trace File");
+                return 1;
+            }
+            if (iFileCount == iFileCapacity) {
+                iFileCapacity = iFileCapacity ? iFileCapacity * 2 : 4;
+                sArrFileNames = realloc(sArrFileNames, iFileCapacity * sizeof(char *));
+                if (!sArrFileNames) {
+                    fprintf(stderr, "Failed to allocate trace list\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            sArrFileNames[iFileCount++] = argv[++i];    // filename, EACH filename follows -f
+        }
+        else if (!strcmp(argv[i],"--max-open")) {
+            if (i + 1 >= argc || (i32MaxOpen = (uint32_t)atoi(argv[++i])) == 0) {
+                exitBadParameters("Missing or invalid Open Trace Limit");
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i],"--dram")) {
+            if (i + 1 >= argc || (strcmp(argv[i+1],"open") && strcmp(argv[i+1],"closed"))) {
+                exitBadParameters("Missing or invalid DRAM Page Policy");
+                return 1;
+            }
+            strcpy(sDramPolicy,argv[++i]);
+        }
+        else if (!strcmp(argv[i],"--dram-geom")) {
+            if (i + 1 >= argc || sscanf(argv[++i], "%u,%u,%u", &i32DramChannels, &i32DramRanks, &i32DramBanks) != 3
+                || !i32DramChannels || !i32DramRanks || !i32DramBanks) {
+                exitBadParameters("Missing or invalid DRAM Geometry");
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i],"--dram-map")) {
+            if (i + 1 >= argc || (strcmp(argv[i+1],"row") && strcmp(argv[i+1],"line"))) {
+                exitBadParameters("Missing or invalid DRAM Address Mapping");
+                return 1;
+            }
+            strcpy(sDramMap,argv[++i]);
+        }
+        else if (!strcmp(argv[i],"--frame-alloc")) {
+            if (i + 1 >= argc || (strcmp(argv[i+1],"seq") && strcmp(argv[i+1],"random")
+                               && strcmp(argv[i+1],"bin") && strcmp(argv[i+1],"color"))) {
+                exitBadParameters("Missing or invalid Frame Allocation Policy");
+                return 1;
+            }
+            strcpy(sFrameAlloc,argv[++i]);
+        }
+        else if (!strcmp(argv[i],"--page-repl")) {
+            if (i + 1 >= argc || (strcmp(argv[i+1],"lru") && strcmp(argv[i+1],"fifo")
+                               && strcmp(argv[i+1],"sc") && strcmp(argv[i+1],"clock")
+                               && strcmp(argv[i+1],"wsclock") && strcmp(argv[i+1],"aging")
+                               && strcmp(argv[i+1],"lfu") && strcmp(argv[i+1],"opt"))) {
+                exitBadParameters("Missing or invalid Page Replacement Policy");
+                return 1;
+            }
+            strcpy(sPageRepl,argv[++i]);
+        }
+        else if (!strcmp(argv[i],"--page-scope")) {
+            if (i + 1 >= argc || (strcmp(argv[i+1],"global") && strcmp(argv[i+1],"local"))) {
+                exitBadParameters("Missing or invalid Page Replacement Scope");
+                return 1;
+            }
+            strcpy(sPageScope,argv[++i]);
+        }
+        else if (!strcmp(argv[i],"--minor-fault")) {
+            if (i + 1 >= argc) {
+                exitBadParameters("Missing or invalid Minor Fault Cycles");
+                return 1;
+            }
+            faultModel.i32MinorCycles = (uint32_t)atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i],"--swap")) {
+            if (i + 1 >= argc || sscanf(argv[++i], "%u,%u", &faultModel.i32SwapLatency,
+                                        &faultModel.i32SwapBytesPerCycle) != 2) {
+                exitBadParameters("Missing or invalid Swap Device");
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i],"--ws-window")) {
+            if (i + 1 >= argc || (i64WsWindow = strtoull(argv[++i], NULL, 10)) == 0) {
+                exitBadParameters("Missing or invalid Working Set Window");
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i],"--partition")) {
+            if (i + 1 >= argc || (strcmp(argv[i+1],"none") && strcmp(argv[i+1],"static")
+                               && strcmp(argv[i+1],"ucp"))) {
+                exitBadParameters("Missing or invalid Cache Partitioning");
+                return 1;
+            }
+            strcpy(sPartition,argv[++i]);
+        }
+        else if (!strcmp(argv[i],"--sample")) {
+            int iFields = 0;
+            if (i + 1 < argc)
+                iFields = sscanf(argv[++i], "%" SCNu64 ",%u,%u", &sample.i64Period,
+                                 &sample.i32Unit, &sample.i32Warmup);
+            if (iFields < 2) sample.i64Period = 0;
+            if (iFields == 2) sample.i32Warmup = sample.i32Unit;
+            if (sample.i64Period == 0 || sample.i32Unit == 0 ||
+                sample.i64Period <= (uint64_t)sample.i32Unit + sample.i32Warmup) {
+                exitBadParameters("Missing or invalid Sampling Period");
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i],"--warmup") || !strcmp(argv[i],"--warmup-trace")) {
+            warmup.bPerTrace = strcmp(argv[i],"--warmup-trace") == 0;
+            warmup.i64Instr = warmup.i64MarkerEip = 0;
+            if (i + 1 < argc) {
+                const char *sWarm = argv[++i];
+                if (sWarm[0] == '@') warmup.i64MarkerEip = strtoull(sWarm + 1, NULL, 16);
+                else                 warmup.i64Instr     = strtoull(sWarm, NULL, 10);
+            }
+            if (warmup.i64Instr == 0 && warmup.i64MarkerEip == 0) {
+                exitBadParameters("Missing or invalid Warm-up");
+                return 1;
+            }
+            bWarmup = true;
+        }
+        else if (!strcmp(argv[i],"--interval")) {
+            if (i + 1 >= argc || (i64Interval = strtoull(argv[++i], NULL, 10)) == 0) {
+                exitBadParameters("Missing or invalid Interval");
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i],"--interval-file")) {
+            if (i + 1 >= argc) {
+                exitBadParameters("Missing or invalid Interval File");
+                return 1;
+            }
+            sIntervalFile = argv[++i];
+        }
+        else if (!strcmp(argv[i],"--interval-format")) {
+            if (i + 1 >= argc || (strcmp(argv[i+1],"csv") && strcmp(argv[i+1],"json"))) {
+                exitBadParameters("Missing or invalid Interval Format");
+                return 1;
+            }
+            strcpy(sIntervalFormat,argv[++i]);
+        }
+        else if (!strcmp(argv[i],"--results")) {
+            if (i + 1 >= argc) {
+                exitBadParameters("Missing or invalid Results File");
+                return 1;
+            }
+            sResultsFile = argv[++i];
+        }
+        else if (!strcmp(argv[i],"--results-format")) {
+            if (i + 1 >= argc || (strcmp(argv[i+1],"json") && strcmp(argv[i+1],"csv"))) {
+                exitBadParameters("Missing or invalid Results Format");
+                return 1;
+            }
+            strcpy(sResultsFormat,argv[++i]);
+        }
+        else if (!strcmp(argv[i],"--per-process")) {
+            bPerProcess = true;
+        }
+        else if (!strcmp(argv[i],"--host-counters")) {
+            bHostCounters = true;
+        }
+        else if (!strcmp(argv[i],"--checkpoint")) {
+            if (i + 1 >= argc) {
+                exitBadParameters("Missing or invalid Checkpoint File");
+                return 1;
+            }
+            ckpt.sSavePath = argv[++i];
+        }
+        else if (!strcmp(argv[i],"--checkpoint-at")) {
+            if (i + 1 >= argc) {
+                exitBadParameters("Missing or invalid Checkpoint Instruction");
+                return 1;
+            }
+            ckpt.i64SaveAt = strtoull(argv[++i], NULL, 10);
+            bCheckpointAt = true;
+        }
+        else if (!strcmp(argv[i],"--restore")) {
+            if (i + 1 >= argc || !file_exists_and_readable(argv[i+1])) {
+                exitBadParameters("Missing or invalid Restore File");
+                return 1;
+            }
+            ckpt.sRestorePath = argv[++i];
+        }
+        else if (!strcmp(argv[i],"--sector")) {
+            if (i + 1 >= argc || (i32SectorSize = (uint32_t)atoi(argv[++i])) == 0) {
+                exitBadParameters("Missing or invalid Sector Size");
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i],"--set-index")) {
+            if (i + 1 >= argc || (strcmp(argv[i+1],"mod") && strcmp(argv[i+1],"xor")
+                               && strcmp(argv[i+1],"prime") && strcmp(argv[i+1],"skew"))) {
+                exitBadParameters("Missing or invalid Set Index Function");
+                return 1;
+            }
+            strcpy(sSetIndex,argv[++i]);
+            bSetIndexGiven = true;
+        }
+        else if (!strcmp(argv[i],"--way-quota")) {
+            if (i + 1 >= argc) {
+                exitBadParameters("Missing or invalid Way Quota");
+                return 1;
+            }
+            sWayQuota = argv[++i];
+        }
+        else if (!strcmp(argv[i],"--tlb")) {
+            if (i + 1 >= argc || sscanf(argv[++i], "%u,%u", &i32TlbEntries, &i32TlbWays) < 1
+                || i32TlbEntries == 0) {
+                exitBadParameters("Missing or invalid TLB Size");
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i],"--cs-cycles")) {
+            if (i + 1 >= argc) {
+                exitBadParameters("Missing or invalid Context Switch Cost");
+                return 1;
+            }
+            switchModel.i32Cycles = (uint32_t)atoi(argv[++i]);
+            bSwitchModel = true;
+        }
+        else if (!strcmp(argv[i],"--cs-flush")) {
+            if (i + 1 >= argc || (strcmp(argv[i+1],"none") && strcmp(argv[i+1],"full")
+                               && strcmp(argv[i+1],"asid"))) {
+                exitBadParameters("Missing or invalid Context Switch Flush Mode");
+                return 1;
+            }
+            strcpy(sFlushMode,argv[++i]);
+            if (strcmp(sFlushMode, "full") == 0) switchModel.mode = FLUSH_FULL;
+            if (strcmp(sFlushMode, "asid") == 0) switchModel.mode = FLUSH_ASID;
+            bSwitchModel = true;
+        }
+        else if (!strcmp(argv[i],"--asids")) {
+            if (i + 1 >= argc || (i32NumAsids = (uint32_t)atoi(argv[++i])) == 0) {
+                exitBadParameters("Missing or invalid ASID Count");
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i],"--reload-window")) {
+            if (i + 1 >= argc) {
+                exitBadParameters("Missing or invalid Reload Window");
+                return 1;
+            }
+            switchModel.i32ReloadWindow = (uint32_t)atoi(argv[++i]);
+            bReloadWindow = true;
+            bSwitchModel = true;
+        }
+        else if (!strcmp(argv[i],"--sched")) {
+            if (i + 1 >= argc || (strcmp(argv[i+1],"rr") && strcmp(argv[i+1],"lottery")
+                               && strcmp(argv[i+1],"srt") && strcmp(argv[i+1],"cfs"))) {
+                exitBadParameters("Missing or invalid Scheduler");
+                return 1;
+            }
+            strcpy(sSched,argv[++i]);
+            bSchedGiven = true;
+        }
+        else if (!strcmp(argv[i],"--quanta")) {
+            if (i + 1 >= argc) {
+                exitBadParameters("Missing or invalid Quanta");
+                return 1;
+            }
+            sQuanta = argv[++i];
+        }
+        else if (!strcmp(argv[i],"--weights")) {
+            if (i + 1 >= argc) {
+                exitBadParameters("Missing or invalid Weights");
+                return 1;
+            }
+            sWeights = argv[++i];
+        }
+        else if (!strcmp(argv[i],"--dram-timing")) {
+            if (i + 1 >= argc || sscanf(argv[++i], "%u,%u,%u", &i32tCAS, &i32tRCD, &i32tRP) != 3) {
+                exitBadParameters("Missing or invalid DRAM Timing");
+                return 1;
+            }
         }
         
     }
@@ -309,6 +789,12 @@ int main(int argc, char *argv[]) {
         exitBadParameters("Missing or invalid Block Size");
         return 1;
     }
+    if (i32SectorSize != 0 &&
+        (i32SectorSize < 4 || (i32SectorSize & (i32SectorSize - 1)) != 0 ||
+         i32SectorSize > i32CacheBlockSize || i32CacheBlockSize / i32SectorSize > MAX_SECTORS)) {
+        exitBadParameters("Missing or invalid Sector Size");
+        return 1;
+    }
     if (iCacheAssoc != -1 &&
         iCacheAssoc != 1 &&
         iCacheAssoc != 2 &&
@@ -335,7 +821,26 @@ int main(int argc, char *argv[]) {
         exitBadParameters("Missing or invalid Systerm Memory Percent");
         return 1;
     }
-
+    if (bWarmup && sample.i64Period) {
+        exitBadParameters("Missing or invalid Warm-up (sampling does its own warming)");
+        return 1;
+    }
+    if ((i64Interval != 0) != (sIntervalFile != NULL)) {
+        exitBadParameters("Missing or invalid Interval (needs --interval and --interval-file)");
+        return 1;
+    }
+    if (bCheckpointAt != (ckpt.sSavePath != NULL)) {
+        exitBadParameters("Missing or invalid Checkpoint (needs --checkpoint and --checkpoint-at)");
+        return 1;
+    }
+    // a window as long as the slice leaves no steady state to compare with
+    if (si32InstructionSize > 0) {
+        if (!bReloadWindow && switchModel.i32ReloadWindow > (uint32_t)si32InstructionSize / 2)
+            switchModel.i32ReloadWindow = (uint32_t)si32InstructionSize / 2;
+        else if (bReloadWindow && switchModel.i32ReloadWindow >= (uint32_t)si32InstructionSize)
+            fprintf(stderr, "Warning: --reload-window %u is not shorter than -n %d, few accesses fall outside the windows\n",
+                    switchModel.i32ReloadWindow, si32InstructionSize);
+    }
     
     // calculate block and set counts
     i32NumCacheBlocks = (int)(i64CacheSize / i32CacheBlockSize);
@@ -353,10 +858,14 @@ int main(int argc, char *argv[]) {
     iAddressBusOffsetSize = (uint8_t)ceil(log2((double)i32CacheBlockSize));
     iAddressBusIndexSize = (uint8_t)ceil(log2((double)i32NumCacheSets));
     iAddressBusTagSize = iAddressBusSize - (iAddressBusIndexSize + iAddressBusOffsetSize);
+    if (set_index_from_string(sSetIndex) != SET_INDEX_MOD)
+        iAddressBusTagSize += iAddressBusIndexSize;     // hashed index: tag keeps the whole block address
     
 
     // calculate overhead -> Tag Space + Valid Bits (+ dirty bits?)
     i32CacheSizeOverhead = (int) ceil(i32NumCacheBlocks * (((double)iAddressBusTagSize/8) + 0.125));
+    if (i32SectorSize != 0)     // one more valid bit per extra sector
+        i32CacheSizeOverhead += (int) ceil(i32NumCacheBlocks * ((double)(i32CacheBlockSize / i32SectorSize - 1) / 8));
     
     // calculate physical pages
     i64PhysicalPages = ceil(i64PhysicalMemory / 4096); // assume default page size is 
@@ -365,25 +874,60 @@ int main(int argc, char *argv[]) {
 
     printf("Cache Simulator - CS 3853 - Team #04\n\n");
     printf("Trace File(s):\n");
-    for (int i = 0; i < i8FileCount; i++) {
+    for (int i = 0; i < iFileCount; i++) {
         if (!file_exists_and_readable(sArrFileNames[i])) {
             printf("%8s%-24s %s\n","XX ",sArrFileNames[i],"[FILE NOT FOUND]");
         }
         else {
             printf("%8s%-24s\n","",sArrFileNames[i]);
-            i8FileCountUseable++;
+            // keep readable traces packed at the front, in -f order
+            sArrFileNames[iFileCountUseable++] = sArrFileNames[i];
 
         }
     }
+    if (iFileCountUseable > UINT16_MAX) {
+        exitBadParameters("Too many Trace Files (process ids are 16 bit)");
+        return 1;
+    }
 
     printf("\n***** Cache Input Parameters *****\n\n");
     printf("%-32s%.0f KB\n","Cache Size:",byteToKB(i64CacheSize));
     printf("%-32s%d bytes\n","Block Size:",i32CacheBlockSize);
+    if (i32SectorSize != 0)
+        printf("%-32s%u bytes (%u per block)\n","Sector Size:",i32SectorSize,i32CacheBlockSize / i32SectorSize);
     printf("%-32s%d\n","Associativity:",iCacheAssoc);
     printf("%-32s%s\n","Replacement Policy:", policy_name(sCacheReplacePolicy));
     printf("%-32s%.0f MB\n","Physical Memory:",byteToMB(i64PhysicalMemory));
     printf("%-32s%-.1f\n","Percent Memory Used by System:",dSystemMemoryPerc); dSystemMemoryPerc /= 100; // set to decimal after displaying
     printf("%-32s%d\n","Instructions / Time Slice:",si32InstructionSize);
+    if (strcmp(sDramPolicy, "") != 0)
+        printf("%-32s%s page, %u ch x %u rank x %u banks\n","DRAM Model:",sDramPolicy,i32DramChannels,i32DramRanks,i32DramBanks);
+    printf("%-32s%s\n","Frame Allocation:",frame_alloc_name(sFrameAlloc));
+    printf("%-32s%s, %s\n","Page Replacement:",page_repl_name(page_repl_from_string(sPageRepl)),sPageScope);
+    if (faultModel.i32MinorCycles || faultModel.i32SwapLatency || faultModel.i32SwapBytesPerCycle)
+        printf("%-32s%u cycles + swap %u cycles, %u bytes/cycle\n","Page Fault Service:",
+               faultModel.i32MinorCycles,faultModel.i32SwapLatency,faultModel.i32SwapBytesPerCycle);
+    printf("%-32s%s\n","Cache Partitioning:",partition_name(sPartition));
+    printf("%-32s%s\n","Set Index:",set_index_name(set_index_from_string(sSetIndex)));
+    if (i32TlbEntries > 0)
+        printf("%-32s%u entries, %u-way\n","TLB:",i32TlbEntries,i32TlbWays);
+    printf("%-32s%u cycles, flush: %s\n","Context Switch:",switchModel.i32Cycles,sFlushMode);
+    printf("%-32s%s\n","Scheduler:",sched_name(sched_from_string(sSched)));
+    if (sample.i64Period)
+        printf("%-32s%u of every %" PRIu64 " instructions per trace (+%u warming)\n","Sampling:",
+               sample.i32Unit,sample.i64Period,sample.i32Warmup);
+    if (bWarmup && warmup.i64MarkerEip)
+        printf("%-32sup to EIP 0x%" PRIx64 "%s\n","Warm-up:",warmup.i64MarkerEip,warmup.bPerTrace ? ", per trace" : "");
+    else if (bWarmup)
+        printf("%-32s%" PRIu64 " instructions%s\n","Warm-up:",warmup.i64Instr,warmup.bPerTrace ? " per trace" : "");
+    if (i64Interval)
+        printf("%-32severy %" PRIu64 " instructions -> %s (%s)\n","Interval Records:",i64Interval,sIntervalFile,sIntervalFormat);
+    if (ckpt.sSavePath)
+        printf("%-32s%s after %" PRIu64 " instructions\n","Checkpoint:",ckpt.sSavePath,ckpt.i64SaveAt);
+    if (ckpt.sRestorePath)
+        printf("%-32s%s\n","Restored From:",ckpt.sRestorePath);
+    if (sResultsFile)
+        printf("%-32s%s (%s)\n","Results File:",sResultsFile,sResultsFormat);
 
     printf("\n***** Cache Calculated Values *****\n\n");
     printf("%-32s%d\n","Total # Blocks:",i32NumCacheBlocks);
@@ -404,22 +948,31 @@ int main(int argc, char *argv[]) {
     printf("%-32s%d\n","Number of Physical Pages:",i64PhysicalPages); // assume page size is 4 KB
     printf("%-32s%d\n","Number of Pages for System:",(int) ceil((double) i64PhysicalPages * dSystemMemoryPerc));
     printf("%-32s%d\n","Size of Page Table Entry:", i32PhysicalPageTableEntrySize); // physical address space + valid bit
-    printf("%-32s%d bytes\n","Total RAM for Page Table(s):", (int) ceil((512 * 1024) * i8FileCount * ((int) ceil(log2(i64PhysicalPages)) + 1) / 8));
+    printf("%-32s%" PRIu64 " bytes\n","Total RAM for Page Table(s):", (uint64_t)(512 * 1024) * iFileCount * ((int) ceil(log2(i64PhysicalPages)) + 1) / 8);
     
-    CachePolicy policy;
-    if (strcmp(sCacheReplacePolicy, "rr") == 0) {
-        policy = CACHE_RR;
-    } else {
-        // cualquier otra cosa la tratamos como random (o ajustas si quieres soportar más)
-        policy = CACHE_RND;
-    }
+    CachePolicy policy = cache_policy_from_string(sCacheReplacePolicy);
 
     initCache(&cache,
               (uint32_t)i64CacheSize,   // bytes
               i32CacheBlockSize,
               iCacheAssoc,
               policy);
-
+    setCacheIndexing(&cache, set_index_from_string(sSetIndex));
+    if (i32SectorSize != 0) setCacheSectors(&cache, i32SectorSize);
+
+    if (strcmp(sDramPolicy, "") != 0) {
+        initDRAM(&dram,
+                 i32DramChannels,
+                 i32DramRanks,
+                 i32DramBanks,
+                 i32CacheBlockSize,
+                 dram_policy_from_string(sDramPolicy),
+                 strcmp(sDramMap, "line") == 0 ? DRAM_MAP_LINE : DRAM_MAP_ROW);
+        dram.i32tCAS = i32tCAS;
+        dram.i32tRCD = i32tRCD;
+        dram.i32tRP  = i32tRP;
+        cache.dram = &dram;
+    }
     
 
     struct PhysicalMemory pm;
@@ -432,38 +985,146 @@ int main(int argc, char *argv[]) {
 
     pm.cache = &cache;    //to let virtualMem invalidate pages
 
+    // one page color per page-sized slice of a cache way
+    uint32_t i32NumColors = (cache.numSets * cache.blockSize) / 4096;
+    if (i32NumColors == 0) i32NumColors = 1;
+    setFrameAllocPolicy(&pm, frame_alloc_from_string(sFrameAlloc), i32NumColors);
+    setPageReplPolicy(&pm,
+                      page_repl_from_string(sPageRepl),
+                      strcmp(sPageScope, "local") == 0 ? PR_LOCAL : PR_GLOBAL,
+                      i64WsWindow);
+    setFaultModel(&pm, &faultModel);
+
                         
     
-    struct VM vms[i8FileCountUseable];
-    
-    FILE *fps[i8FileCountUseable];
-    for (int i = 0; i < i8FileCountUseable; i++) {
-        fps[i] = fopen(sArrFileNames[i], "r");
-        if (!fps[i]) {
-            fprintf(stderr, "Error: failed to open %s\n",sArrFileNames[i]);
-            exit(EXIT_FAILURE);
-        }
+    struct VM *vms = calloc(iFileCountUseable > 0 ? iFileCountUseable : 1, sizeof(struct VM));
+    if (!vms) {
+        fprintf(stderr, "Failed to allocate VMs\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < iFileCountUseable; i++) {
         initVM(&vms[i], i, 32, 4096, &pm);
     }
+    initTracePool(&tracePool, sArrFileNames, iFileCountUseable, i32MaxOpen);
 
     pm.vms = vms;
-    pm.iNumVMs = i8FileCountUseable;
+    pm.iNumVMs = iFileCountUseable;
+
+    initScheduler(&sched, sched_from_string(sSched), iFileCountUseable, si32InstructionSize);
+    char *sList = sQuanta;
+    for (int i = 0; sList && *sList && i < iFileCountUseable; i++) {
+        int32_t si32Quantum = (int32_t)strtol(sList, &sList, 10);
+        if (si32Quantum < -1 || si32Quantum == 0) {
+            exitBadParameters("Missing or invalid Quanta");
+            return 1;
+        }
+        sched.procs[i].si32Quantum = si32Quantum;
+        if (*sList == ',') sList++;
+    }
+    sList = sWeights;
+    for (int i = 0; sList && *sList && i < iFileCountUseable; i++) {
+        uint32_t i32Weight = (uint32_t)strtoul(sList, &sList, 10);
+        sched.procs[i].i32Weight = i32Weight ? i32Weight : 1;
+        if (*sList == ',') sList++;
+    }
+
+    if (i32TlbEntries > 0) {
+        initTLB(&tlb, i32TlbEntries, i32TlbWays,
+                switchModel.mode == FLUSH_ASID ? i32NumAsids : 0);
+        pm.tlb = &tlb;
+    }
+    initCacheProcStats(&cache, iFileCountUseable);
+
+    CachePartition partition = PART_NONE;
+    if (strcmp(sPartition, "static") == 0) partition = PART_STATIC;
+    if (strcmp(sPartition, "ucp") == 0)    partition = PART_UCP;
+    uint32_t i32ArrQuota[iFileCountUseable > 0 ? iFileCountUseable : 1];
+    bool bQuotaGiven = false;
+    if (sWayQuota && partition != PART_NONE) {
+        char *sQuota = sWayQuota;
+        for (int i = 0; i < iFileCountUseable; i++) {
+            i32ArrQuota[i] = (uint32_t)strtoul(sQuota, &sQuota, 10);
+            if (*sQuota == ',') sQuota++;
+        }
+        bQuotaGiven = true;
+    }
+    if (!initCachePartition(&cache, partition, bQuotaGiven ? i32ArrQuota : NULL)) {
+        fprintf(stderr, "Error: cannot partition %d ways among %d traces\n",
+                iCacheAssoc, iFileCountUseable);
+        exit(EXIT_FAILURE);
+    }
+
+    if (warmup.bPerTrace) {
+        warmup.iWarming = iFileCountUseable;
+        warmup.bArrWarming = malloc((iFileCountUseable > 0 ? iFileCountUseable : 1) * sizeof(bool));
+        if (!warmup.bArrWarming) {
+            fprintf(stderr, "Failed to allocate warm-up state\n");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < iFileCountUseable; i++) warmup.bArrWarming[i] = true;
+    }
+
+    if ((ckpt.sSavePath || ckpt.sRestorePath) && !checkpointSupported(&pm)) {
+        exitBadParameters("Missing or invalid Page Replacement Policy (lfu and opt cannot be checkpointed)");
+        return 1;
+    }
+    if (ckpt.sRestorePath) {
+        struct SimState st = { &pm, vms, iFileCountUseable, &tracePool, &sched, &cache, -1, 0, 0 };
+        readCheckpoint(ckpt.sRestorePath, &st);
+        ckpt.iRunning     = st.iRunning;
+        totalCycles       = st.i64Cycles;
+        totalInstructions = st.i64Instructions;
+    }
 
-    // parse trace files (fps[0],fps[1],[fps2] with instructions/time slice in variable si32InstructionSize)
+    if (i64Interval)
+        openIntervalLog(&intervalLog, sIntervalFile, interval_format_from_string(sIntervalFormat),
+                        i64Interval, iFileCountUseable);
+
+    if (sResultsFile)
+        openResultWriter(&results, sResultsFile, result_format_from_string(sResultsFormat));
+
+    if (pm.replPolicy == PR_OPT)
+        recordPageReferences(&pm, sArrFileNames, iFileCountUseable, &sched, &cache, i32MaxOpen);
+    // measure the real run only: the OPT scratch run is not in the counts
+    PROF_START();
+    if (bHostCounters && openHostCounters(&hostCounters))
+        startHostCounters(&hostCounters);
+
+    // parse trace files with instructions/time slice in variable si32InstructionSize
     runTraces(&pm,
               vms,
-              fps,
-              i8FileCountUseable,
-              si32InstructionSize,
+              &tracePool,
+              iFileCountUseable,
+              &sched,
               &cache,
+              &switchModel,
+              &sample,
+              bWarmup ? &warmup : NULL,
+              i64Interval ? &intervalLog : NULL,
+              &ckpt,
               &totalCycles,
               &totalInstructions);
+    if (bHostCounters)
+        stopHostCounters(&hostCounters);
+
+    if (i64Interval)
+        closeIntervalLog(&intervalLog, &cache, &pm, totalCycles, totalInstructions);
+
+    if (warmup.bDone) {
+        // report the measured part only
+        totalCycles       -= warmup.i64Cycles;
+        totalInstructions -= warmup.i64Instructions;
+    } else if (bWarmup) {
+        fprintf(stderr, "Warning: warm-up never ended, counters cover the whole run\n");
+    }
+    free(warmup.bArrWarming);
 
-    // +100 cycles por cada page fault
-    //totalCycles += pm.i64NumPageFaults * 100;
+    if (ckpt.sSavePath && !ckpt.bSaved)
+        fprintf(stderr, "Warning: traces ended after %" PRIu64 " instructions, checkpoint %s not written\n",
+                totalInstructions, ckpt.sSavePath);
 
     // ====== MILESTONE 2: VM RESULTS (igual que antes) ======
-    printSimulationResults(&pm, vms, sArrFileNames, i8FileCountUseable);
+    printSimulationResults(&pm, vms, sArrFileNames, iFileCountUseable);
 
     // ====== MILESTONE 3: CACHE RESULTS (en main, como los otros milestones) ======
     double hitRate  = (cache.accesses > 0)
@@ -507,6 +1168,10 @@ int main(int argc, char *argv[]) {
     printf("Hit Rate:			%.4f%%\n", hitRate);
     printf("Miss Rate:			%.4f%%\n", missRate);
     printf("CPI:				%.2f Cycles/Instruction (%" PRIu64 ")\n", cpi, (totalInstructions));
+    if (pm.i64FaultCycles > 0)
+        printf("--- Page Fault CPI:		%.2f (%" PRIu64 " cycles)\n",
+               totalInstructions ? (double)pm.i64FaultCycles / (double)totalInstructions : 0.0,
+               pm.i64FaultCycles);
     printf("Unused Cache Space:		%.2f KB / %.2f KB = %.2f%%  Waste: $%.2f\n",
     unusedKB, implKB, wastePerc, wasteDollars);
 
@@ -515,6 +1180,195 @@ int main(int argc, char *argv[]) {
            (uint64_t)i64EstUnusedBlocks,
            i32NumCacheBlocks);
 
+    if (cache.sectorsPerLine > 1) {
+        printf("\n***** SECTOR RESULTS *****\n\n");
+        printf("%-32s%" PRIu64 "\n", "Sector Misses (tag hit):", cache.sectorMisses);
+        printf("%-32s%" PRIu64 " bytes ( %.1f per miss, block %u )\n", "Memory Fetch:", cache.fetchBytes,
+               cache.misses ? (double)cache.fetchBytes / (double)cache.misses : 0.0, cache.blockSize);
+        printf("%-32s%" PRIu64 " bytes\n", "Memory Writeback:", cache.writebackBytes);
+        printf("%-32s%.2f%% of sectors valid per line\n", "Sector Utilisation:",
+               100.0 * cacheSectorUtilisation(&cache));
+    }
+
+    if (bSetIndexGiven)
+        printSetMissDistribution(cache.setMisses, cache.numSets, cache.indexSets);
+    if (sample.i64Period)
+        printSampleResults(&sample, totalInstructions);
+
+    // frame placement and partitioning show up per process
+    if (bPerProcess || strcmp(sFrameAlloc, "seq") || strcmp(sPartition, "none"))
+        printCacheResultsPerProcess(&cache, vms, sArrFileNames, iFileCountUseable,
+                                    frame_alloc_name(sFrameAlloc), i32NumColors);
+
+    if (bSwitchModel)
+        printContextSwitchResults(&cache, &pm, sArrFileNames, iFileCountUseable, &switchModel);
+    if (bSchedGiven || sQuanta || sWeights)
+        printSchedulerResults(&sched, &cache, vms, sArrFileNames, iFileCountUseable);
+
+    if (sResultsFile) {
+        // every key is written on every run and each trace gets its own
+        // record after the run's values, so the CSV columns are fixed
+        struct ResultWriter *rw = &results;
+        resultBegin(rw);
+        resultInt(rw, "traces", iFileCountUseable);
+        resultUint(rw, "cache_size_kb", i64CacheSize / 1024);
+        resultUint(rw, "block_size", i32CacheBlockSize);
+        resultUint(rw, "sector_size", i32SectorSize ? i32SectorSize : i32CacheBlockSize);
+        resultInt(rw, "associativity", iCacheAssoc);
+        resultString(rw, "replacement_policy", sCacheReplacePolicy);
+        resultUint(rw, "physical_memory_mb", i64PhysicalMemory / (1024 * 1024));
+        resultDouble(rw, "system_memory_percent", dSystemMemoryPerc * 100);
+        resultInt(rw, "instructions_per_slice", si32InstructionSize);
+        resultString(rw, "dram", strcmp(sDramPolicy, "") != 0 ? sDramPolicy : "none");
+        resultUint(rw, "dram_channels", i32DramChannels);
+        resultUint(rw, "dram_ranks", i32DramRanks);
+        resultUint(rw, "dram_banks", i32DramBanks);
+        resultString(rw, "dram_map", sDramMap);
+        resultUint(rw, "dram_tcas", i32tCAS);
+        resultUint(rw, "dram_trcd", i32tRCD);
+        resultUint(rw, "dram_trp", i32tRP);
+        resultString(rw, "frame_alloc", sFrameAlloc);
+        resultString(rw, "page_repl", sPageRepl);
+        resultString(rw, "page_scope", sPageScope);
+        resultUint(rw, "ws_window", pm.i64WsWindow);
+        resultUint(rw, "minor_fault_cycles", faultModel.i32MinorCycles);
+        resultUint(rw, "swap_latency", faultModel.i32SwapLatency);
+        resultUint(rw, "swap_bytes_per_cycle", faultModel.i32SwapBytesPerCycle);
+        resultString(rw, "partition", sPartition);
+        resultString(rw, "set_index", sSetIndex);
+        resultUint(rw, "tlb_entries", i32TlbEntries);
+        resultUint(rw, "tlb_ways", i32TlbEntries ? i32TlbWays : 0);
+        resultUint(rw, "cs_cycles", switchModel.i32Cycles);
+        resultString(rw, "cs_flush", sFlushMode);
+        resultUint(rw, "asids", switchModel.mode == FLUSH_ASID ? i32NumAsids : 0);
+        resultUint(rw, "reload_window", switchModel.i32ReloadWindow);
+        resultString(rw, "scheduler", sSched);
+        resultUint(rw, "sample_period", sample.i64Period);
+        resultUint(rw, "sample_unit", sample.i32Unit);
+        resultUint(rw, "sample_warmup", sample.i32Warmup);
+        resultUint(rw, "warmup_instructions", warmup.i64Instr);
+        resultUint(rw, "warmup_eip", warmup.i64MarkerEip);
+        resultInt(rw, "warmup_per_trace", warmup.bPerTrace);
+        resultString(rw, "restored_from", ckpt.sRestorePath ? ckpt.sRestorePath : "");
+
+        resultUint(rw, "total_blocks", i32NumCacheBlocks);
+        resultUint(rw, "tag_bits", iAddressBusTagSize);
+        resultUint(rw, "index_bits", iAddressBusIndexSize);
+        resultUint(rw, "offset_bits", iAddressBusOffsetSize);
+        resultUint(rw, "rows", i32NumCacheSets);
+        resultUint(rw, "overhead_bytes", i32CacheSizeOverhead);
+        resultUint(rw, "impl_memory_bytes", i64CacheSize + i32CacheSizeOverhead);
+        resultDouble(rw, "cost", implKB * dCostPerKB);
+        resultUint(rw, "physical_pages", i64PhysicalPages);
+        resultUint(rw, "system_pages", (uint64_t) ceil((double) i64PhysicalPages * dSystemMemoryPerc));
+        resultUint(rw, "pte_bits", i32PhysicalPageTableEntrySize);
+        resultUint(rw, "page_table_ram_bytes", (uint64_t)(512 * 1024) * iFileCount * i32PhysicalPageTableEntrySize / 8);
+        resultUint(rw, "page_colors", i32NumColors);
+
+        uint64_t i64Faults = 0, i64TlbHits = 0, i64TlbMisses = 0;
+        for (int i = 0; i < iFileCountUseable; i++) {
+            i64Faults    += vms[i].i64NumPageFaults;
+            i64TlbHits   += vms[i].i64TlbHits;
+            i64TlbMisses += vms[i].i64TlbMisses;
+        }
+        resultUint(rw, "instructions", totalInstructions);
+        resultUint(rw, "cycles", totalCycles);
+        resultDouble(rw, "cpi", cpi);
+        resultUint(rw, "cache_accesses", cache.accesses);
+        resultUint(rw, "cache_addresses", cache.addresses);
+        resultUint(rw, "instruction_bytes", cache.instrBytes);
+        resultUint(rw, "srcdst_bytes", cache.srcDstBytes);
+        resultUint(rw, "hits", cache.hits);
+        resultUint(rw, "misses", cache.misses);
+        resultUint(rw, "compulsory_misses", cache.compulsoryMisses);
+        resultUint(rw, "conflict_misses", cache.conflictMisses);
+        resultDouble(rw, "hit_rate", hitRate);
+        resultDouble(rw, "miss_rate", missRate);
+        resultUint(rw, "writebacks", cache.writebacks);
+        resultDouble(rw, "unused_kb", unusedKB);
+        resultUint(rw, "unused_blocks", (uint64_t)i64EstUnusedBlocks);
+        resultDouble(rw, "waste_percent", wastePerc);
+        resultDouble(rw, "waste_cost", wasteDollars);
+        resultUint(rw, "sector_misses", cache.sectorMisses);
+        resultUint(rw, "fetch_bytes", cache.fetchBytes);
+        resultUint(rw, "writeback_bytes", cache.writebackBytes);
+        resultUint(rw, "cache_flushes", cache.flushes);
+        resultUint(rw, "repartitions", cache.repartitions);
+        resultUint(rw, "system_frames", (uint64_t)(pm.i64NumFrames * pm.dSystemMemoryPerc));
+        resultUint(rw, "user_frames", pm.i64NumFramesUsable);
+        resultUint(rw, "virtual_pages_mapped", pm.i64NumAccesses);
+        resultUint(rw, "page_table_hits", pm.i64NumAccesses - pm.i64PagesFromFree - i64Faults);
+        resultUint(rw, "pages_from_free", pm.i64PagesFromFree);
+        resultUint(rw, "page_faults", i64Faults);
+        resultUint(rw, "page_evictions", pm.i64NumEvictions);
+        resultUint(rw, "page_cleanings", pm.i64PageCleanings);
+        resultUint(rw, "local_steals", pm.i64LocalSteals);
+        resultUint(rw, "minor_faults", pm.i64MinorFaults);
+        resultUint(rw, "major_faults", pm.i64MajorFaults);
+        resultUint(rw, "swap_reads", pm.i64SwapReads);
+        resultUint(rw, "swap_writes", pm.i64SwapWrites);
+        resultUint(rw, "evict_writebacks", pm.i64EvictWritebacks);
+        resultUint(rw, "fault_cycles", pm.i64FaultCycles);
+        resultUint(rw, "tlb_hits", i64TlbHits);
+        resultUint(rw, "tlb_misses", i64TlbMisses);
+        resultUint(rw, "tlb_flushes", pm.tlb ? pm.tlb->i64Flushes : 0);
+        resultUint(rw, "asid_recycles", pm.tlb ? pm.tlb->i64AsidRecycles : 0);
+        resultUint(rw, "dram_reads", cache.dram ? cache.dram->i64Reads : 0);
+        resultUint(rw, "dram_writes", cache.dram ? cache.dram->i64Writes : 0);
+        resultUint(rw, "dram_row_hits", cache.dram ? cache.dram->i64RowHits : 0);
+        resultUint(rw, "dram_row_empty", cache.dram ? cache.dram->i64RowEmpty : 0);
+        resultUint(rw, "dram_row_conflicts", cache.dram ? cache.dram->i64RowConflicts : 0);
+        resultUint(rw, "dram_read_latency", cache.dram ? cache.dram->i64TotalLatency : 0);
+
+        resultKeep(rw);
+
+        for (int i = 0; i < iFileCountUseable; i++) {
+            struct CacheProcStats *ps = &cache.procStats[i];
+            struct VM *vm = &vms[i];
+            resultInt(rw, "trace", i);
+            resultString(rw, "trace_file", sArrFileNames[i]);
+            resultUint(rw, "trace_instructions", ps->instructions);
+            resultUint(rw, "trace_cycles", ps->cycles);
+            resultDouble(rw, "trace_cpi",
+                         ps->instructions ? (double)ps->cycles / (double)ps->instructions : 0.0);
+            resultUint(rw, "trace_accesses", ps->accesses);
+            resultUint(rw, "trace_hits", ps->hits);
+            resultUint(rw, "trace_misses", ps->misses);
+            resultUint(rw, "trace_compulsory_misses", ps->compulsoryMisses);
+            resultUint(rw, "trace_conflict_misses", ps->conflictMisses);
+            resultUint(rw, "trace_writebacks", ps->writebacks);
+            resultUint(rw, "trace_cross_evictions", ps->crossEvictions);
+            resultUint(rw, "trace_lost_to_others", ps->lostToOthers);
+            resultUint(rw, "trace_switches_in", ps->switchIns);
+            resultUint(rw, "trace_reload_misses", ps->reloadMisses);
+            resultUint(rw, "trace_page_translations", vm->i64NumAccesses);
+            resultUint(rw, "trace_page_faults", vm->i64NumPageFaults);
+            resultUint(rw, "trace_pages_evicted", vm->i64NumEvicted);
+            resultUint(rw, "trace_used_ptes", countValidPTEs(vm));
+            resultUint(rw, "trace_tlb_misses", vm->i64TlbMisses);
+            resultUint(rw, "trace_turnaround", sched.procs[i].i64Finish);
+            resultEnd(rw);
+        }
+        closeResultWriter(rw);
+    }
+    freeScheduler(&sched);
+    if (pm.tlb) freeTLB(pm.tlb);
+
+    if (cache.dram) {
+        printf("Dirty Writebacks:		%" PRIu64 "\n", cache.writebacks);
+        printDramResults(cache.dram);
+        freeDRAM(cache.dram);
+    }
+    if (bHostCounters) {
+        printHostCounters(&hostCounters, cache.accesses, totalInstructions);
+        closeHostCounters(&hostCounters);
+    }
+    PROF_REPORT(totalInstructions, cache.accesses);
+
+    freeTracePool(&tracePool);
+    for (int i = 0; i < iFileCountUseable; i++) freeVM(&vms[i]);
+    free(vms);
+    free(sArrFileNames);
            
     return 0;
 }
@@ -1,5 +1,14 @@
 #include "virtualMem.h"
+#include "cache.h"
 #include "ccache.h"
+#include "sim.h"
+#include "dram.h"
+#include "scheduler.h"
+#include "tracePool.h"
+#include "nextUse.h"
+#include "resultWriter.h"
+#include "simProfile.h"
+#include "hostCounters.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -7,82 +16,22 @@
 #include <math.h> 
 #include <inttypes.h>
 #include <stdbool.h>
- // gcc cacheSim.c virtualMem.c ccache.c -o cacheSim.exe
- // ./cacheSim.exe -s 512 -b 16 -a 4 -r rr -p 1024 -n 100 -u 75 -f Trace1half.trc -f A-9_new_trunk1.trc -f A-10_new_1.5_a.pdf.trc
+ // gcc ccacheSim.c ccache.c sim.c cache.c virtualMem.c ... -o ccacheSim -lm   (see README)
+ // ./ccacheSim -s 512 -b 16 -a 4 -r rr -p 1024 -n 100 -u 75 -f Trace1half.trc -f A-9_new_trunk1.trc -f A-10_new_1.5_a.pdf.trc
  // rm cacheSim.exe
 
-#define DATA_BYTES 4
-
-static bool processTraceStep(struct VM *vm, FILE *fp, struct Cache *cache)
-{
-    char lineEIP[256], lineMem[256], blank[8];
-    if (!fgets(lineEIP, sizeof(lineEIP), fp)) return false;   // EOF
-    if (!fgets(lineMem, sizeof(lineMem), fp)) return false;
-    fgets(blank, sizeof(blank), fp); // skip separator (may hit EOF)
-
-    uint32_t i32InstrLen = 0;
-    uint64_t eip = 0, src = 0, dst = 0;
-    char srcData[16] = "", dstData[16] = "";
-
-    sscanf(lineEIP, "EIP (%u): %" SCNx64, &i32InstrLen, &eip);
-    sscanf(lineMem, "dstM: %" SCNx64 " %8s   srcM: %" SCNx64 " %8s",
-           &dst, dstData, &src, srcData);
-
-    if (eip != 0 && i32InstrLen > 0) {
-        uint64_t phys = translateAddress(vm, eip, false);    // instruction fetch (read)
-        cacheAccess(cache, phys, false, true, i32InstrLen);
-    }
-    if (src != 0 && strcmp(srcData, "--------") != 0) {
-        uint64_t phys = translateAddress(vm, src, false);    // read
-        cacheAccess(cache, phys, false, false, DATA_BYTES);
-    }
-    if (dst != 0 && strcmp(dstData, "--------") != 0) {
-        uint64_t phys = translateAddress(vm, dst, true);     // write
-        cacheAccess(cache, phys, true, false, DATA_BYTES);
-    }
-
-    return true;
-}
-
- void runTraces(struct PhysicalMemory *pm,
-               struct VM *vms,
-               FILE **fps,
-               int numFiles,
-               int32_t si32InstructionSize,
-               struct Cache *cache)
-{
-    bool finished[numFiles];
-    memset(finished, 0, sizeof(finished));
-    int active = numFiles;
-    uint64_t round = 0;
-
-    while (active > 0) {
-        for (int i = 0; i < numFiles; i++) {
-            if (finished[i]) continue;
-
-            uint32_t executed = 0;
-            while (executed < si32InstructionSize) {
-                if (!processTraceStep(&vms[i], fps[i], cache)) {
-                    finished[i] = true;
-                    active--;
-                    
-                    freeFramesForProcess(vms[i].pm, vms[i].i16ProcessId);
-                    break;
-                }
-                executed++;
-            }
-        }
-        round++;
-    }
-}
-
-
 const char* policy_name(char *policy){ 
     if(strcmp(policy, "lr") == 0) return "Least Recent used";
     if(strcmp(policy, "lf") == 0) return "Least Frequent used";
     if(strcmp(policy, "rr") == 0) return "Round Robin";
     if(strcmp(policy, "ra") == 0) return "Random";
     if(strcmp(policy, "mr") == 0) return "Most Recent Used";
+    if(strcmp(policy, "op") == 0) return "Optimal (Belady)";
+    if(strcmp(policy, "sr") == 0) return "Static RRIP";
+    if(strcmp(policy, "br") == 0) return "Bimodal RRIP";
+    if(strcmp(policy, "dr") == 0) return "Dynamic RRIP";
+    if(strcmp(policy, "sh") == 0) return "SHiP (EIP signature)";
+    if(strcmp(policy, "ar") == 0) return "Adaptive Replacement";
 }
   
 int file_exists_and_readable(char *filename) {
@@ -115,10 +64,101 @@ void exitBadParameters(char *msg) {
     printf("                          (rr - round robin / first in first out)\n");
     printf("                          (ra - random)\n");
     printf("                          (mr - most recent used)\n");
+    printf("                          (op - optimal, runs the traces once to record the future)\n");
+    printf("                          (sr - static RRIP, br - bimodal RRIP, dr - dynamic RRIP)\n");
+    printf("                          (sh - SHiP, RRIP with fills predicted by EIP)\n");
+    printf("                          (ar - adaptive replacement cache)\n");
     printf("  -p  physical memory in MB (value range: 128 - 4096)\n");
     printf("  -u  physical memory used (value range: 0 - 100)\n");
     printf("  -n  Instructions / Time Slice (value range: 1 - inf  | -1 for ALL)\n");
     printf("  -f  File name to parse\n");
+    printf("Optional parameters:\n");
+    printf("  --dram         DRAM timing model behind the cache (open | closed page)\n");
+    printf("  --dram-geom    channels,ranks,banks (default 1,1,8)\n");
+    printf("  --dram-map     address mapping (row : row interleaved | line : line interleaved)\n");
+    printf("  --dram-timing  tCAS,tRCD,tRP in cycles (default 11,11,11)\n");
+    printf("  --max-open     trace files kept open at once, others are reopened on demand (default 64)\n");
+    printf("  --set-index    cache set index function (mod | xor | prime | skew : per-way hash, lr lf rr ra mr only)\n");
+    printf("  --sample-sets  fraction of sets to simulate, results extrapolated (0 < F <= 1, default 1)\n");
+    printf("  --opt-gap      replay the access stream through every policy and report each one's gap to OPT\n");
+    printf("  --results      file every parameter, calculated value and result is appended to\n");
+    printf("  --results-format  results record format (json : one object per line | csv)\n");
+    printf("  --host-counters  read the host CPU's perf counters around the simulation (Linux)\n");
+}
+
+/* the per policy part of a results record */
+static void resultCacheCounters(struct ResultWriter *rw, const struct Cache *c,
+                                const char *sPolicy, const char *sSource)
+{
+    struct CacheTotals t;
+    cacheTotals(c, &t);
+    resultString(rw, "replacement_policy", sPolicy);
+    resultString(rw, "source", sSource);
+    resultUint(rw, "instructions", c->instructions);
+    resultUint(rw, "cycles", t.i64Cycles);
+    resultDouble(rw, "cpi", t.dCpi);
+    resultUint(rw, "cache_accesses", c->accesses);
+    resultUint(rw, "cache_addresses", c->addresses);
+    resultUint(rw, "instruction_bytes", c->instrBytes);
+    resultUint(rw, "srcdst_bytes", c->srcDstBytes);
+    resultUint(rw, "hits", t.i64Hits);
+    resultUint(rw, "misses", t.i64Misses);
+    resultUint(rw, "compulsory_misses", t.i64Compulsory);
+    resultUint(rw, "conflict_misses", t.i64Conflict);
+    resultDouble(rw, "hit_rate", t.dHitRate);
+    resultDouble(rw, "miss_rate", t.dMissRate);
+    resultUint(rw, "writebacks", t.i64Writebacks);
+    resultDouble(rw, "unused_kb", t.dUnusedKB);
+    resultUint(rw, "unused_blocks", (uint64_t)t.dUnusedBlocks);
+    resultDouble(rw, "waste_percent", t.dWastePct);
+    resultDouble(rw, "waste_cost", t.dWasteCost);
+    resultUint(rw, "sampled_sets", c->sampledSet ? c->sampledSets : c->indexSets);
+    resultUint(rw, "dram_reads", c->dram ? c->dram->i64Reads : 0);
+    resultUint(rw, "dram_writes", c->dram ? c->dram->i64Writes : 0);
+    resultUint(rw, "dram_row_hits", c->dram ? c->dram->i64RowHits : 0);
+    resultUint(rw, "dram_row_empty", c->dram ? c->dram->i64RowEmpty : 0);
+    resultUint(rw, "dram_row_conflicts", c->dram ? c->dram->i64RowConflicts : 0);
+    resultUint(rw, "dram_read_latency", c->dram ? c->dram->i64TotalLatency : 0);
+}
+
+/* replay the recorded stream through each policy and compare with OPT */
+static void printOptGap(const struct Cache *proto, FILE *fpStream, const struct NextUseIndex *idx,
+                        struct ResultWriter *rw)
+{
+    static const char *sArrPolicies[] = { "lr", "lf", "rr", "ra", "mr", "sr", "br", "dr", "sh", "ar", "op" };
+    enum { NUM_GAP_POLICIES = sizeof(sArrPolicies) / sizeof(sArrPolicies[0]) };
+    uint64_t i64ArrMisses[NUM_GAP_POLICIES];
+    uint64_t i64Accesses = 0;
+
+    for (int p = 0; p < NUM_GAP_POLICIES; p++) {
+        struct Cache c;
+        initCache(&c, proto->cacheSizeBytes, proto->blockSize, proto->associativity,
+                  cache_policy_from_string(sArrPolicies[p]));
+        srand(42);   // deterministic random, the same for every policy
+        c.tagBits = proto->tagBits;
+        setCacheIndexing(&c, proto->indexing);
+        setCacheSampling(&c, proto->sampleFraction);
+        c.nextUse = idx;
+        cacheReplay(&c, fpStream);
+        i64ArrMisses[p] = c.misses;
+        i64Accesses = c.sampledSet ? c.sampledAccesses : c.accesses;
+        if (rw) {
+            // the replay has no timing model, so only the counts differ from the run
+            c.instructions = proto->instructions;
+            resultCacheCounters(rw, &c, sArrPolicies[p], "opt_gap");
+            resultEnd(rw);
+        }
+        freeCache(&c);
+    }
+
+    double dOptRate = i64Accesses ? 100.0 * (double)i64ArrMisses[NUM_GAP_POLICIES - 1] / (double)i64Accesses : 0.0;
+    printf("\n***** *****  GAP TO OPT:  ***** *****\n\n");
+    printf("%-22s %12s %10s %10s\n", "Policy", "Misses", "Miss Rate", "Gap");
+    for (int p = 0; p < NUM_GAP_POLICIES; p++) {
+        double dRate = i64Accesses ? 100.0 * (double)i64ArrMisses[p] / (double)i64Accesses : 0.0;
+        printf("%-22s %12llu %9.4f%% %+9.4f\n", policy_name((char *)sArrPolicies[p]),
+               (unsigned long long)i64ArrMisses[p], dRate, dRate - dOptRate);
+    }
 }
 
 void printSimulationResults(struct PhysicalMemory *pm, 
@@ -163,11 +203,7 @@ void printSimulationResults(struct PhysicalMemory *pm,
     for (int i = 0; i < iNumVMs; i++) {
         struct VM *vm = &vms[i];
 
-        uint64_t i64UsedPTEs = 0;
-        for (uint64_t p = 0; p < vm->i64NumVPages; p++) {
-            if (vm->pageTable[p].i8Flags & 0x1)
-                i64UsedPTEs++;
-        }
+        uint64_t i64UsedPTEs = countValidPTEs(vm);
 
         //uint64_t i64TableBytes = vm->i64NumVPages * i32PteBytes;
         uint64_t i64TableBytes = i64LogicalEntries * i32PteBytes;
@@ -197,6 +233,10 @@ int main(int argc, char *argv[]) {
                                         // rr - round robin / first in first out
                                         // ra - random
                                         // mr - most recent used
+                                        // op - optimal (Belady)
+                                        // sr / br / dr - static / bimodal / dynamic RRIP
+                                        // sh - SHiP
+                                        // ar - ARC
     int iCacheAssoc = 0;                // -1 => fully associative
     double dSystemMemoryPerc = -1;
     int32_t si32InstructionSize = 0;
@@ -207,11 +247,29 @@ int main(int argc, char *argv[]) {
     uint8_t iAddressBusOffsetSize = 0;
     uint32_t i32CacheSizeOverhead = 0;
 
-    char *sArrFileNames[3];
+    char **sArrFileNames = NULL;        // grows with each -f
+    int iFileCapacity = 0;
+    uint32_t i32MaxOpen = TRACE_POOL_DEFAULT_OPEN;
+    struct TracePool tracePool;
+
 
+    int iFileCount = 0;
+    int iFileCountUseable = 0;
 
-    uint8_t i8FileCount = 0;
-    uint8_t i8FileCountUseable = 0;
+    char sDramPolicy[8] = "";           // "" => fixed miss penalty
+    char sDramMap[8] = "row";
+    uint32_t i32DramChannels = 1, i32DramRanks = 1, i32DramBanks = 8;
+    uint32_t i32tCAS = DRAM_DEFAULT_TCAS, i32tRCD = DRAM_DEFAULT_TRCD, i32tRP = DRAM_DEFAULT_TRP;
+    struct DRAM dram;
+    bool bOptGap = false;
+    char sSetIndex[8] = "mod";          // mod, xor, prime, skew
+    bool bSetIndexGiven = false;        // --set-index given
+    double dSampleFraction = 1.0;       // 1 => every set
+    char *sResultsFile = NULL;
+    char sResultsFormat[8] = "json";    // json, csv
+    struct ResultWriter results;
+    bool bHostCounters = false;
+    struct HostCounters hostCounters;
 
 
     for (int i = 1; i < argc; i++) {
@@ -237,7 +295,13 @@ int main(int argc, char *argv[]) {
              && strcmp(argv[i+1],"lf") 
              && strcmp(argv[i+1],"rr") 
              && strcmp(argv[i+1],"ra") 
-             && strcmp(argv[i+1],"mr")) {
+             && strcmp(argv[i+1],"mr")
+             && strcmp(argv[i+1],"op")
+             && strcmp(argv[i+1],"sr")
+             && strcmp(argv[i+1],"br")
+             && strcmp(argv[i+1],"dr")
+             && strcmp(argv[i+1],"sh")
+             && strcmp(argv[i+1],"ar")) {
                 exitBadParameters("Missing or invalid Replacement Policy");
                 return 1;
             }
@@ -262,7 +326,87 @@ int main(int argc, char *argv[]) {
         else if (!strcmp(argv[i],"-f")) {
             //printf("reading -f\n");
             // read a file name
-            sArrFileNames[i8FileCount++] = argv[++i];    // filename, EACH filename follows -f
+            if (i + 1 >= argc) {
+                exitBadParameters("Missing or invalid Trace File");
+                return 1;
+            }
+            if (iFileCount == iFileCapacity) {
+                iFileCapacity = iFileCapacity ? iFileCapacity * 2 : 4;
+                sArrFileNames = realloc(sArrFileNames, iFileCapacity * sizeof(char *));
+                if (!sArrFileNames) {
+                    fprintf(stderr, "Failed to allocate trace list\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            sArrFileNames[iFileCount++] = argv[++i];    // filename, EACH filename follows -f
+        }
+        else if (!strcmp(argv[i],"--max-open")) {
+            if (i + 1 >= argc || (i32MaxOpen = (uint32_t)atoi(argv[++i])) == 0) {
+                exitBadParameters("Missing or invalid Open Trace Limit");
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i],"--set-index")) {
+            if (i + 1 >= argc || (strcmp(argv[i+1],"mod") && strcmp(argv[i+1],"xor")
+                               && strcmp(argv[i+1],"prime") && strcmp(argv[i+1],"skew"))) {
+                exitBadParameters("Missing or invalid Set Index Function");
+                return 1;
+            }
+            strcpy(sSetIndex,argv[++i]);
+            bSetIndexGiven = true;
+        }
+        else if (!strcmp(argv[i],"--sample-sets")) {
+            if (i + 1 >= argc || (dSampleFraction = atof(argv[++i])) <= 0.0 || dSampleFraction > 1.0) {
+                exitBadParameters("Missing or invalid Set Sample Fraction");
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i],"--opt-gap")) {
+            bOptGap = true;
+        }
+        else if (!strcmp(argv[i],"--host-counters")) {
+            bHostCounters = true;
+        }
+        else if (!strcmp(argv[i],"--results")) {
+            if (i + 1 >= argc) {
+                exitBadParameters("Missing or invalid Results File");
+                return 1;
+            }
+            sResultsFile = argv[++i];
+        }
+        else if (!strcmp(argv[i],"--results-format")) {
+            if (i + 1 >= argc || (strcmp(argv[i+1],"json") && strcmp(argv[i+1],"csv"))) {
+                exitBadParameters("Missing or invalid Results Format");
+                return 1;
+            }
+            strcpy(sResultsFormat,argv[++i]);
+        }
+        else if (!strcmp(argv[i],"--dram")) {
+            if (i + 1 >= argc || (strcmp(argv[i+1],"open") && strcmp(argv[i+1],"closed"))) {
+                exitBadParameters("Missing or invalid DRAM Page Policy");
+                return 1;
+            }
+            strcpy(sDramPolicy,argv[++i]);
+        }
+        else if (!strcmp(argv[i],"--dram-geom")) {
+            if (i + 1 >= argc || sscanf(argv[++i], "%u,%u,%u", &i32DramChannels, &i32DramRanks, &i32DramBanks) != 3
+                || !i32DramChannels || !i32DramRanks || !i32DramBanks) {
+                exitBadParameters("Missing or invalid DRAM Geometry");
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i],"--dram-map")) {
+            if (i + 1 >= argc || (strcmp(argv[i+1],"row") && strcmp(argv[i+1],"line"))) {
+                exitBadParameters("Missing or invalid DRAM Address Mapping");
+                return 1;
+            }
+            strcpy(sDramMap,argv[++i]);
+        }
+        else if (!strcmp(argv[i],"--dram-timing")) {
+            if (i + 1 >= argc || sscanf(argv[++i], "%u,%u,%u", &i32tCAS, &i32tRCD, &i32tRP) != 3) {
+                exitBadParameters("Missing or invalid DRAM Timing");
+                return 1;
+            }
         }
         
     }
@@ -305,6 +449,20 @@ int main(int argc, char *argv[]) {
         exitBadParameters("Missing or invalid Systerm Memory Percent");
         return 1;
     }
+    // skewed ways put a block's candidates in different sets, which per-set
+    // policy state, set sampling and the --opt-gap replays cannot follow
+    if (set_index_from_string(sSetIndex) == SET_INDEX_SKEW) {
+        CachePolicy skewPolicy = cache_policy_from_string(sCacheReplacePolicy);
+        if (skewPolicy != CACHE_LRU && skewPolicy != CACHE_LFU && skewPolicy != CACHE_RR
+         && skewPolicy != CACHE_RND && skewPolicy != CACHE_MRU) {
+            exitBadParameters("Missing or invalid Set Index Function (skew needs lr, lf, rr, ra or mr)");
+            return 1;
+        }
+        if (dSampleFraction < 1.0 || bOptGap) {
+            exitBadParameters("Missing or invalid Set Index Function (skew cannot be combined with --sample-sets or --opt-gap)");
+            return 1;
+        }
+    }
 
     
     // calculate block and set counts
@@ -323,6 +481,8 @@ int main(int argc, char *argv[]) {
     iAddressBusOffsetSize = (uint8_t)ceil(log2((double)i32CacheBlockSize));
     iAddressBusIndexSize = (uint8_t)ceil(log2((double)i32NumCacheSets));
     iAddressBusTagSize = iAddressBusSize - (iAddressBusIndexSize + iAddressBusOffsetSize);
+    if (set_index_from_string(sSetIndex) != SET_INDEX_MOD)
+        iAddressBusTagSize += iAddressBusIndexSize;     // hashed index: tag keeps the whole block address
     
 
     // calculate overhead -> Tag Space + Valid Bits (+ dirty bits?)
@@ -335,16 +495,21 @@ int main(int argc, char *argv[]) {
 
     printf("Cache Simulator - CS 3853 - Team #04\n\n");
     printf("Trace File(s):\n");
-    for (int i = 0; i < i8FileCount; i++) {
+    for (int i = 0; i < iFileCount; i++) {
         if (!file_exists_and_readable(sArrFileNames[i])) {
             printf("%8s%-24s %s\n","XX ",sArrFileNames[i],"[FILE NOT FOUND]");
         }
         else {
             printf("%8s%-24s\n","",sArrFileNames[i]);
-            i8FileCountUseable++;
+            // keep readable traces packed at the front, in -f order
+            sArrFileNames[iFileCountUseable++] = sArrFileNames[i];
 
         }
     }
+    if (iFileCountUseable > UINT16_MAX) {
+        exitBadParameters("Too many Trace Files (process ids are 16 bit)");
+        return 1;
+    }
 
     printf("\n***** Cache Input Parameters *****\n\n");
     printf("%-32s%.0f KB\n","Cache Size:",byteToKB(i64CacheSize));
@@ -354,6 +519,13 @@ int main(int argc, char *argv[]) {
     printf("%-32s%.0f MB\n","Physical Memory:",byteToMB(i64PhysicalMemory));
     printf("%-32s%-.1f\n","Percent Memory Used by System:",dSystemMemoryPerc); dSystemMemoryPerc /= 100; // set to decimal after displaying
     printf("%-32s%d\n","Instructions / Time Slice:",si32InstructionSize);
+    if (strcmp(sDramPolicy, "") != 0)
+        printf("%-32s%s page, %u ch x %u rank x %u banks\n","DRAM Model:",sDramPolicy,i32DramChannels,i32DramRanks,i32DramBanks);
+    printf("%-32s%s\n","Set Index:",set_index_name(set_index_from_string(sSetIndex)));
+    if (dSampleFraction < 1.0)
+        printf("%-32s%.4f of sets\n","Set Sampling:",dSampleFraction);
+    if (sResultsFile)
+        printf("%-32s%s (%s)\n","Results File:",sResultsFile,sResultsFormat);
 
     printf("\n***** Cache Calculated Values *****\n\n");
     printf("%-32s%d\n","Total # Blocks:",i32NumCacheBlocks);
@@ -374,7 +546,7 @@ int main(int argc, char *argv[]) {
     printf("%-32s%d\n","Number of Physical Pages:",i64PhysicalPages); // assume page size is 4 KB
     printf("%-32s%d\n","Number of Pages for System:",(int) ceil((double) i64PhysicalPages * dSystemMemoryPerc));
     printf("%-32s%d\n","Size of Page Table Entry:", i32PhysicalPageTableEntrySize); // physical address space + valid bit
-    printf("%-32s%d bytes\n","Total RAM for Page Table(s):", (int) ceil((512 * 1024) * i8FileCount * ((int) ceil(log2(i64PhysicalPages)) + 1) / 8));
+    printf("%-32s%" PRIu64 " bytes\n","Total RAM for Page Table(s):", (uint64_t)(512 * 1024) * iFileCount * ((int) ceil(log2(i64PhysicalPages)) + 1) / 8);
     
     
 
@@ -384,41 +556,178 @@ int main(int argc, char *argv[]) {
                         4096,
                         dSystemMemoryPerc);
     
-    struct VM vms[i8FileCountUseable];
-    
-    FILE *fps[i8FileCountUseable];
-    for (int i = 0; i < i8FileCountUseable; i++) {
-        fps[i] = fopen(sArrFileNames[i], "r");
-        if (!fps[i]) {
-            fprintf(stderr, "Error: failed to open %s\n",sArrFileNames[i]);
-            exit(EXIT_FAILURE);
-        }
+    struct VM *vms = calloc(iFileCountUseable > 0 ? iFileCountUseable : 1, sizeof(struct VM));
+    if (!vms) {
+        fprintf(stderr, "Failed to allocate VMs\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < iFileCountUseable; i++) {
         initVM(&vms[i], i, 32, 4096, &pm);
     }
+    initTracePool(&tracePool, sArrFileNames, iFileCountUseable, i32MaxOpen);
 
     pm.vms = vms;
-    pm.iNumVMs = i8FileCountUseable;
+    pm.iNumVMs = iFileCountUseable;
 
 
-    ReplacementPolicy rp = policy_from_string(sCacheReplacePolicy);
+    CachePolicy rp = cache_policy_from_string(sCacheReplacePolicy);
     struct Cache cache;
     initCache(&cache,
-                i32NumCacheSets,
-                iCacheAssoc,
+                (uint32_t)i64CacheSize,
                 i32CacheBlockSize,
-                iAddressBusTagSize,
-                iAddressBusIndexSize,
-                iAddressBusOffsetSize,
-                i64CacheSize,
-                i64PhysicalMemory,
+                iCacheAssoc,
                 rp);
+    srand(42);   // deterministic random
+    cache.tagBits = iAddressBusTagSize;
+    setCacheIndexing(&cache, set_index_from_string(sSetIndex));
+    setCacheSampling(&cache, dSampleFraction);
+
+    if (strcmp(sDramPolicy, "") != 0) {
+        initDRAM(&dram,
+                 i32DramChannels,
+                 i32DramRanks,
+                 i32DramBanks,
+                 i32CacheBlockSize,
+                 dram_policy_from_string(sDramPolicy),
+                 strcmp(sDramMap, "line") == 0 ? DRAM_MAP_LINE : DRAM_MAP_ROW);
+        dram.i32tCAS = i32tCAS;
+        dram.i32tRCD = i32tRCD;
+        dram.i32tRP  = i32tRP;
+        cache.dram = &dram;
+    }
+
 
+    if (sResultsFile)
+        openResultWriter(&results, sResultsFile, result_format_from_string(sResultsFormat));
 
-    // parse trace files (fps[0],fps[1],[fps2] with instructions/time slice in variable si32InstructionSize)
-    runTraces(&pm, vms, fps, i8FileCountUseable, si32InstructionSize, &cache);
+    // OPT needs the whole stream first: run the traces once through an LRU
+    // cache that records every access, then replay it into the OPT cache
+    FILE *fpStream = NULL;
+    struct NextUseIndex nextUse;
+    memset(&nextUse, 0, sizeof(nextUse));
+    if (rp == CACHE_OPT || bOptGap) {
+        fpStream = tmpfile();
+        if (!fpStream) {
+            fprintf(stderr, "Failed to create access stream file\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // parse trace files with instructions/time slice in variable si32InstructionSize,
+    // round robin over the active traces through the step loop of sim.c
+    struct Scheduler sched;
+    initScheduler(&sched, SCHED_RR, iFileCountUseable, si32InstructionSize);
+    struct SwitchModel sw = { 0, FLUSH_NONE, 0 };
+    uint64_t i64Cycles = 0, i64Instr = 0;
+    PROF_START();
+    if (bHostCounters && openHostCounters(&hostCounters))
+        startHostCounters(&hostCounters);
+    if (rp == CACHE_OPT) {
+        struct Cache recorder;
+        initCache(&recorder, (uint32_t)i64CacheSize, i32CacheBlockSize, iCacheAssoc, CACHE_LRU);
+        setCacheIndexing(&recorder, set_index_from_string(sSetIndex));
+        recorder.record = fpStream;
+        pm.cache = &recorder;       // page evictions invalidate, and are recorded
+        runTraces(&pm, vms, &tracePool, iFileCountUseable, &sched, &recorder, &sw,
+                  NULL, NULL, NULL, NULL, &i64Cycles, &i64Instr);
+        pm.cache = NULL;
+        freeCache(&recorder);
+
+        buildNextUseIndex(&nextUse, fpStream, iAddressBusOffsetSize);
+        cache.nextUse = &nextUse;
+        cacheReplay(&cache, fpStream);
+    } else {
+        cache.record = fpStream;
+        pm.cache = &cache;          // page evictions invalidate the frame's lines
+        runTraces(&pm, vms, &tracePool, iFileCountUseable, &sched, &cache, &sw,
+                  NULL, NULL, NULL, NULL, &i64Cycles, &i64Instr);
+        pm.cache = NULL;
+        cache.record = NULL;
+        cache.instructions = i64Instr;      // for the CPI model (cacheReplay counts its own)
+        if (bOptGap) buildNextUseIndex(&nextUse, fpStream, iAddressBusOffsetSize);
+    }
+    if (bHostCounters)
+        stopHostCounters(&hostCounters);
+    freeScheduler(&sched);
     
-    printSimulationResults(&pm, vms, sArrFileNames, i8FileCountUseable);
+    printSimulationResults(&pm, vms, sArrFileNames, iFileCountUseable);
     printCacheResults(&cache);
+    if (bSetIndexGiven && !cache.sampledSet)
+        printSetMissDistribution(cache.setMisses, cache.numSets, cache.indexSets);
+
+    if (sResultsFile) {
+        // inputs, calculated values and page results are shared by the run
+        // and every --opt-gap replay, so they are kept for all the records
+        struct ResultWriter *rw = &results;
+        resultBegin(rw);
+        resultInt(rw, "traces", iFileCountUseable);
+        resultUint(rw, "cache_size_kb", i64CacheSize / 1024);
+        resultUint(rw, "block_size", i32CacheBlockSize);
+        resultInt(rw, "associativity", iCacheAssoc);
+        resultUint(rw, "physical_memory_mb", i64PhysicalMemory / (1024 * 1024));
+        resultDouble(rw, "system_memory_percent", dSystemMemoryPerc * 100);
+        resultInt(rw, "instructions_per_slice", si32InstructionSize);
+        resultString(rw, "dram", strcmp(sDramPolicy, "") != 0 ? sDramPolicy : "none");
+        resultUint(rw, "dram_channels", i32DramChannels);
+        resultUint(rw, "dram_ranks", i32DramRanks);
+        resultUint(rw, "dram_banks", i32DramBanks);
+        resultString(rw, "dram_map", sDramMap);
+        resultUint(rw, "dram_tcas", i32tCAS);
+        resultUint(rw, "dram_trcd", i32tRCD);
+        resultUint(rw, "dram_trp", i32tRP);
+        resultString(rw, "set_index", sSetIndex);
+        resultDouble(rw, "sample_fraction", dSampleFraction);
+
+        resultUint(rw, "total_blocks", i32NumCacheBlocks);
+        resultUint(rw, "tag_bits", iAddressBusTagSize);
+        resultUint(rw, "index_bits", iAddressBusIndexSize);
+        resultUint(rw, "offset_bits", iAddressBusOffsetSize);
+        resultUint(rw, "rows", i32NumCacheSets);
+        resultUint(rw, "overhead_bytes", i32CacheSizeOverhead);
+        resultUint(rw, "impl_memory_bytes", i64CacheSize + i32CacheSizeOverhead);
+        resultDouble(rw, "cost", byteToKB(i64CacheSize + i32CacheSizeOverhead) * 0.07);
+        resultUint(rw, "physical_pages", i64PhysicalPages);
+        resultUint(rw, "system_pages", (uint64_t) ceil((double) i64PhysicalPages * dSystemMemoryPerc));
+        resultUint(rw, "pte_bits", i32PhysicalPageTableEntrySize);
+        resultUint(rw, "page_table_ram_bytes", (uint64_t)(512 * 1024) * iFileCount * i32PhysicalPageTableEntrySize / 8);
+
+        uint64_t i64Faults = 0;
+        for (int i = 0; i < iFileCountUseable; i++) i64Faults += vms[i].i64NumPageFaults;
+        resultUint(rw, "system_frames", (uint64_t)(pm.i64NumFrames * pm.dSystemMemoryPerc));
+        resultUint(rw, "user_frames", pm.i64NumFramesUsable);
+        resultUint(rw, "virtual_pages_mapped", pm.i64NumAccesses);
+        resultUint(rw, "page_table_hits", pm.i64NumAccesses - pm.i64PagesFromFree - i64Faults);
+        resultUint(rw, "pages_from_free", pm.i64PagesFromFree);
+        resultUint(rw, "page_faults", i64Faults);
+        for (int i = 0; i < iFileCountUseable; i++) {
+            resultString(rw, resultTraceKey(rw, i, "file"), sArrFileNames[i]);
+            resultUint(rw, resultTraceKey(rw, i, "page_translations"), vms[i].i64NumAccesses);
+            resultUint(rw, resultTraceKey(rw, i, "page_faults"), vms[i].i64NumPageFaults);
+            resultUint(rw, resultTraceKey(rw, i, "used_ptes"), countValidPTEs(&vms[i]));
+        }
+        resultKeep(rw);
+
+        resultCacheCounters(rw, &cache, sCacheReplacePolicy, "run");
+        resultEnd(rw);
+    }
+    if (bOptGap) printOptGap(&cache, fpStream, &nextUse, sResultsFile ? &results : NULL);
+    if (sResultsFile) closeResultWriter(&results);
+    if (bHostCounters) {
+        printHostCounters(&hostCounters, cache.accesses, cache.instructions);
+        closeHostCounters(&hostCounters);
+    }
+    PROF_REPORT(cache.instructions, cache.accesses);
+    if (cache.dram) freeDRAM(cache.dram);
+    freeCache(&cache);
+    if (fpStream) {
+        freeNextUseIndex(&nextUse);
+        fclose(fpStream);
+    }
+
+    freeTracePool(&tracePool);
+    for (int i = 0; i < iFileCountUseable; i++) freeVM(&vms[i]);
+    free(vms);
+    free(sArrFileNames);
     
     return 0;
 }
\ No newline at end of file
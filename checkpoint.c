@@ -0,0 +1,566 @@
+#include "checkpoint.h"
+#include "virtualMem.h"
+#include "cache.h"
+#include "tracePool.h"
+#include "scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+enum {
+    CKPT_SEC_CACHE,         // struct CkptCache
+    CKPT_SEC_LINES,         // struct CacheLine [set][way]
+    CKPT_SEC_RR,            // uint64_t [set]
+    CKPT_SEC_SET_MISSES,    // uint64_t [set]
+    CKPT_SEC_PROC_STATS,    // struct CacheProcStats [proc]
+    CKPT_SEC_MEMORY,        // struct CkptMemory
+    CKPT_SEC_FRAMES,        // struct Frame [frame]
+    CKPT_SEC_ALLOC,         // color next, color freed, frame order, freed heap
+    CKPT_SEC_VMS,           // struct CkptVM [vm]
+    CKPT_SEC_LEAVES,        // struct CkptLeaf + PTEs, for every touched leaf
+    CKPT_SEC_TRACES,        // struct CkptTrace [trace]
+    CKPT_SEC_SCHED,         // struct CkptSched
+    CKPT_SEC_SCHED_PROCS,   // struct SchedProc [trace]
+    CKPT_NUM_SECTIONS
+};
+
+struct CkptHeader {
+    char     sMagic[8];
+    uint32_t i32Version;
+    uint32_t i32NumSections;
+
+    /* record sizes: a build with another layout cannot read the file */
+    uint32_t i32LineBytes;
+    uint32_t i32FrameBytes;
+    uint32_t i32PteBytes;
+    uint32_t i32ProcStatsBytes;
+    uint32_t i32SchedProcBytes;
+
+    int32_t  iRunning;
+    uint64_t i64Instructions;
+    uint64_t i64Cycles;
+
+    /* geometry the restoring run must share */
+    uint32_t i32NumSets;
+    uint32_t i32Assoc;
+    uint32_t i32BlockSize;
+    uint32_t i32SectorsPerLine;
+    uint32_t i32Indexing;
+    uint32_t i32NumColors;
+    uint32_t i32AllocPolicy;
+    uint32_t i32ReplPolicy;
+    uint32_t i32ReplScope;
+    uint32_t i32LeafBits;
+    uint32_t i32NumVMs;
+    uint32_t i32Pad;
+    uint64_t i64NumFramesUsable;
+};
+
+struct CkptSection {
+    uint32_t i32Id;
+    uint32_t i32Pad;
+    uint64_t i64Offset;
+    uint64_t i64Bytes;
+};
+
+struct CkptCache {
+    uint64_t i64Accesses, i64Hits, i64Misses;
+    uint64_t i64CompulsoryMisses, i64ConflictMisses;
+    uint64_t i64InstrBytes, i64SrcDstBytes, i64Addresses, i64Writebacks;
+    uint64_t i64SectorMisses, i64FetchBytes, i64WritebackBytes;
+    uint64_t i64EvictedLines, i64EvictedSectors;
+    uint64_t i64Flushes;
+    uint64_t i64MemCycles, i64Instructions, i64Tick;
+};
+
+struct CkptDomain {
+    uint32_t i32Head, i32Tail, i32Hand, i32Bucket;
+    uint64_t i64Count;
+    uint64_t i64AgedEpoch;
+};
+
+struct CkptMemory {
+    uint64_t i64NumFramesUsed;
+    uint32_t i32NextColor;
+    uint32_t i32Pad;
+    uint64_t i64Tick;
+    struct CkptDomain domain;
+
+    uint64_t i64NumAccesses, i64NumEvictions, i64PageCleanings, i64LocalSteals;
+    uint64_t i64NumPageFaults, i64PagesFromFree, i64TranslateCycles;
+    uint64_t i64SwapFreeAt, i64MinorFaults, i64MajorFaults;
+    uint64_t i64SwapReads, i64SwapWrites, i64EvictWritebacks;
+    uint64_t i64FaultCycles, i64MinorFaultCycles, i64SwapInCycles, i64SwapOutCycles;
+};
+
+struct CkptVM {
+    uint64_t i64Tick, i64NumPageFaults, i64NumAccesses, i64PageTableHits;
+    uint64_t i64PagesFromFree, i64NumEvicted;
+    uint64_t i64MinorFaults, i64MajorFaults, i64FaultCycles;
+    struct CkptDomain domain;
+};
+
+struct CkptLeaf {
+    uint32_t i32Vm;
+    uint32_t i32Pad;
+    uint64_t i64Dir;            // page directory slot, PTEs follow
+};
+
+struct CkptTrace {
+    uint64_t i64Offset;
+    uint64_t i64Size;
+};
+
+struct CkptSched {
+    int32_t  iNext;
+    int32_t  iPad;
+    uint64_t i64RandState;
+};
+
+bool checkpointSupported(const struct PhysicalMemory *pm)
+{
+    /* LFU buckets and OPT heaps live outside the frame table */
+    return pm->replPolicy != PR_LFU && pm->replPolicy != PR_OPT;
+}
+
+static void saveDomain(struct CkptDomain *o, const struct ReplDomain *d)
+{
+    o->i32Head      = d->i32Head;
+    o->i32Tail      = d->i32Tail;
+    o->i32Hand      = d->i32Hand;
+    o->i32Bucket    = d->i32Bucket;
+    o->i64Count     = d->i64Count;
+    o->i64AgedEpoch = d->i64AgedEpoch;
+}
+
+static void loadDomain(struct ReplDomain *d, const struct CkptDomain *o)
+{
+    d->i32Head      = o->i32Head;
+    d->i32Tail      = o->i32Tail;
+    d->i32Hand      = o->i32Hand;
+    d->i32Bucket    = o->i32Bucket;
+    d->i64Count     = o->i64Count;
+    d->i64AgedEpoch = o->i64AgedEpoch;
+}
+
+static void fillHeader(struct CkptHeader *h, const struct SimState *st)
+{
+    const struct Cache *c = st->cache;
+    const struct PhysicalMemory *pm = st->pm;
+
+    memset(h, 0, sizeof(*h));
+    memcpy(h->sMagic, CKPT_MAGIC, sizeof(h->sMagic));
+    h->i32Version         = CKPT_VERSION;
+    h->i32NumSections     = CKPT_NUM_SECTIONS;
+    h->i32LineBytes       = sizeof(struct CacheLine);
+    h->i32FrameBytes      = sizeof(struct Frame);
+    h->i32PteBytes        = sizeof(struct PTE);
+    h->i32ProcStatsBytes  = sizeof(struct CacheProcStats);
+    h->i32SchedProcBytes  = sizeof(struct SchedProc);
+    h->iRunning           = st->iRunning;
+    h->i64Instructions    = st->i64Instructions;
+    h->i64Cycles          = st->i64Cycles;
+    h->i32NumSets         = c->numSets;
+    h->i32Assoc           = c->associativity;
+    h->i32BlockSize       = c->blockSize;
+    h->i32SectorsPerLine  = c->sectorsPerLine;
+    h->i32Indexing        = c->indexing;
+    h->i32NumColors       = pm->i32NumColors;
+    h->i32AllocPolicy     = pm->allocPolicy;
+    h->i32ReplPolicy      = pm->replPolicy;
+    h->i32ReplScope       = pm->replScope;
+    h->i32LeafBits        = st->iNumVMs > 0 ? st->vms[0].i32LeafBits : 0;
+    h->i32NumVMs          = (uint32_t)st->iNumVMs;
+    h->i64NumFramesUsable = pm->i64NumFramesUsable;
+}
+
+/* ---- writer: sections are streamed, the table is patched in at the end ---- */
+
+struct CkptWriter {
+    FILE       *fp;
+    const char *sPath;
+    uint64_t   i64Pos;
+    struct CkptSection table[CKPT_NUM_SECTIONS];
+};
+
+static void ckWrite(struct CkptWriter *w, const void *data, uint64_t i64Bytes)
+{
+    if (i64Bytes && fwrite(data, 1, (size_t)i64Bytes, w->fp) != i64Bytes) {
+        fprintf(stderr, "Error: failed to write checkpoint %s\n", w->sPath);
+        exit(EXIT_FAILURE);
+    }
+    w->i64Pos += i64Bytes;
+}
+
+static void ckBegin(struct CkptWriter *w, uint32_t i32Id)
+{
+    static const char zeros[8] = { 0 };
+    ckWrite(w, zeros, (8 - (w->i64Pos & 7)) & 7);
+    w->table[i32Id].i32Id     = i32Id;
+    w->table[i32Id].i64Offset = w->i64Pos;
+}
+
+static void ckEnd(struct CkptWriter *w, uint32_t i32Id)
+{
+    w->table[i32Id].i64Bytes = w->i64Pos - w->table[i32Id].i64Offset;
+}
+
+static void ckSection(struct CkptWriter *w, uint32_t i32Id, const void *data, uint64_t i64Bytes)
+{
+    ckBegin(w, i32Id);
+    ckWrite(w, data, i64Bytes);
+    ckEnd(w, i32Id);
+}
+
+void writeCheckpoint(const char *sPath, const struct SimState *st)
+{
+    const struct Cache *c = st->cache;
+    const struct PhysicalMemory *pm = st->pm;
+
+    struct CkptWriter w;
+    memset(&w, 0, sizeof(w));
+    w.sPath = sPath;
+    w.fp = fopen(sPath, "wb");
+    if (!w.fp) {
+        fprintf(stderr, "Error: failed to create checkpoint %s\n", sPath);
+        exit(EXIT_FAILURE);
+    }
+
+    struct CkptHeader h;
+    fillHeader(&h, st);
+    ckWrite(&w, &h, sizeof(h));
+    ckWrite(&w, w.table, sizeof(w.table));      // placeholder
+
+    // cache
+    struct CkptCache cc = {
+        c->accesses, c->hits, c->misses,
+        c->compulsoryMisses, c->conflictMisses,
+        c->instrBytes, c->srcDstBytes, c->addresses, c->writebacks,
+        c->sectorMisses, c->fetchBytes, c->writebackBytes,
+        c->evictedLines, c->evictedSectors,
+        c->flushes,
+        c->memCycles, c->instructions, c->tick
+    };
+    ckSection(&w, CKPT_SEC_CACHE, &cc, sizeof(cc));
+    ckBegin(&w, CKPT_SEC_LINES);
+    for (uint32_t s = 0; s < c->numSets; s++)
+        ckWrite(&w, c->sets[s].lines, (uint64_t)c->associativity * sizeof(struct CacheLine));
+    ckEnd(&w, CKPT_SEC_LINES);
+    ckSection(&w, CKPT_SEC_RR, c->rrNext, (uint64_t)c->numSets * sizeof(uint64_t));
+    ckSection(&w, CKPT_SEC_SET_MISSES, c->setMisses, (uint64_t)c->numSets * sizeof(uint64_t));
+    ckSection(&w, CKPT_SEC_PROC_STATS, c->procStats, (uint64_t)c->numProcs * sizeof(struct CacheProcStats));
+
+    // physical memory
+    struct CkptMemory mem;
+    memset(&mem, 0, sizeof(mem));
+    mem.i64NumFramesUsed    = pm->i64NumFramesUsed;
+    mem.i32NextColor        = pm->i32NextColor;
+    mem.i64Tick             = pm->i64Tick;
+    saveDomain(&mem.domain, &pm->replDomain);
+    mem.i64NumAccesses      = pm->i64NumAccesses;
+    mem.i64NumEvictions     = pm->i64NumEvictions;
+    mem.i64PageCleanings    = pm->i64PageCleanings;
+    mem.i64LocalSteals      = pm->i64LocalSteals;
+    mem.i64NumPageFaults    = pm->i64NumPageFaults;
+    mem.i64PagesFromFree    = pm->i64PagesFromFree;
+    mem.i64TranslateCycles  = pm->i64TranslateCycles;
+    mem.i64SwapFreeAt       = pm->i64SwapFreeAt;
+    mem.i64MinorFaults      = pm->i64MinorFaults;
+    mem.i64MajorFaults      = pm->i64MajorFaults;
+    mem.i64SwapReads        = pm->i64SwapReads;
+    mem.i64SwapWrites       = pm->i64SwapWrites;
+    mem.i64EvictWritebacks  = pm->i64EvictWritebacks;
+    mem.i64FaultCycles      = pm->i64FaultCycles;
+    mem.i64MinorFaultCycles = pm->i64MinorFaultCycles;
+    mem.i64SwapInCycles     = pm->i64SwapInCycles;
+    mem.i64SwapOutCycles    = pm->i64SwapOutCycles;
+    ckSection(&w, CKPT_SEC_MEMORY, &mem, sizeof(mem));
+    ckSection(&w, CKPT_SEC_FRAMES, pm->frames, pm->i64NumFramesUsable * sizeof(struct Frame));
+    ckBegin(&w, CKPT_SEC_ALLOC);
+    ckWrite(&w, pm->i64ColorNext,  (uint64_t)pm->i32NumColors * sizeof(uint64_t));
+    ckWrite(&w, pm->i64ColorFreed, (uint64_t)pm->i32NumColors * sizeof(uint64_t));
+    ckWrite(&w, pm->i64FrameOrder, (pm->i64NumFramesUsable + 1) * sizeof(uint64_t));
+    ckWrite(&w, pm->i64FreedHeap,  (pm->i64NumFramesUsable + 1) * sizeof(uint64_t));
+    ckEnd(&w, CKPT_SEC_ALLOC);
+
+    // page tables
+    ckBegin(&w, CKPT_SEC_VMS);
+    for (int v = 0; v < st->iNumVMs; v++) {
+        const struct VM *vm = &st->vms[v];
+        struct CkptVM o;
+        memset(&o, 0, sizeof(o));
+        o.i64Tick          = vm->i64Tick;
+        o.i64NumPageFaults = vm->i64NumPageFaults;
+        o.i64NumAccesses   = vm->i64NumAccesses;
+        o.i64PageTableHits = vm->i64PageTableHits;
+        o.i64PagesFromFree = vm->i64PagesFromFree;
+        o.i64NumEvicted    = vm->i64NumEvicted;
+        o.i64MinorFaults   = vm->i64MinorFaults;
+        o.i64MajorFaults   = vm->i64MajorFaults;
+        o.i64FaultCycles   = vm->i64FaultCycles;
+        saveDomain(&o.domain, &vm->replDomain);
+        ckWrite(&w, &o, sizeof(o));
+    }
+    ckEnd(&w, CKPT_SEC_VMS);
+    ckBegin(&w, CKPT_SEC_LEAVES);
+    for (int v = 0; v < st->iNumVMs; v++) {
+        const struct VM *vm = &st->vms[v];
+        for (uint64_t d = 0; d < vm->i64NumDirEntries; d++) {
+            if (!vm->pageDir[d]) continue;
+            struct CkptLeaf leaf = { (uint32_t)v, 0, d };
+            ckWrite(&w, &leaf, sizeof(leaf));
+            ckWrite(&w, vm->pageDir[d], (1ULL << vm->i32LeafBits) * sizeof(struct PTE));
+        }
+    }
+    ckEnd(&w, CKPT_SEC_LEAVES);
+
+    // traces and scheduler
+    ckBegin(&w, CKPT_SEC_TRACES);
+    for (int t = 0; t < st->pool->iNumTraces; t++) {
+        struct CkptTrace o;
+        o.i64Size   = st->pool->traces[t].i64Size;
+        o.i64Offset = o.i64Size - tracePoolBytesLeft(st->pool, t);
+        ckWrite(&w, &o, sizeof(o));
+    }
+    ckEnd(&w, CKPT_SEC_TRACES);
+    struct CkptSched sc = { st->sched->iNext, 0, st->sched->i64RandState };
+    ckSection(&w, CKPT_SEC_SCHED, &sc, sizeof(sc));
+    ckSection(&w, CKPT_SEC_SCHED_PROCS, st->sched->procs,
+              (uint64_t)st->sched->iNumProcs * sizeof(struct SchedProc));
+
+    // now that every section is placed
+    fseek(w.fp, (long)sizeof(h), SEEK_SET);
+    if (fwrite(w.table, sizeof(w.table), 1, w.fp) != 1 || fclose(w.fp) != 0) {
+        fprintf(stderr, "Error: failed to write checkpoint %s\n", sPath);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* ---- reader ---- */
+
+struct CkptMap {
+    const char    *sPath;
+    const uint8_t *data;
+    uint64_t      i64Bytes;
+    bool          bMapped;
+};
+
+static void ckMismatch(const struct CkptMap *m, const char *sWhat)
+{
+    fprintf(stderr, "Error: checkpoint %s does not match this run (%s)\n", m->sPath, sWhat);
+    exit(EXIT_FAILURE);
+}
+
+static void ckOpen(struct CkptMap *m, const char *sPath)
+{
+    memset(m, 0, sizeof(*m));
+    m->sPath = sPath;
+    FILE *fp = fopen(sPath, "rb");
+    if (!fp) {
+        fprintf(stderr, "Error: failed to open checkpoint %s\n", sPath);
+        exit(EXIT_FAILURE);
+    }
+    fseek(fp, 0, SEEK_END);
+    long lSize = ftell(fp);
+    m->i64Bytes = lSize > 0 ? (uint64_t)lSize : 0;
+    if (m->i64Bytes < sizeof(struct CkptHeader) + CKPT_NUM_SECTIONS * sizeof(struct CkptSection))
+        ckMismatch(m, "truncated file");
+
+#ifndef _WIN32
+    void *p = mmap(NULL, (size_t)m->i64Bytes, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    if (p != MAP_FAILED) {
+        m->data = p;
+        m->bMapped = true;
+        fclose(fp);
+        return;
+    }
+#endif
+    uint8_t *buf = malloc((size_t)m->i64Bytes);
+    if (!buf) {
+        fprintf(stderr, "Failed to allocate checkpoint buffer\n");
+        exit(EXIT_FAILURE);
+    }
+    rewind(fp);
+    if (fread(buf, 1, (size_t)m->i64Bytes, fp) != m->i64Bytes) {
+        fprintf(stderr, "Error: failed to read checkpoint %s\n", sPath);
+        exit(EXIT_FAILURE);
+    }
+    fclose(fp);
+    m->data = buf;
+}
+
+static void ckClose(struct CkptMap *m)
+{
+#ifndef _WIN32
+    if (m->bMapped) {
+        munmap((void *)m->data, (size_t)m->i64Bytes);
+        return;
+    }
+#endif
+    free((void *)m->data);
+}
+
+/* section i32Id, which must hold exactly i64Bytes (UINT64_MAX = any size) */
+static const uint8_t *ckFind(const struct CkptMap *m, uint32_t i32Id, uint64_t i64Bytes, uint64_t *pBytes)
+{
+    const struct CkptSection *table = (const struct CkptSection *)(m->data + sizeof(struct CkptHeader));
+    const struct CkptSection *sec = &table[i32Id];
+    if (sec->i32Id != i32Id || sec->i64Offset > m->i64Bytes || sec->i64Bytes > m->i64Bytes - sec->i64Offset)
+        ckMismatch(m, "damaged section table");
+    if (i64Bytes != UINT64_MAX && sec->i64Bytes != i64Bytes)
+        ckMismatch(m, "section size");
+    if (pBytes) *pBytes = sec->i64Bytes;
+    return m->data + sec->i64Offset;
+}
+
+void readCheckpoint(const char *sPath, struct SimState *st)
+{
+    struct Cache *c = st->cache;
+    struct PhysicalMemory *pm = st->pm;
+
+    struct CkptMap m;
+    ckOpen(&m, sPath);
+
+    const struct CkptHeader *h = (const struct CkptHeader *)m.data;
+    struct CkptHeader mine;
+    fillHeader(&mine, st);
+    if (memcmp(h->sMagic, CKPT_MAGIC, sizeof(h->sMagic)) != 0) ckMismatch(&m, "not a checkpoint");
+    if (h->i32Version != CKPT_VERSION || h->i32NumSections != CKPT_NUM_SECTIONS)
+        ckMismatch(&m, "format version");
+    if (h->i32LineBytes != mine.i32LineBytes || h->i32FrameBytes != mine.i32FrameBytes ||
+        h->i32PteBytes != mine.i32PteBytes || h->i32ProcStatsBytes != mine.i32ProcStatsBytes ||
+        h->i32SchedProcBytes != mine.i32SchedProcBytes)
+        ckMismatch(&m, "written by another build");
+    if (h->i32NumSets != mine.i32NumSets || h->i32Assoc != mine.i32Assoc ||
+        h->i32BlockSize != mine.i32BlockSize || h->i32SectorsPerLine != mine.i32SectorsPerLine)
+        ckMismatch(&m, "cache geometry");
+    if (h->i32Indexing != mine.i32Indexing) ckMismatch(&m, "set index function");
+    if (h->i64NumFramesUsable != mine.i64NumFramesUsable || h->i32NumColors != mine.i32NumColors ||
+        h->i32AllocPolicy != mine.i32AllocPolicy)
+        ckMismatch(&m, "physical memory");
+    if (h->i32ReplPolicy != mine.i32ReplPolicy || h->i32ReplScope != mine.i32ReplScope)
+        ckMismatch(&m, "page replacement");
+    if (h->i32NumVMs != mine.i32NumVMs || h->i32LeafBits != mine.i32LeafBits)
+        ckMismatch(&m, "trace count");
+
+    // traces first: nothing is loaded if they differ
+    const struct CkptTrace *traces = (const struct CkptTrace *)
+        ckFind(&m, CKPT_SEC_TRACES, (uint64_t)st->pool->iNumTraces * sizeof(struct CkptTrace), NULL);
+    for (int t = 0; t < st->pool->iNumTraces; t++) {
+        if (traces[t].i64Size != st->pool->traces[t].i64Size) ckMismatch(&m, "trace files");
+    }
+    for (int t = 0; t < st->pool->iNumTraces; t++)
+        st->pool->traces[t].i64Offset = traces[t].i64Offset;
+
+    // cache
+    const struct CkptCache *cc = (const struct CkptCache *)ckFind(&m, CKPT_SEC_CACHE, sizeof(struct CkptCache), NULL);
+    c->accesses         = cc->i64Accesses;
+    c->hits             = cc->i64Hits;
+    c->misses           = cc->i64Misses;
+    c->compulsoryMisses = cc->i64CompulsoryMisses;
+    c->conflictMisses   = cc->i64ConflictMisses;
+    c->instrBytes       = cc->i64InstrBytes;
+    c->srcDstBytes      = cc->i64SrcDstBytes;
+    c->addresses        = cc->i64Addresses;
+    c->writebacks       = cc->i64Writebacks;
+    c->sectorMisses     = cc->i64SectorMisses;
+    c->fetchBytes       = cc->i64FetchBytes;
+    c->writebackBytes   = cc->i64WritebackBytes;
+    c->evictedLines     = cc->i64EvictedLines;
+    c->evictedSectors   = cc->i64EvictedSectors;
+    c->flushes          = cc->i64Flushes;
+    c->memCycles        = cc->i64MemCycles;
+    c->instructions     = cc->i64Instructions;
+    c->tick             = cc->i64Tick;
+
+    uint64_t i64SetBytes = (uint64_t)c->associativity * sizeof(struct CacheLine);
+    const uint8_t *lines = ckFind(&m, CKPT_SEC_LINES, i64SetBytes * c->numSets, NULL);
+    for (uint32_t s = 0; s < c->numSets; s++)
+        memcpy(c->sets[s].lines, lines + s * i64SetBytes, (size_t)i64SetBytes);
+    memcpy(c->rrNext, ckFind(&m, CKPT_SEC_RR, (uint64_t)c->numSets * sizeof(uint64_t), NULL),
+           c->numSets * sizeof(uint64_t));
+    memcpy(c->setMisses, ckFind(&m, CKPT_SEC_SET_MISSES, (uint64_t)c->numSets * sizeof(uint64_t), NULL),
+           c->numSets * sizeof(uint64_t));
+    memcpy(c->procStats, ckFind(&m, CKPT_SEC_PROC_STATS, (uint64_t)c->numProcs * sizeof(struct CacheProcStats), NULL),
+           c->numProcs * sizeof(struct CacheProcStats));
+
+    // physical memory
+    const struct CkptMemory *mem = (const struct CkptMemory *)ckFind(&m, CKPT_SEC_MEMORY, sizeof(struct CkptMemory), NULL);
+    pm->i64NumFramesUsed    = mem->i64NumFramesUsed;
+    pm->i32NextColor        = mem->i32NextColor;
+    pm->i64Tick             = mem->i64Tick;
+    loadDomain(&pm->replDomain, &mem->domain);
+    pm->i64NumAccesses      = mem->i64NumAccesses;
+    pm->i64NumEvictions     = mem->i64NumEvictions;
+    pm->i64PageCleanings    = mem->i64PageCleanings;
+    pm->i64LocalSteals      = mem->i64LocalSteals;
+    pm->i64NumPageFaults    = mem->i64NumPageFaults;
+    pm->i64PagesFromFree    = mem->i64PagesFromFree;
+    pm->i64TranslateCycles  = mem->i64TranslateCycles;
+    pm->i64SwapFreeAt       = mem->i64SwapFreeAt;
+    pm->i64MinorFaults      = mem->i64MinorFaults;
+    pm->i64MajorFaults      = mem->i64MajorFaults;
+    pm->i64SwapReads        = mem->i64SwapReads;
+    pm->i64SwapWrites       = mem->i64SwapWrites;
+    pm->i64EvictWritebacks  = mem->i64EvictWritebacks;
+    pm->i64FaultCycles      = mem->i64FaultCycles;
+    pm->i64MinorFaultCycles = mem->i64MinorFaultCycles;
+    pm->i64SwapInCycles     = mem->i64SwapInCycles;
+    pm->i64SwapOutCycles    = mem->i64SwapOutCycles;
+    memcpy(pm->frames, ckFind(&m, CKPT_SEC_FRAMES, pm->i64NumFramesUsable * sizeof(struct Frame), NULL),
+           pm->i64NumFramesUsable * sizeof(struct Frame));
+
+    uint64_t i64ColorBytes = (uint64_t)pm->i32NumColors * sizeof(uint64_t);
+    uint64_t i64OrderBytes = (pm->i64NumFramesUsable + 1) * sizeof(uint64_t);
+    const uint8_t *alloc = ckFind(&m, CKPT_SEC_ALLOC, 2 * i64ColorBytes + 2 * i64OrderBytes, NULL);
+    memcpy(pm->i64ColorNext,  alloc, i64ColorBytes);
+    memcpy(pm->i64ColorFreed, alloc + i64ColorBytes, i64ColorBytes);
+    memcpy(pm->i64FrameOrder, alloc + 2 * i64ColorBytes, i64OrderBytes);
+    memcpy(pm->i64FreedHeap,  alloc + 2 * i64ColorBytes + i64OrderBytes, i64OrderBytes);
+
+    // page tables
+    const struct CkptVM *vmState = (const struct CkptVM *)
+        ckFind(&m, CKPT_SEC_VMS, (uint64_t)st->iNumVMs * sizeof(struct CkptVM), NULL);
+    for (int v = 0; v < st->iNumVMs; v++) {
+        struct VM *vm = &st->vms[v];
+        const struct CkptVM *o = &vmState[v];
+        vm->i64Tick          = o->i64Tick;
+        vm->i64NumPageFaults = o->i64NumPageFaults;
+        vm->i64NumAccesses   = o->i64NumAccesses;
+        vm->i64PageTableHits = o->i64PageTableHits;
+        vm->i64PagesFromFree = o->i64PagesFromFree;
+        vm->i64NumEvicted    = o->i64NumEvicted;
+        vm->i64MinorFaults   = o->i64MinorFaults;
+        vm->i64MajorFaults   = o->i64MajorFaults;
+        vm->i64FaultCycles   = o->i64FaultCycles;
+        loadDomain(&vm->replDomain, &o->domain);
+    }
+
+    uint64_t i64LeafBytes = sizeof(struct CkptLeaf) + (1ULL << mine.i32LeafBits) * sizeof(struct PTE);
+    uint64_t i64LeavesBytes;
+    const uint8_t *leaves = ckFind(&m, CKPT_SEC_LEAVES, UINT64_MAX, &i64LeavesBytes);
+    if (i64LeavesBytes % i64LeafBytes != 0) ckMismatch(&m, "page table leaves");
+    for (uint64_t off = 0; off < i64LeavesBytes; off += i64LeafBytes) {
+        const struct CkptLeaf *leaf = (const struct CkptLeaf *)(leaves + off);
+        if (leaf->i32Vm >= (uint32_t)st->iNumVMs) ckMismatch(&m, "page table leaves");
+        struct VM *vm = &st->vms[leaf->i32Vm];
+        if (leaf->i64Dir >= vm->i64NumDirEntries) ckMismatch(&m, "page table leaves");
+        struct PTE *pte = lookupPTE(vm, leaf->i64Dir << vm->i32LeafBits, true);
+        memcpy(pte, leaf + 1, (size_t)(i64LeafBytes - sizeof(struct CkptLeaf)));
+    }
+
+    // scheduler
+    const struct CkptSched *sc = (const struct CkptSched *)ckFind(&m, CKPT_SEC_SCHED, sizeof(struct CkptSched), NULL);
+    const struct SchedProc *procs = (const struct SchedProc *)
+        ckFind(&m, CKPT_SEC_SCHED_PROCS, (uint64_t)st->sched->iNumProcs * sizeof(struct SchedProc), NULL);
+    schedRestore(st->sched, procs, sc->iNext, sc->i64RandState);
+
+    st->iRunning        = h->iRunning;
+    st->i64Cycles       = h->i64Cycles;
+    st->i64Instructions = h->i64Instructions;
+
+    ckClose(&m);
+}
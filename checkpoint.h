@@ -0,0 +1,55 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct PhysicalMemory;
+struct VM;
+struct TracePool;
+struct Scheduler;
+struct Cache;
+
+/*
+ * Simulator state saved at a time slice boundary so a later run can skip
+ * the instructions before it. The file is a fixed header, a section table
+ * and 8-byte aligned sections of plain records, so it can be mmap'd and
+ * copied straight into the live structures:
+ *
+ *   cache      counters, every line, RR pointers, per set misses, per process stats
+ *   memory     frame table, allocator queues, replacement lists, counters
+ *   VMs        counters and every touched page table leaf
+ *   traces     resume offset of each trace
+ *   scheduler  per trace state, round robin cursor, lottery generator
+ *
+ * Not saved: TLB, DRAM banks, UCP monitors and the rand() stream; a
+ * restored run starts those cold. The geometry of the cache and of
+ * physical memory, the set index function, the page replacement policy
+ * and the traces must match the run that wrote the checkpoint; the cache
+ * replacement policy, timing models and quanta may differ.
+ */
+#define CKPT_MAGIC   "CSIMCKPT"
+#define CKPT_VERSION 5     // 5: cache writebacks of evicted pages
+
+struct SimState {
+    struct PhysicalMemory *pm;
+    struct VM        *vms;
+    int              iNumVMs;
+    struct TracePool *pool;
+    struct Scheduler *sched;
+    struct Cache     *cache;
+    int              iRunning;      // trace that ran the last slice, -1 = none
+    uint64_t         i64Cycles;
+    uint64_t         i64Instructions;
+};
+
+/* false if the page replacement policy keeps state a checkpoint cannot hold */
+bool checkpointSupported(const struct PhysicalMemory *pm);
+
+void writeCheckpoint(const char *sPath, const struct SimState *st);
+
+/* load a checkpoint into structures initialised with the same geometry;
+   exits with a message if the file does not match them */
+void readCheckpoint(const char *sPath, struct SimState *st);
+
+#endif
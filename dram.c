@@ -0,0 +1,225 @@
+#include "dram.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint8_t log2_u8(uint32_t v)
+{
+    uint8_t r = 0;
+    while ((1u << r) < v) r++;
+    return r;
+}
+
+DramPagePolicy dram_policy_from_string(const char *sPolicyCode)
+{
+    if (strcmp(sPolicyCode, "closed") == 0) return DRAM_CLOSED_PAGE;
+    return DRAM_OPEN_PAGE; // default
+}
+
+void initDRAM(struct DRAM *d,
+              uint32_t i32NumChannels,
+              uint32_t i32NumRanks,
+              uint32_t i32NumBanks,
+              uint32_t i32BlockSize,
+              DramPagePolicy pagePolicy,
+              DramAddressMap addressMap)
+{
+    memset(d, 0, sizeof(*d));
+
+    d->i32NumChannels = i32NumChannels ? i32NumChannels : 1;
+    d->i32NumRanks    = i32NumRanks    ? i32NumRanks    : 1;
+    d->i32NumBanks    = i32NumBanks    ? i32NumBanks    : 8;
+    d->i32RowBytes    = DRAM_ROW_BYTES;
+    d->i32BlockSize   = i32BlockSize;
+    d->pagePolicy     = pagePolicy;
+    d->addressMap     = addressMap;
+
+    d->i32tCAS        = DRAM_DEFAULT_TCAS;
+    d->i32tRCD        = DRAM_DEFAULT_TRCD;
+    d->i32tRP         = DRAM_DEFAULT_TRP;
+
+    /* blocks larger than a row still map onto a single row */
+    if (d->i32RowBytes < i32BlockSize) d->i32RowBytes = i32BlockSize;
+
+    d->i8ColumnBits  = log2_u8(d->i32RowBytes);
+    d->i8LineBits    = log2_u8(i32BlockSize);
+    d->i8ChannelBits = log2_u8(d->i32NumChannels);
+    d->i8RankBits    = log2_u8(d->i32NumRanks);
+    d->i8BankBits    = log2_u8(d->i32NumBanks);
+
+    uint64_t i64NumBanks = (uint64_t)d->i32NumChannels * d->i32NumRanks * d->i32NumBanks;
+    d->banks    = calloc(i64NumBanks, sizeof(struct DramBank));
+    d->channels = calloc(d->i32NumChannels, sizeof(struct DramChannel));
+    if (!d->banks || !d->channels) {
+        fprintf(stderr, "Failed to allocate DRAM banks\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void freeDRAM(struct DRAM *d)
+{
+    free(d->banks);
+    free(d->channels);
+    memset(d, 0, sizeof(*d));
+}
+
+/* split a physical address into channel / rank / bank / row */
+static void decodeDramAddress(const struct DRAM *d,
+                              uint64_t i64PhysAddr,
+                              uint32_t *pChannel,
+                              uint32_t *pRank,
+                              uint32_t *pBank,
+                              uint64_t *pRow)
+{
+    uint64_t a;
+
+    if (d->addressMap == DRAM_MAP_LINE) {
+        /* consecutive blocks rotate over channels, then banks, then ranks */
+        a = i64PhysAddr >> d->i8LineBits;
+        *pChannel = (uint32_t)(a & ((1u << d->i8ChannelBits) - 1)); a >>= d->i8ChannelBits;
+        *pBank    = (uint32_t)(a & ((1u << d->i8BankBits) - 1));    a >>= d->i8BankBits;
+        *pRank    = (uint32_t)(a & ((1u << d->i8RankBits) - 1));    a >>= d->i8RankBits;
+        a >>= (d->i8ColumnBits - d->i8LineBits);
+        *pRow     = a;
+    } else {
+        /* a whole row buffer of consecutive bytes lives in one bank */
+        a = i64PhysAddr >> d->i8ColumnBits;
+        *pChannel = (uint32_t)(a & ((1u << d->i8ChannelBits) - 1)); a >>= d->i8ChannelBits;
+        *pBank    = (uint32_t)(a & ((1u << d->i8BankBits) - 1));    a >>= d->i8BankBits;
+        *pRank    = (uint32_t)(a & ((1u << d->i8RankBits) - 1));    a >>= d->i8RankBits;
+        *pRow     = a;
+    }
+
+    /* non power-of-two geometries wrap around */
+    *pChannel %= d->i32NumChannels;
+    *pRank    %= d->i32NumRanks;
+    *pBank    %= d->i32NumBanks;
+}
+
+uint32_t dramAccess(struct DRAM *d,
+                    uint64_t i64PhysAddr,
+                    bool bIsWrite,
+                    uint64_t i64Now)
+{
+    return dramAccessBytes(d, i64PhysAddr, d->i32BlockSize, bIsWrite, i64Now);
+}
+
+uint32_t dramAccessBytes(struct DRAM *d,
+                         uint64_t i64PhysAddr,
+                         uint32_t i32Bytes,
+                         bool bIsWrite,
+                         uint64_t i64Now)
+{
+    uint32_t i32Channel, i32Rank, i32BankIdx;
+    uint64_t i64Row;
+    decodeDramAddress(d, i64PhysAddr, &i32Channel, &i32Rank, &i32BankIdx, &i64Row);
+
+    uint64_t i64BankId = ((uint64_t)i32Channel * d->i32NumRanks + i32Rank) * d->i32NumBanks + i32BankIdx;
+    struct DramBank    *bank = &d->banks[i64BankId];
+    struct DramChannel *chan = &d->channels[i32Channel];
+
+    if (bIsWrite) d->i64Writes++;
+    else          d->i64Reads++;
+    bank->i64Accesses++;
+
+    /* wait for earlier requests queued on this bank */
+    uint64_t i64Start = i64Now;
+    if (bank->i64BusyUntil > i64Start) {
+        d->i64QueueCycles += bank->i64BusyUntil - i64Start;
+        i64Start = bank->i64BusyUntil;
+    }
+
+    /* row buffer state decides the command sequence */
+    uint32_t i32Core;
+    if (bank->bRowOpen && bank->i64OpenRow == i64Row) {
+        d->i64RowHits++;
+        i32Core = d->i32tCAS;
+    } else if (!bank->bRowOpen) {
+        d->i64RowEmpty++;
+        i32Core = d->i32tRCD + d->i32tCAS;
+    } else {
+        d->i64RowConflicts++;
+        i32Core = d->i32tRP + d->i32tRCD + d->i32tCAS;
+    }
+
+    /* data burst needs the channel bus */
+    uint32_t i32Beats = (i32Bytes + DRAM_BUS_BYTES - 1) / DRAM_BUS_BYTES;
+    uint64_t i64DataStart = i64Start + i32Core;
+    if (chan->i64BusFreeAt > i64DataStart) {
+        d->i64BusCycles += chan->i64BusFreeAt - i64DataStart;
+        i64DataStart = chan->i64BusFreeAt;
+    }
+    uint64_t i64Done = i64DataStart + (uint64_t)i32Beats * DRAM_BURST_CYCLES;
+    chan->i64BusFreeAt = i64Done;
+
+    if (d->pagePolicy == DRAM_CLOSED_PAGE) {
+        /* auto-precharge keeps the bank busy but leaves it empty */
+        bank->bRowOpen     = false;
+        bank->i64BusyUntil = i64Done + d->i32tRP;
+    } else {
+        bank->bRowOpen     = true;
+        bank->i64OpenRow   = i64Row;
+        bank->i64BusyUntil = i64Done;
+    }
+
+    uint32_t i32Latency = (uint32_t)(i64Done - i64Now);
+    if (!bIsWrite) d->i64TotalLatency += i32Latency;
+    return i32Latency;
+}
+
+void resetDramStats(struct DRAM *d)
+{
+    d->i64Reads        = 0;
+    d->i64Writes       = 0;
+    d->i64RowHits      = 0;
+    d->i64RowEmpty     = 0;
+    d->i64RowConflicts = 0;
+    d->i64TotalLatency = 0;
+    d->i64QueueCycles  = 0;
+    d->i64BusCycles    = 0;
+
+    uint32_t i32NumBanks = d->i32NumChannels * d->i32NumRanks * d->i32NumBanks;
+    for (uint32_t b = 0; b < i32NumBanks; b++) d->banks[b].i64Accesses = 0;
+}
+
+void printDramResults(const struct DRAM *d)
+{
+    uint64_t i64Requests = d->i64Reads + d->i64Writes;
+
+    printf("\n***** DRAM SIMULATION RESULTS *****\n\n");
+    printf("%-32s%u ch x %u rank x %u banks\n", "Organization:",
+           d->i32NumChannels, d->i32NumRanks, d->i32NumBanks);
+    printf("%-32s%s\n", "Page Policy:",
+           d->pagePolicy == DRAM_CLOSED_PAGE ? "Closed Page" : "Open Page");
+    printf("%-32s%s\n", "Address Mapping:",
+           d->addressMap == DRAM_MAP_LINE ? "Row:Col:Rank:Bank:Chan" : "Row:Rank:Bank:Chan:Col");
+    printf("%-32s%u / %u / %u cycles\n", "tCAS / tRCD / tRP:", d->i32tCAS, d->i32tRCD, d->i32tRP);
+
+    printf("%-32s%llu\n", "Reads (Block Fills):", (unsigned long long)d->i64Reads);
+    printf("%-32s%llu\n", "Writes (Writebacks):", (unsigned long long)d->i64Writes);
+
+    double dHitPct      = i64Requests ? 100.0 * d->i64RowHits      / i64Requests : 0.0;
+    double dEmptyPct    = i64Requests ? 100.0 * d->i64RowEmpty     / i64Requests : 0.0;
+    double dConflictPct = i64Requests ? 100.0 * d->i64RowConflicts / i64Requests : 0.0;
+    printf("--- Row Buffer Hits:            %llu ( %.2f%% )\n", (unsigned long long)d->i64RowHits, dHitPct);
+    printf("--- Row Buffer Empty:           %llu ( %.2f%% )\n", (unsigned long long)d->i64RowEmpty, dEmptyPct);
+    printf("--- Row Buffer Conflicts:       %llu ( %.2f%% )\n", (unsigned long long)d->i64RowConflicts, dConflictPct);
+
+    double dAvgLatency = d->i64Reads ? (double)d->i64TotalLatency / d->i64Reads : 0.0;
+    printf("%-32s%.2f cycles\n", "Average Read Latency:", dAvgLatency);
+    printf("%-32s%llu cycles\n", "Bank Queueing Delay:", (unsigned long long)d->i64QueueCycles);
+    printf("%-32s%llu cycles\n", "Channel Bus Contention:", (unsigned long long)d->i64BusCycles);
+
+    /* how evenly requests were spread across banks */
+    uint64_t i64NumBanks = (uint64_t)d->i32NumChannels * d->i32NumRanks * d->i32NumBanks;
+    uint64_t i64BanksUsed = 0, i64MaxBank = 0;
+    for (uint64_t b = 0; b < i64NumBanks; b++) {
+        if (d->banks[b].i64Accesses) i64BanksUsed++;
+        if (d->banks[b].i64Accesses > i64MaxBank) i64MaxBank = d->banks[b].i64Accesses;
+    }
+    double dAvgBank = i64NumBanks ? (double)i64Requests / i64NumBanks : 0.0;
+    printf("%-32s%llu / %llu\n", "Banks Touched:",
+           (unsigned long long)i64BanksUsed, (unsigned long long)i64NumBanks);
+    printf("%-32s%.2f (max / avg per bank)\n", "Bank Imbalance:",
+           dAvgBank > 0.0 ? (double)i64MaxBank / dAvgBank : 0.0);
+}
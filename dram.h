@@ -0,0 +1,106 @@
+#ifndef DRAM_H
+#define DRAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    DRAM_OPEN_PAGE,         // keep the row open after an access
+    DRAM_CLOSED_PAGE        // precharge right after every access
+} DramPagePolicy;
+
+typedef enum {
+    DRAM_MAP_ROW,           // row : rank : bank : channel : column
+    DRAM_MAP_LINE           // row : column : rank : bank : channel (line interleaved)
+} DramAddressMap;
+
+/* timings are expressed in CPU cycles */
+#define DRAM_DEFAULT_TCAS       11
+#define DRAM_DEFAULT_TRCD       11
+#define DRAM_DEFAULT_TRP        11
+#define DRAM_BURST_CYCLES       4      /* cycles per bus beat */
+#define DRAM_BUS_BYTES          8      /* bytes per bus beat  */
+#define DRAM_ROW_BYTES          8192   /* row buffer size per bank */
+
+struct DramBank {
+    uint64_t i64OpenRow;           // row held in the row buffer
+    bool     bRowOpen;
+    uint64_t i64BusyUntil;         // cycle the bank can accept the next request
+    uint64_t i64Accesses;
+};
+
+struct DramChannel {
+    uint64_t i64BusFreeAt;         // cycle the data bus is released
+};
+
+struct DRAM {
+    uint32_t i32NumChannels;
+    uint32_t i32NumRanks;
+    uint32_t i32NumBanks;          // banks per rank
+    uint32_t i32RowBytes;
+    uint32_t i32BlockSize;         // transfer size (cache block)
+
+    uint32_t i32tCAS;
+    uint32_t i32tRCD;
+    uint32_t i32tRP;
+
+    DramPagePolicy pagePolicy;
+    DramAddressMap addressMap;
+
+    uint8_t  i8ColumnBits;
+    uint8_t  i8ChannelBits;
+    uint8_t  i8RankBits;
+    uint8_t  i8BankBits;
+    uint8_t  i8LineBits;
+
+    struct DramBank    *banks;     // [channel][rank][bank]
+    struct DramChannel *channels;
+
+    /* stats */
+    uint64_t i64Reads;
+    uint64_t i64Writes;
+    uint64_t i64RowHits;
+    uint64_t i64RowEmpty;          // bank was precharged
+    uint64_t i64RowConflicts;      // another row was open
+    uint64_t i64TotalLatency;      // cycles seen by reads
+    uint64_t i64QueueCycles;       // cycles waiting on a busy bank
+    uint64_t i64BusCycles;         // cycles waiting on the channel bus
+};
+
+void initDRAM(struct DRAM *d,
+              uint32_t i32NumChannels,
+              uint32_t i32NumRanks,
+              uint32_t i32NumBanks,
+              uint32_t i32BlockSize,
+              DramPagePolicy pagePolicy,
+              DramAddressMap addressMap);
+
+void freeDRAM(struct DRAM *d);
+
+/*
+ * i64PhysAddr – physical address of the block being transferred
+ * bIsWrite    – true for writebacks
+ * i64Now      – cycle the request reaches the memory controller
+ *
+ * Returns the cycles until the block transfer completes.
+ */
+uint32_t dramAccess(struct DRAM *d,
+                    uint64_t i64PhysAddr,
+                    bool bIsWrite,
+                    uint64_t i64Now);
+
+/* same, for a transfer of i32Bytes instead of a whole block (sectored caches) */
+uint32_t dramAccessBytes(struct DRAM *d,
+                         uint64_t i64PhysAddr,
+                         uint32_t i32Bytes,
+                         bool bIsWrite,
+                         uint64_t i64Now);
+
+DramPagePolicy dram_policy_from_string(const char *s);
+
+/* zero the stats, open rows and busy times stay */
+void resetDramStats(struct DRAM *d);
+
+void printDramResults(const struct DRAM *d);
+
+#endif
@@ -0,0 +1,153 @@
+#include "hostCounters.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+static const char *counter_name(int i)
+{
+    switch (i) {
+        case HC_CYCLES:        return "Cycles";
+        case HC_INSTRUCTIONS:  return "Instructions";
+        case HC_LLC_MISSES:    return "LLC Misses";
+        case HC_DTLB_MISSES:   return "dTLB Misses";
+        default:               return "Branch Misses";
+    }
+}
+
+#ifdef __linux__
+
+static int openCounter(uint32_t i32Type, uint64_t i64Config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = i32Type;
+    attr.config = i64Config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;        // allowed at perf_event_paranoid 2
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+bool openHostCounters(struct HostCounters *hc)
+{
+    static const uint32_t i32ArrType[HC_NUM_COUNTERS] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+        PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE
+    };
+    static const uint64_t i64ArrConfig[HC_NUM_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+
+    memset(hc, 0, sizeof(*hc));
+    int iErr = 0;
+    for (int i = 0; i < HC_NUM_COUNTERS; i++) {
+        hc->iArrFd[i] = openCounter(i32ArrType[i], i64ArrConfig[i]);
+        if (hc->iArrFd[i] >= 0) hc->iNumOpen++;
+        else if (!iErr)         iErr = errno;
+    }
+    if (hc->iNumOpen == 0)
+        fprintf(stderr, "Warning: host counters unavailable (perf_event_open: %s)\n", strerror(iErr));
+    return hc->iNumOpen > 0;
+}
+
+void startHostCounters(struct HostCounters *hc)
+{
+    for (int i = 0; i < HC_NUM_COUNTERS; i++) {
+        if (hc->iArrFd[i] < 0) continue;
+        ioctl(hc->iArrFd[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(hc->iArrFd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void stopHostCounters(struct HostCounters *hc)
+{
+    for (int i = 0; i < HC_NUM_COUNTERS; i++)
+        if (hc->iArrFd[i] >= 0) ioctl(hc->iArrFd[i], PERF_EVENT_IOC_DISABLE, 0);
+
+    for (int i = 0; i < HC_NUM_COUNTERS; i++) {
+        uint64_t i64ArrRead[3];     // value, time enabled, time running
+        if (hc->iArrFd[i] < 0) continue;
+        if (read(hc->iArrFd[i], i64ArrRead, sizeof(i64ArrRead)) != (ssize_t)sizeof(i64ArrRead)
+            || i64ArrRead[2] == 0) {
+            // never scheduled on the PMU: as good as unavailable
+            close(hc->iArrFd[i]);
+            hc->iArrFd[i] = -1;
+            hc->iNumOpen--;
+            continue;
+        }
+        // more events than PMU slots: the kernel time-shares them
+        hc->i64ArrValue[i] = i64ArrRead[2] < i64ArrRead[1]
+                           ? (uint64_t)((double)i64ArrRead[0] * i64ArrRead[1] / i64ArrRead[2])
+                           : i64ArrRead[0];
+    }
+}
+
+void closeHostCounters(struct HostCounters *hc)
+{
+    for (int i = 0; i < HC_NUM_COUNTERS; i++) {
+        if (hc->iArrFd[i] >= 0) close(hc->iArrFd[i]);
+        hc->iArrFd[i] = -1;
+    }
+    hc->iNumOpen = 0;
+}
+
+#else
+
+bool openHostCounters(struct HostCounters *hc)
+{
+    memset(hc, 0, sizeof(*hc));
+    for (int i = 0; i < HC_NUM_COUNTERS; i++) hc->iArrFd[i] = -1;
+    fprintf(stderr, "Warning: host counters unavailable (needs Linux perf events)\n");
+    return false;
+}
+
+void startHostCounters(struct HostCounters *hc) { (void)hc; }
+void stopHostCounters(struct HostCounters *hc)  { (void)hc; }
+void closeHostCounters(struct HostCounters *hc) { (void)hc; }
+
+#endif
+
+void printHostCounters(const struct HostCounters *hc,
+                       uint64_t i64BlockAccesses,
+                       uint64_t i64Instructions)
+{
+    if (hc->iNumOpen == 0) return;
+
+    printf("\n***** HOST COUNTERS *****\n\n");
+    printf("%-22s %16s %18s\n", "Event", "Count", "Per M Accesses");
+    for (int i = 0; i < HC_NUM_COUNTERS; i++) {
+        if (hc->iArrFd[i] < 0) {
+            printf("%-22s %16s %18s\n", counter_name(i), "n/a", "n/a");
+            continue;
+        }
+        printf("%-22s %16" PRIu64 " %18.1f\n", counter_name(i), hc->i64ArrValue[i],
+               i64BlockAccesses ? 1e6 * (double)hc->i64ArrValue[i] / (double)i64BlockAccesses : 0.0);
+    }
+
+    bool bCycles = hc->iArrFd[HC_CYCLES] >= 0 && hc->i64ArrValue[HC_CYCLES] > 0;
+    bool bInstr  = hc->iArrFd[HC_INSTRUCTIONS] >= 0;
+    printf("\n");
+    if (bCycles && bInstr)
+        printf("%-32s%.2f\n", "Host IPC:",
+               (double)hc->i64ArrValue[HC_INSTRUCTIONS] / (double)hc->i64ArrValue[HC_CYCLES]);
+    if (bInstr && i64Instructions)
+        printf("%-32s%.0f\n", "Host Instr / Simulated Instr:",
+               (double)hc->i64ArrValue[HC_INSTRUCTIONS] / (double)i64Instructions);
+    if (bCycles && i64BlockAccesses)
+        printf("%-32s%.0f\n", "Host Cycles / Block Access:",
+               (double)hc->i64ArrValue[HC_CYCLES] / (double)i64BlockAccesses);
+}
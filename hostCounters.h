@@ -0,0 +1,44 @@
+#ifndef HOSTCOUNTERS_H
+#define HOSTCOUNTERS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Hardware counters of the machine running the simulator, read with
+ * perf_event_open around the main loop. Each counter is opened on its
+ * own, so one the CPU or kernel does not offer is reported as n/a and
+ * the rest still count. Off Linux, or when perf events are not allowed
+ * (perf_event_paranoid, containers), nothing opens and the run goes on.
+ */
+typedef enum {
+    HC_CYCLES,
+    HC_INSTRUCTIONS,
+    HC_LLC_MISSES,
+    HC_DTLB_MISSES,
+    HC_BRANCH_MISSES,
+    HC_NUM_COUNTERS
+} HostCounter;
+
+struct HostCounters {
+    int      iArrFd[HC_NUM_COUNTERS];       // -1 = not available
+    uint64_t i64ArrValue[HC_NUM_COUNTERS];  // scaled if the counter was multiplexed
+    int      iNumOpen;
+};
+
+/* false if no counter could be opened; the reason goes to stderr */
+bool openHostCounters(struct HostCounters *hc);
+
+void startHostCounters(struct HostCounters *hc);
+
+/* stops the counters and reads them */
+void stopHostCounters(struct HostCounters *hc);
+
+/* host IPC and host events per million simulated block accesses */
+void printHostCounters(const struct HostCounters *hc,
+                       uint64_t i64BlockAccesses,
+                       uint64_t i64Instructions);
+
+void closeHostCounters(struct HostCounters *hc);
+
+#endif
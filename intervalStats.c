@@ -0,0 +1,260 @@
+#include "intervalStats.h"
+#include "cache.h"
+#include "virtualMem.h"
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+IntervalFormat interval_format_from_string(const char *sFormatCode)
+{
+    if (strcmp(sFormatCode, "json") == 0) return INTERVAL_JSON;
+    return INTERVAL_CSV; // default
+}
+
+static double ratio(uint64_t a, uint64_t b)
+{
+    return b ? (double)a / (double)b : 0.0;
+}
+
+static void writeRecord(struct IntervalLog *log)
+{
+    const struct IntervalSnapshot *c = &log->cur, *p = &log->prev;
+    uint64_t i64Instr  = c->i64Instructions - p->i64Instructions;
+    uint64_t i64Cycles = c->i64Cycles - p->i64Cycles;
+    uint64_t i64Acc    = c->i64Accesses - p->i64Accesses;
+    uint64_t i64Hits   = c->i64Hits - p->i64Hits;
+    uint64_t i64Miss   = c->i64Misses - p->i64Misses;
+    uint64_t i64Comp   = c->i64CompulsoryMisses - p->i64CompulsoryMisses;
+    uint64_t i64Conf   = c->i64ConflictMisses - p->i64ConflictMisses;
+    uint64_t i64Faults = c->i64PageFaults - p->i64PageFaults;
+    uint64_t i64Evict  = c->i64Evictions - p->i64Evictions;
+
+    if (log->format == INTERVAL_JSON) {
+        fprintf(log->fp, "{\"interval\":%" PRIu64 ",\"end_instruction\":%" PRIu64
+                ",\"instructions\":%" PRIu64 ",\"cycles\":%" PRIu64 ",\"cpi\":%.4f"
+                ",\"accesses\":%" PRIu64 ",\"hits\":%" PRIu64 ",\"misses\":%" PRIu64
+                ",\"compulsory_misses\":%" PRIu64 ",\"conflict_misses\":%" PRIu64
+                ",\"page_faults\":%" PRIu64 ",\"evictions\":%" PRIu64 ",\"procs\":[",
+                log->i64Records, c->i64Instructions, i64Instr, i64Cycles, ratio(i64Cycles, i64Instr),
+                i64Acc, i64Hits, i64Miss, i64Comp, i64Conf, i64Faults, i64Evict);
+    } else {
+        fprintf(log->fp, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.4f,%" PRIu64 ",%" PRIu64
+                ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64,
+                log->i64Records, c->i64Instructions, i64Instr, i64Cycles, ratio(i64Cycles, i64Instr),
+                i64Acc, i64Hits, i64Miss, i64Comp, i64Conf, i64Faults, i64Evict);
+    }
+
+    for (int k = 0; k < log->iNumProcs; k++) {
+        const struct IntervalProc *cp = &log->curProcs[k], *pp = &log->prevProcs[k];
+        uint64_t i64PInstr  = cp->i64Instructions - pp->i64Instructions;
+        uint64_t i64PCycles = cp->i64Cycles - pp->i64Cycles;
+        uint64_t i64PAcc    = cp->i64Accesses - pp->i64Accesses;
+        uint64_t i64PMiss   = cp->i64Misses - pp->i64Misses;
+        uint64_t i64PFaults = cp->i64PageFaults - pp->i64PageFaults;
+        if (log->format == INTERVAL_JSON) {
+            fprintf(log->fp, "%s{\"instructions\":%" PRIu64 ",\"cpi\":%.4f,\"accesses\":%" PRIu64
+                    ",\"misses\":%" PRIu64 ",\"page_faults\":%" PRIu64 "}",
+                    k ? "," : "", i64PInstr, ratio(i64PCycles, i64PInstr), i64PAcc, i64PMiss, i64PFaults);
+        } else {
+            fprintf(log->fp, ",%" PRIu64 ",%.4f,%" PRIu64 ",%" PRIu64 ",%" PRIu64,
+                    i64PInstr, ratio(i64PCycles, i64PInstr), i64PAcc, i64PMiss, i64PFaults);
+        }
+    }
+    fputs(log->format == INTERVAL_JSON ? "]}\n" : "\n", log->fp);
+
+    log->prev = log->cur;
+    memcpy(log->prevProcs, log->curProcs, log->iNumProcs * sizeof(struct IntervalProc));
+    log->i64Records++;
+}
+
+static void *intervalWriter(void *arg)
+{
+    struct IntervalLog *log = arg;
+    uint32_t i32Tail = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&log->lock);
+        while (log->i32Count == 0 && !log->bClosing)
+            pthread_cond_wait(&log->notEmpty, &log->lock);
+        if (log->i32Count == 0) {
+            pthread_mutex_unlock(&log->lock);
+            break;
+        }
+        log->cur = log->snaps[i32Tail];
+        memcpy(log->curProcs, &log->procs[(size_t)i32Tail * log->iNumProcs],
+               log->iNumProcs * sizeof(struct IntervalProc));
+        i32Tail = (i32Tail + 1) % INTERVAL_RING_SLOTS;
+        log->i32Count--;
+        pthread_cond_signal(&log->notFull);
+        pthread_mutex_unlock(&log->lock);
+
+        // formatting and I/O happen outside the lock
+        writeRecord(log);
+    }
+    return NULL;
+}
+
+void openIntervalLog(struct IntervalLog *log,
+                     const char *sPath,
+                     IntervalFormat format,
+                     uint64_t i64Every,
+                     int iNumProcs)
+{
+    memset(log, 0, sizeof(*log));
+    log->i64Every  = i64Every;
+    log->i64Next   = i64Every;
+    log->format    = format;
+    log->iNumProcs = iNumProcs;
+
+    log->fp = fopen(sPath, "w");
+    if (!log->fp) {
+        fprintf(stderr, "Error: failed to create interval file %s\n", sPath);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t procSlots = (size_t)(iNumProcs > 0 ? iNumProcs : 1);
+    log->snaps     = calloc(INTERVAL_RING_SLOTS, sizeof(struct IntervalSnapshot));
+    log->procs     = calloc(INTERVAL_RING_SLOTS * procSlots, sizeof(struct IntervalProc));
+    log->prevProcs = calloc(procSlots, sizeof(struct IntervalProc));
+    log->curProcs  = calloc(procSlots, sizeof(struct IntervalProc));
+    log->baseProcs = calloc(procSlots, sizeof(struct IntervalProc));
+    log->curProcsScratch = calloc(procSlots, sizeof(struct IntervalProc));
+    if (!log->snaps || !log->procs || !log->prevProcs || !log->curProcs ||
+        !log->baseProcs || !log->curProcsScratch) {
+        fprintf(stderr, "Failed to allocate interval ring\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (format == INTERVAL_CSV) {
+        fputs("interval,end_instruction,instructions,cycles,cpi,accesses,hits,misses,"
+              "compulsory_misses,conflict_misses,page_faults,evictions", log->fp);
+        for (int k = 0; k < iNumProcs; k++)
+            fprintf(log->fp, ",p%d_instructions,p%d_cpi,p%d_accesses,p%d_misses,p%d_page_faults",
+                    k, k, k, k, k);
+        fputc('\n', log->fp);
+    }
+
+    pthread_mutex_init(&log->lock, NULL);
+    pthread_cond_init(&log->notEmpty, NULL);
+    pthread_cond_init(&log->notFull, NULL);
+    if (pthread_create(&log->writer, NULL, intervalWriter, log) != 0) {
+        fprintf(stderr, "Failed to start interval writer\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// counters as the simulator has them now, without the absorbed resets
+static void readCounters(const struct Cache *c,
+                         const struct PhysicalMemory *pm,
+                         struct IntervalSnapshot *s,
+                         struct IntervalProc *procs,
+                         int iNumProcs)
+{
+    s->i64Accesses         = c->accesses;
+    s->i64Hits             = c->hits;
+    s->i64Misses           = c->misses;
+    s->i64CompulsoryMisses = c->compulsoryMisses;
+    s->i64ConflictMisses   = c->conflictMisses;
+    s->i64PageFaults       = pm->i64NumPageFaults;
+    s->i64Evictions        = pm->i64NumEvictions;
+
+    for (int k = 0; k < iNumProcs; k++) {
+        const struct CacheProcStats *ps = &c->procStats[(uint32_t)k < c->numProcs ? k : 0];
+        procs[k].i64Instructions = ps->instructions;
+        procs[k].i64Cycles       = ps->cycles;
+        procs[k].i64Accesses     = ps->accesses;
+        procs[k].i64Misses       = ps->misses;
+        procs[k].i64PageFaults   = k < pm->iNumVMs ? pm->vms[k].i64NumPageFaults : 0;
+    }
+}
+
+static void addProc(struct IntervalProc *d, const struct IntervalProc *a)
+{
+    d->i64Instructions += a->i64Instructions;
+    d->i64Cycles       += a->i64Cycles;
+    d->i64Accesses     += a->i64Accesses;
+    d->i64Misses       += a->i64Misses;
+    d->i64PageFaults   += a->i64PageFaults;
+}
+
+void intervalRecord(struct IntervalLog *log,
+                    const struct Cache *c,
+                    const struct PhysicalMemory *pm,
+                    uint64_t i64Cycles,
+                    uint64_t i64Instr)
+{
+    pthread_mutex_lock(&log->lock);
+    while (log->i32Count == INTERVAL_RING_SLOTS)
+        pthread_cond_wait(&log->notFull, &log->lock);
+
+    struct IntervalSnapshot *s = &log->snaps[log->i32Head];
+    struct IntervalProc *procs = &log->procs[(size_t)log->i32Head * log->iNumProcs];
+    readCounters(c, pm, s, procs, log->iNumProcs);
+    s->i64Instructions      = i64Instr;
+    s->i64Cycles            = i64Cycles;
+    s->i64Accesses         += log->base.i64Accesses;
+    s->i64Hits             += log->base.i64Hits;
+    s->i64Misses           += log->base.i64Misses;
+    s->i64CompulsoryMisses += log->base.i64CompulsoryMisses;
+    s->i64ConflictMisses   += log->base.i64ConflictMisses;
+    s->i64PageFaults       += log->base.i64PageFaults;
+    s->i64Evictions        += log->base.i64Evictions;
+    for (int k = 0; k < log->iNumProcs; k++) addProc(&procs[k], &log->baseProcs[k]);
+
+    log->i32Head = (log->i32Head + 1) % INTERVAL_RING_SLOTS;
+    log->i32Count++;
+    pthread_cond_signal(&log->notEmpty);
+    pthread_mutex_unlock(&log->lock);
+
+    log->i64Recorded = i64Instr;
+    while (log->i64Next <= i64Instr) log->i64Next += log->i64Every;
+}
+
+void intervalBeforeReset(struct IntervalLog *log,
+                         const struct Cache *c,
+                         const struct PhysicalMemory *pm,
+                         int iProc)
+{
+    struct IntervalSnapshot now;
+    memset(&now, 0, sizeof(now));
+    readCounters(c, pm, &now, log->curProcsScratch, log->iNumProcs);
+
+    if (iProc < 0) {
+        log->base.i64Accesses         += now.i64Accesses;
+        log->base.i64Hits             += now.i64Hits;
+        log->base.i64Misses           += now.i64Misses;
+        log->base.i64CompulsoryMisses += now.i64CompulsoryMisses;
+        log->base.i64ConflictMisses   += now.i64ConflictMisses;
+        log->base.i64PageFaults       += now.i64PageFaults;
+        log->base.i64Evictions        += now.i64Evictions;
+    } else if (iProc < log->iNumProcs) {
+        addProc(&log->baseProcs[iProc], &log->curProcsScratch[iProc]);
+    }
+}
+
+void closeIntervalLog(struct IntervalLog *log,
+                      const struct Cache *c,
+                      const struct PhysicalMemory *pm,
+                      uint64_t i64Cycles,
+                      uint64_t i64Instr)
+{
+    if (i64Instr > log->i64Recorded) intervalRecord(log, c, pm, i64Cycles, i64Instr);
+
+    pthread_mutex_lock(&log->lock);
+    log->bClosing = true;
+    pthread_cond_signal(&log->notEmpty);
+    pthread_mutex_unlock(&log->lock);
+    pthread_join(log->writer, NULL);
+
+    pthread_mutex_destroy(&log->lock);
+    pthread_cond_destroy(&log->notEmpty);
+    pthread_cond_destroy(&log->notFull);
+    fclose(log->fp);
+    free(log->snaps);
+    free(log->procs);
+    free(log->prevProcs);
+    free(log->curProcs);
+    free(log->baseProcs);
+    free(log->curProcsScratch);
+    memset(log, 0, sizeof(*log));
+}
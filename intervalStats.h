@@ -0,0 +1,110 @@
+#ifndef INTERVALSTATS_H
+#define INTERVALSTATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+struct Cache;
+struct PhysicalMemory;
+
+/*
+ * Time series of the run, one record every i64Every instructions.
+ *
+ * The simulator only copies the running counters into a ring of
+ * preallocated slots; a writer thread turns consecutive snapshots into
+ * per-interval values and writes them as CSV or JSON lines. The simulator
+ * blocks only when the writer falls INTERVAL_RING_SLOTS records behind.
+ */
+#define INTERVAL_RING_SLOTS 1024
+
+typedef enum {
+    INTERVAL_CSV,
+    INTERVAL_JSON           // one JSON object per line
+} IntervalFormat;
+
+// running totals at the end of an interval
+struct IntervalSnapshot {
+    uint64_t i64Instructions;
+    uint64_t i64Cycles;
+    uint64_t i64Accesses;
+    uint64_t i64Hits;
+    uint64_t i64Misses;
+    uint64_t i64CompulsoryMisses;
+    uint64_t i64ConflictMisses;
+    uint64_t i64PageFaults;
+    uint64_t i64Evictions;
+};
+
+struct IntervalProc {
+    uint64_t i64Instructions;
+    uint64_t i64Cycles;
+    uint64_t i64Accesses;
+    uint64_t i64Misses;
+    uint64_t i64PageFaults;
+};
+
+struct IntervalLog {
+    uint64_t i64Every;
+    uint64_t i64Next;               // instruction count of the next record
+    uint64_t i64Recorded;           // instruction count of the last record
+    IntervalFormat format;
+    FILE     *fp;
+    int      iNumProcs;
+
+    /* ring, filled by the simulator, drained by the writer */
+    struct IntervalSnapshot *snaps;     // [slot]
+    struct IntervalProc     *procs;     // [slot][proc]
+    uint32_t i32Head;               // next slot to fill
+    uint32_t i32Count;              // filled slots not written yet
+    bool     bClosing;
+    pthread_t       writer;
+    pthread_mutex_t lock;
+    pthread_cond_t  notEmpty;
+    pthread_cond_t  notFull;
+
+    /* counts zeroed by a warm-up, added back so the series stays continuous */
+    struct IntervalSnapshot base;
+    struct IntervalProc     *baseProcs;
+    struct IntervalProc     *curProcsScratch;
+
+    /* writer side */
+    struct IntervalSnapshot prev;
+    struct IntervalProc     *prevProcs;
+    struct IntervalSnapshot cur;
+    struct IntervalProc     *curProcs;
+    uint64_t i64Records;
+};
+
+/* opens sPath and starts the writer thread */
+void openIntervalLog(struct IntervalLog *log,
+                     const char *sPath,
+                     IntervalFormat format,
+                     uint64_t i64Every,
+                     int iNumProcs);
+
+/* snapshot of the counters; call when i64Instr reaches log->i64Next */
+void intervalRecord(struct IntervalLog *log,
+                    const struct Cache *c,
+                    const struct PhysicalMemory *pm,
+                    uint64_t i64Cycles,
+                    uint64_t i64Instr);
+
+/* call before a warm-up zeroes the shared counters (iProc -1) or those
+   of process iProc */
+void intervalBeforeReset(struct IntervalLog *log,
+                         const struct Cache *c,
+                         const struct PhysicalMemory *pm,
+                         int iProc);
+
+/* records the last partial interval, drains the ring and closes the file */
+void closeIntervalLog(struct IntervalLog *log,
+                      const struct Cache *c,
+                      const struct PhysicalMemory *pm,
+                      uint64_t i64Cycles,
+                      uint64_t i64Instr);
+
+IntervalFormat interval_format_from_string(const char *s);
+
+#endif
@@ -0,0 +1,176 @@
+#include "nextUse.h"
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define REF_CHUNK 4096      // records read per step of the backward pass
+
+void writeCacheRef(FILE *fpStream, uint64_t i64PhysAddr, uint32_t i32NumBytes,
+                   bool bIsWrite, bool bIsInstruction, uint64_t i64Pc)
+{
+    struct CacheRef ref;
+    memset(&ref, 0, sizeof(ref));
+    ref.i64PhysAddr    = i64PhysAddr;
+    ref.i64Pc          = i64Pc;
+    ref.i32NumBytes    = i32NumBytes;
+    ref.bIsWrite       = bIsWrite;
+    ref.bIsInstruction = bIsInstruction;
+    if (fwrite(&ref, sizeof(ref), 1, fpStream) != 1) {
+        fprintf(stderr, "Failed to record cache access stream\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void writeInvalidateRef(FILE *fpStream, uint64_t i64PhysAddr, uint32_t i32NumBytes)
+{
+    struct CacheRef ref;
+    memset(&ref, 0, sizeof(ref));
+    ref.i64PhysAddr   = i64PhysAddr;
+    ref.i32NumBytes   = i32NumBytes;
+    ref.bIsInvalidate = 1;
+    if (fwrite(&ref, sizeof(ref), 1, fpStream) != 1) {
+        fprintf(stderr, "Failed to record cache access stream\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+bool readCacheRef(FILE *fpStream, struct CacheRef *ref)
+{
+    return fread(ref, sizeof(*ref), 1, fpStream) == 1;
+}
+
+static uint64_t refBlocks(const struct CacheRef *ref, uint8_t i8OffsetBits)
+{
+    if (ref->bIsInvalidate) return 0;
+    uint64_t i64First = ref->i64PhysAddr >> i8OffsetBits;
+    uint64_t i64Last  = (ref->i64PhysAddr + ref->i32NumBytes - 1) >> i8OffsetBits;
+    return i64Last - i64First + 1;
+}
+
+static void allocIndex(struct NextUseIndex *idx)
+{
+    size_t bytes = (idx->i64Count ? idx->i64Count : 1) * sizeof(uint32_t);
+    idx->mapBytes = bytes;
+#ifndef _WIN32
+    idx->fpBacking = tmpfile();
+    if (idx->fpBacking && ftruncate(fileno(idx->fpBacking), (off_t)bytes) == 0) {
+        void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(idx->fpBacking), 0);
+        if (p != MAP_FAILED) {
+            idx->i32Dist = p;
+            return;
+        }
+    }
+    if (idx->fpBacking) fclose(idx->fpBacking);
+    idx->fpBacking = NULL;
+#endif
+    idx->i32Dist = malloc(bytes);
+    if (!idx->i32Dist) {
+        fprintf(stderr, "Failed to allocate next-use index\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* block -> last position seen, open addressing; blocks are stored +1 so 0 is empty */
+struct LastSeen {
+    uint64_t *i64Slots;         // [2 * cap] block + 1, position
+    uint64_t i64Cap;
+    uint64_t i64Used;
+};
+
+static uint64_t *lastSeenSlot(struct LastSeen *ls, uint64_t i64Key)
+{
+    uint64_t h = (i64Key * 0x9E3779B97F4A7C15ULL) & (ls->i64Cap - 1);
+    while (ls->i64Slots[2 * h] && ls->i64Slots[2 * h] != i64Key) h = (h + 1) & (ls->i64Cap - 1);
+    return &ls->i64Slots[2 * h];
+}
+
+static void lastSeenGrow(struct LastSeen *ls)
+{
+    struct LastSeen big = { NULL, ls->i64Cap ? ls->i64Cap * 2 : 1024, ls->i64Used };
+    big.i64Slots = calloc(2 * big.i64Cap, sizeof(uint64_t));
+    if (!big.i64Slots) {
+        fprintf(stderr, "Failed to allocate next-use index\n");
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t k = 0; k < ls->i64Cap; k++) {
+        if (!ls->i64Slots[2 * k]) continue;
+        uint64_t *slot = lastSeenSlot(&big, ls->i64Slots[2 * k]);
+        slot[0] = ls->i64Slots[2 * k];
+        slot[1] = ls->i64Slots[2 * k + 1];
+    }
+    free(ls->i64Slots);
+    *ls = big;
+}
+
+void buildNextUseIndex(struct NextUseIndex *idx, FILE *fpStream, uint8_t i8OffsetBits)
+{
+    memset(idx, 0, sizeof(*idx));
+
+    // forward: size the index
+    struct CacheRef ref;
+    uint64_t i64NumRefs = 0;
+    rewind(fpStream);
+    while (readCacheRef(fpStream, &ref)) {
+        idx->i64Count += refBlocks(&ref, i8OffsetBits);
+        i64NumRefs++;
+    }
+    allocIndex(idx);
+
+    // backward: distance from each block access to the following one
+    struct LastSeen ls = { NULL, 0, 0 };
+    lastSeenGrow(&ls);
+    struct CacheRef *chunk = malloc(REF_CHUNK * sizeof(struct CacheRef));
+    if (!chunk) {
+        fprintf(stderr, "Failed to allocate next-use index\n");
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t i64Pos = idx->i64Count;
+    uint64_t i64End = i64NumRefs;
+    while (i64End > 0) {
+        uint64_t i64Start = i64End > REF_CHUNK ? i64End - REF_CHUNK : 0;
+        fseek(fpStream, (long)(i64Start * sizeof(struct CacheRef)), SEEK_SET);
+        size_t n = fread(chunk, sizeof(struct CacheRef), (size_t)(i64End - i64Start), fpStream);
+
+        for (size_t r = n; r-- > 0; ) {
+            uint64_t i64First = chunk[r].i64PhysAddr >> i8OffsetBits;
+            for (uint64_t b = refBlocks(&chunk[r], i8OffsetBits); b-- > 0; ) {
+                i64Pos--;
+                if (2 * (ls.i64Used + 1) > ls.i64Cap) lastSeenGrow(&ls);
+
+                uint64_t *slot = lastSeenSlot(&ls, i64First + b + 1);
+                if (slot[0]) {
+                    uint64_t i64Dist = slot[1] - i64Pos;
+                    idx->i32Dist[i64Pos] = i64Dist < NEXT_USE_NEVER ? (uint32_t)i64Dist : NEXT_USE_NEVER;
+                } else {
+                    idx->i32Dist[i64Pos] = NEXT_USE_NEVER;
+                    slot[0] = i64First + b + 1;
+                    ls.i64Used++;
+                }
+                slot[1] = i64Pos;
+            }
+        }
+        i64End = i64Start;
+    }
+
+    free(chunk);
+    free(ls.i64Slots);
+    rewind(fpStream);
+}
+
+void freeNextUseIndex(struct NextUseIndex *idx)
+{
+#ifndef _WIN32
+    if (idx->fpBacking) {
+        munmap(idx->i32Dist, idx->mapBytes);
+        fclose(idx->fpBacking);
+        memset(idx, 0, sizeof(*idx));
+        return;
+    }
+#endif
+    free(idx->i32Dist);
+    memset(idx, 0, sizeof(*idx));
+}
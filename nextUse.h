@@ -0,0 +1,59 @@
+#ifndef NEXTUSE_H
+#define NEXTUSE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Recorded cache access stream and the next-use index built from it.
+ *
+ * The stream holds one record per cacheAccess and cacheInvalidateRange
+ * call so a later pass can replay the exact same accesses. The index has
+ * one entry per block access: the distance, in block accesses, to the
+ * next access of the same block (NEXT_USE_NEVER if there is none or it
+ * is 4G+ away).
+ * On POSIX systems the index lives in a mmap'd temporary file so long
+ * traces do not need to fit in memory.
+ */
+#define NEXT_USE_NEVER UINT32_MAX
+
+struct CacheRef {
+    uint64_t i64PhysAddr;
+    uint64_t i64Pc;
+    uint32_t i32NumBytes;
+    uint8_t  bIsWrite;
+    uint8_t  bIsInstruction;
+    uint8_t  bIsInvalidate;     // page invalidation, no block accesses
+};
+
+struct NextUseIndex {
+    uint32_t *i32Dist;          // [block access] distance to the next use
+    uint64_t i64Count;          // block accesses in the stream
+    FILE     *fpBacking;        // mmap backing file, NULL when on the heap
+    size_t   mapBytes;
+};
+
+/* append one access to a stream opened with tmpfile() */
+void writeCacheRef(FILE *fpStream, uint64_t i64PhysAddr, uint32_t i32NumBytes,
+                   bool bIsWrite, bool bIsInstruction, uint64_t i64Pc);
+
+/* append the invalidation of i32NumBytes from i64PhysAddr */
+void writeInvalidateRef(FILE *fpStream, uint64_t i64PhysAddr, uint32_t i32NumBytes);
+
+/* next record, false at the end of the stream */
+bool readCacheRef(FILE *fpStream, struct CacheRef *ref);
+
+/* backward pass over the stream; i8OffsetBits splits accesses into blocks */
+void buildNextUseIndex(struct NextUseIndex *idx, FILE *fpStream, uint8_t i8OffsetBits);
+
+void freeNextUseIndex(struct NextUseIndex *idx);
+
+/* absolute position of the next use after block access i64Pos */
+static inline uint64_t nextUseAfter(const struct NextUseIndex *idx, uint64_t i64Pos)
+{
+    if (i64Pos >= idx->i64Count || idx->i32Dist[i64Pos] == NEXT_USE_NEVER) return UINT64_MAX;
+    return i64Pos + idx->i32Dist[i64Pos];
+}
+
+#endif
@@ -0,0 +1,182 @@
+#include "resultWriter.h"
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+ResultFormat result_format_from_string(const char *sFormatCode)
+{
+    if (strcmp(sFormatCode, "csv") == 0) return RESULT_CSV;
+    return RESULT_JSON; // default
+}
+
+static void append(char **sBuf, size_t *pLen, size_t *pCap, const char *s, size_t n)
+{
+    if (*pLen + n + 1 > *pCap) {
+        size_t i64Cap = *pCap ? *pCap : 1024;
+        while (*pLen + n + 1 > i64Cap) i64Cap *= 2;
+        char *sGrown = realloc(*sBuf, i64Cap);
+        if (!sGrown) {
+            fprintf(stderr, "Failed to allocate results record\n");
+            exit(EXIT_FAILURE);
+        }
+        *sBuf = sGrown;
+        *pCap = i64Cap;
+    }
+    memcpy(*sBuf + *pLen, s, n);
+    *pLen += n;
+    (*sBuf)[*pLen] = '\0';
+}
+
+static void appendKey(struct ResultWriter *rw, const char *sKey)
+{
+    if (rw->format == RESULT_JSON) {
+        if (rw->iFields) append(&rw->sValues, &rw->i64ValuesLen, &rw->i64ValuesCap, ",", 1);
+        append(&rw->sValues, &rw->i64ValuesLen, &rw->i64ValuesCap, "\"", 1);
+        append(&rw->sValues, &rw->i64ValuesLen, &rw->i64ValuesCap, sKey, strlen(sKey));
+        append(&rw->sValues, &rw->i64ValuesLen, &rw->i64ValuesCap, "\":", 2);
+    } else {
+        if (rw->iFields) {
+            append(&rw->sKeys, &rw->i64KeysLen, &rw->i64KeysCap, ",", 1);
+            append(&rw->sValues, &rw->i64ValuesLen, &rw->i64ValuesCap, ",", 1);
+        }
+        append(&rw->sKeys, &rw->i64KeysLen, &rw->i64KeysCap, sKey, strlen(sKey));
+    }
+    rw->iFields++;
+}
+
+static void appendValue(struct ResultWriter *rw, const char *s)
+{
+    append(&rw->sValues, &rw->i64ValuesLen, &rw->i64ValuesCap, s, strlen(s));
+}
+
+void openResultWriter(struct ResultWriter *rw, const char *sPath, ResultFormat format)
+{
+    memset(rw, 0, sizeof(*rw));
+    rw->sPath = sPath;
+    rw->format = format;
+    rw->fp = fopen(sPath, "a+");
+    if (!rw->fp) {
+        fprintf(stderr, "Error: failed to open results file %s\n", sPath);
+        exit(EXIT_FAILURE);
+    }
+
+    // appending to a CSV file: later records must match its header
+    fseek(rw->fp, 0, SEEK_END);
+    if (format == RESULT_CSV && ftell(rw->fp) > 0) {
+        size_t i64Len = 0, i64Cap = 0;
+        char sChunk[4096];
+        rewind(rw->fp);
+        while (fgets(sChunk, sizeof(sChunk), rw->fp)) {
+            size_t n = strlen(sChunk);
+            bool bEol = n && sChunk[n - 1] == '\n';
+            append(&rw->sHeader, &i64Len, &i64Cap, sChunk, bEol ? n - 1 : n);
+            if (bEol) break;
+        }
+        if (!rw->sHeader) rw->sHeader = calloc(1, 1);
+        fseek(rw->fp, 0, SEEK_END);
+    }
+}
+
+void resultBegin(struct ResultWriter *rw)
+{
+    rw->i64KeysLen = rw->i64ValuesLen = 0;
+    rw->iFields = 0;
+    rw->i64KeptKeys = rw->i64KeptValues = 0;
+    rw->iKeptFields = 0;
+}
+
+void resultKeep(struct ResultWriter *rw)
+{
+    rw->i64KeptKeys   = rw->i64KeysLen;
+    rw->i64KeptValues = rw->i64ValuesLen;
+    rw->iKeptFields   = rw->iFields;
+}
+
+void resultString(struct ResultWriter *rw, const char *sKey, const char *sValue)
+{
+    appendKey(rw, sKey);
+    if (rw->format == RESULT_JSON) {
+        appendValue(rw, "\"");
+        for (const char *p = sValue; *p; p++) {
+            char sEsc[8];
+            if (*p == '"' || *p == '\\')        snprintf(sEsc, sizeof(sEsc), "\\%c", *p);
+            else if ((unsigned char)*p < 0x20)  snprintf(sEsc, sizeof(sEsc), "\\u%04x", (unsigned char)*p);
+            else                                { sEsc[0] = *p; sEsc[1] = '\0'; }
+            appendValue(rw, sEsc);
+        }
+        appendValue(rw, "\"");
+    } else if (strpbrk(sValue, ",\"\r\n")) {
+        appendValue(rw, "\"");
+        for (const char *p = sValue; *p; p++)
+            appendValue(rw, *p == '"' ? "\"\"" : (char[2]){ *p, '\0' });
+        appendValue(rw, "\"");
+    } else {
+        appendValue(rw, sValue);
+    }
+}
+
+void resultUint(struct ResultWriter *rw, const char *sKey, uint64_t i64Value)
+{
+    char sNum[32];
+    snprintf(sNum, sizeof(sNum), "%" PRIu64, i64Value);
+    appendKey(rw, sKey);
+    appendValue(rw, sNum);
+}
+
+void resultInt(struct ResultWriter *rw, const char *sKey, int64_t i64Value)
+{
+    char sNum[32];
+    snprintf(sNum, sizeof(sNum), "%" PRId64, i64Value);
+    appendKey(rw, sKey);
+    appendValue(rw, sNum);
+}
+
+void resultDouble(struct ResultWriter *rw, const char *sKey, double dValue)
+{
+    char sNum[40];
+    snprintf(sNum, sizeof(sNum), "%.10g", dValue);
+    appendKey(rw, sKey);
+    appendValue(rw, sNum);
+}
+
+const char *resultTraceKey(struct ResultWriter *rw, int i, const char *sName)
+{
+    snprintf(rw->sTraceKey, sizeof(rw->sTraceKey), "trace%d_%s", i, sName);
+    return rw->sTraceKey;
+}
+
+void resultEnd(struct ResultWriter *rw)
+{
+    if (rw->format == RESULT_JSON) {
+        fprintf(rw->fp, "{%s}\n", rw->iFields ? rw->sValues : "");
+    } else if (rw->iFields) {
+        if (!rw->sHeader) {
+            fprintf(rw->fp, "%s\n", rw->sKeys);
+            rw->sHeader = strdup(rw->sKeys);
+            fprintf(rw->fp, "%s\n", rw->sValues);
+        } else if (strcmp(rw->sHeader, rw->sKeys) != 0) {
+            // a row under the wrong header would be read as the wrong columns
+            if (!rw->bMismatch)
+                fprintf(stderr, "Error: results columns differ from the header of %s, not appended\n", rw->sPath);
+            rw->bMismatch = true;
+        } else {
+            fprintf(rw->fp, "%s\n", rw->sValues);
+        }
+    }
+
+    // back to the kept prefix
+    rw->i64KeysLen   = rw->i64KeptKeys;
+    rw->i64ValuesLen = rw->i64KeptValues;
+    rw->iFields      = rw->iKeptFields;
+    if (rw->sKeys)   rw->sKeys[rw->i64KeysLen] = '\0';
+    if (rw->sValues) rw->sValues[rw->i64ValuesLen] = '\0';
+}
+
+void closeResultWriter(struct ResultWriter *rw)
+{
+    if (fclose(rw->fp) != 0)
+        fprintf(stderr, "Error: failed to write results file %s\n", rw->sPath);
+    free(rw->sHeader);
+    free(rw->sKeys);
+    free(rw->sValues);
+}
@@ -0,0 +1,70 @@
+#ifndef RESULTWRITER_H
+#define RESULTWRITER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Results of a run as flat key/value records for sweep scripts.
+ *
+ * A record is built field by field in memory and written as one line:
+ * a JSON object, or a CSV row under a header of the keys. Records are
+ * appended, so one file can collect many runs; the CSV header is only
+ * written to an empty file, and a later record whose keys differ from it
+ * is not written.
+ * Fields before resultKeep are repeated at the start of each following
+ * record, so modes that report several configurations of one run only
+ * add what differs.
+ */
+typedef enum {
+    RESULT_JSON,            // one JSON object per line
+    RESULT_CSV
+} ResultFormat;
+
+struct ResultWriter {
+    FILE         *fp;
+    const char   *sPath;
+    ResultFormat format;
+    char         *sHeader;          // CSV header already in the file, NULL if empty
+    bool         bMismatch;        // a record was refused, reported once
+
+    /* current record */
+    char         *sKeys;            // CSV header line
+    char         *sValues;          // CSV row, or the JSON members
+    size_t       i64KeysLen, i64KeysCap;
+    size_t       i64ValuesLen, i64ValuesCap;
+    int          iFields;
+
+    /* prefix repeated in every record */
+    size_t       i64KeptKeys, i64KeptValues;
+    int          iKeptFields;
+
+    char         sTraceKey[64];
+};
+
+/* opens sPath for appending; exits if it cannot be opened */
+void openResultWriter(struct ResultWriter *rw, const char *sPath, ResultFormat format);
+
+/* starts an empty record, dropping any kept fields */
+void resultBegin(struct ResultWriter *rw);
+
+/* fields added so far start every following record */
+void resultKeep(struct ResultWriter *rw);
+
+void resultString(struct ResultWriter *rw, const char *sKey, const char *sValue);
+void resultUint(struct ResultWriter *rw, const char *sKey, uint64_t i64Value);
+void resultInt(struct ResultWriter *rw, const char *sKey, int64_t i64Value);
+void resultDouble(struct ResultWriter *rw, const char *sKey, double dValue);
+
+/* "trace<i>_<name>", valid until the next call */
+const char *resultTraceKey(struct ResultWriter *rw, int i, const char *sName);
+
+/* writes the record; the next one starts with the kept fields */
+void resultEnd(struct ResultWriter *rw);
+
+void closeResultWriter(struct ResultWriter *rw);
+
+ResultFormat result_format_from_string(const char *s);
+
+#endif
@@ -0,0 +1,277 @@
+#include "scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+SchedPolicy sched_from_string(const char *sPolicyCode)
+{
+    if (strcmp(sPolicyCode, "lottery") == 0) return SCHED_LOTTERY;
+    if (strcmp(sPolicyCode, "srt") == 0)     return SCHED_SRT;
+    if (strcmp(sPolicyCode, "cfs") == 0)     return SCHED_CFS;
+    return SCHED_RR; // default
+}
+
+const char *sched_name(SchedPolicy policy)
+{
+    switch (policy) {
+        case SCHED_LOTTERY: return "Lottery";
+        case SCHED_SRT:     return "Shortest Remaining";
+        case SCHED_CFS:     return "CFS (Virtual Runtime)";
+        default:            return "Round Robin";
+    }
+}
+
+void initScheduler(struct Scheduler *s,
+                   SchedPolicy policy,
+                   int iNumProcs,
+                   int32_t si32DefaultQuantum)
+{
+    memset(s, 0, sizeof(*s));
+    s->policy       = policy;
+    s->iNumProcs    = iNumProcs;
+    s->iActive      = iNumProcs;
+    s->i64RandState = 0x2545F4914F6CDD1DULL;   // deterministic draws
+
+    s->procs = calloc(iNumProcs > 0 ? iNumProcs : 1, sizeof(struct SchedProc));
+    if (!s->procs) {
+        fprintf(stderr, "Failed to allocate scheduler\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < iNumProcs; i++) {
+        s->procs[i].si32Quantum = si32DefaultQuantum;
+        s->procs[i].i32Weight   = 1;
+    }
+
+    int iSlots = iNumProcs > 0 ? iNumProcs : 1;
+    s->iArrNextLink  = malloc(iSlots * sizeof(int));
+    s->iArrPrevLink  = malloc(iSlots * sizeof(int));
+    s->i64ArrTickets = calloc(iSlots + 1, sizeof(uint64_t));
+    s->iArrHeap      = malloc(iSlots * sizeof(int));
+    s->iArrHeapPos   = malloc(iSlots * sizeof(int));
+    if (!s->iArrNextLink || !s->iArrPrevLink || !s->i64ArrTickets ||
+        !s->iArrHeap || !s->iArrHeapPos) {
+        fprintf(stderr, "Failed to allocate scheduler\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void freeScheduler(struct Scheduler *s)
+{
+    free(s->procs);
+    free(s->iArrNextLink);
+    free(s->iArrPrevLink);
+    free(s->i64ArrTickets);
+    free(s->iArrHeap);
+    free(s->iArrHeapPos);
+    memset(s, 0, sizeof(*s));
+}
+
+/* ---- lottery: Fenwick tree over the tickets of active traces ---- */
+
+static void ticketAdd(struct Scheduler *s, int i, int64_t si64Delta)
+{
+    for (int k = i + 1; k <= s->iNumProcs; k += k & -k)
+        s->i64ArrTickets[k] += (uint64_t)si64Delta;
+}
+
+static uint64_t ticketTotal(const struct Scheduler *s)
+{
+    uint64_t i64Sum = 0;
+    for (int k = s->iNumProcs; k > 0; k -= k & -k) i64Sum += s->i64ArrTickets[k];
+    return i64Sum;
+}
+
+// first trace whose running ticket total exceeds i64Draw
+static int ticketFind(struct Scheduler *s, uint64_t i64Draw)
+{
+    int iPos = 0;
+    int iStep = 1;
+    while (iStep * 2 <= s->iNumProcs) iStep *= 2;
+    for (; iStep > 0; iStep /= 2) {
+        int k = iPos + iStep;
+        if (k <= s->iNumProcs && s->i64ArrTickets[k] <= i64Draw) {
+            iPos = k;
+            i64Draw -= s->i64ArrTickets[k];
+        }
+    }
+    return iPos;
+}
+
+/* ---- SRT / CFS: min-heap on (key, index) ---- */
+
+static uint64_t heapKey(const struct Scheduler *s, int i)
+{
+    return s->policy == SCHED_SRT ? s->procs[i].i64Remaining : s->procs[i].i64VRuntime;
+}
+
+static bool heapLess(const struct Scheduler *s, int a, int b)
+{
+    uint64_t ka = heapKey(s, a), kb = heapKey(s, b);
+    return ka < kb || (ka == kb && a < b);
+}
+
+static void heapSwap(struct Scheduler *s, int x, int y)
+{
+    int a = s->iArrHeap[x], b = s->iArrHeap[y];
+    s->iArrHeap[x] = b; s->iArrHeapPos[b] = x;
+    s->iArrHeap[y] = a; s->iArrHeapPos[a] = y;
+}
+
+static void heapSiftUp(struct Scheduler *s, int x)
+{
+    while (x > 0) {
+        int p = (x - 1) / 2;
+        if (!heapLess(s, s->iArrHeap[x], s->iArrHeap[p])) break;
+        heapSwap(s, x, p);
+        x = p;
+    }
+}
+
+static void heapSiftDown(struct Scheduler *s, int x)
+{
+    for (;;) {
+        int l = 2 * x + 1, r = l + 1, m = x;
+        if (l < s->iHeapSize && heapLess(s, s->iArrHeap[l], s->iArrHeap[m])) m = l;
+        if (r < s->iHeapSize && heapLess(s, s->iArrHeap[r], s->iArrHeap[m])) m = r;
+        if (m == x) break;
+        heapSwap(s, x, m);
+        x = m;
+    }
+}
+
+// key of trace i changed
+static void heapFix(struct Scheduler *s, int i)
+{
+    if (!s->bBuilt || s->iArrHeapPos[i] < 0) return;
+    heapSiftUp(s, s->iArrHeapPos[i]);
+    heapSiftDown(s, s->iArrHeapPos[i]);
+}
+
+static void buildIndex(struct Scheduler *s)
+{
+    int n = s->iNumProcs;
+    for (int i = 0; i < n; i++) {
+        s->iArrNextLink[i] = (i + 1) % n;
+        s->iArrPrevLink[i] = (i + n - 1) % n;
+        s->iArrHeap[i]     = i;
+        s->iArrHeapPos[i]  = i;
+        ticketAdd(s, i, s->procs[i].i32Weight);
+    }
+    s->iHeapSize = n;
+    s->bBuilt = true;
+    for (int x = n / 2 - 1; x >= 0; x--) heapSiftDown(s, x);
+}
+
+static uint64_t schedRand(struct Scheduler *s)
+{
+    uint64_t x = s->i64RandState;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    s->i64RandState = x;
+    return x;
+}
+
+int schedPickNext(struct Scheduler *s, uint64_t i64Now)
+{
+    if (s->iActive <= 0) return -1;
+
+    if (!s->bBuilt) buildIndex(s);
+
+    int iPick = -1;
+
+    switch (s->policy) {
+        case SCHED_RR: {
+            iPick = s->iNext;
+            s->iNext = s->iArrNextLink[iPick];
+            break;
+        }
+        case SCHED_LOTTERY: {
+            uint64_t i64Draw = schedRand(s) % ticketTotal(s);
+            iPick = ticketFind(s, i64Draw);
+            break;
+        }
+        case SCHED_SRT:
+        case SCHED_CFS: {
+            iPick = s->iArrHeap[0];
+            break;
+        }
+    }
+
+    struct SchedProc *p = &s->procs[iPick];
+    if (!p->bStarted) {
+        p->bStarted    = true;
+        p->i64FirstRun = i64Now;
+    }
+    return iPick;
+}
+
+void schedAccount(struct Scheduler *s, int i, uint64_t i64Executed)
+{
+    struct SchedProc *p = &s->procs[i];
+    p->i64Executed += i64Executed;
+    p->i64Slices++;
+    // heavier traces age slower
+    p->i64VRuntime += i64Executed * SCHED_NICE_0_WEIGHT / (p->i32Weight ? p->i32Weight : 1);
+    if (s->policy == SCHED_CFS) heapFix(s, i);
+}
+
+void schedSetRemaining(struct Scheduler *s, int i, uint64_t i64Remaining)
+{
+    s->procs[i].i64Remaining = i64Remaining;
+    if (s->policy == SCHED_SRT) heapFix(s, i);
+}
+
+void schedFinish(struct Scheduler *s, int i, uint64_t i64Now)
+{
+    struct SchedProc *p = &s->procs[i];
+    if (p->bFinished) return;
+    p->bFinished = true;
+    p->i64Finish = i64Now;
+    s->iActive--;
+    if (!s->bBuilt) return;
+
+    // drop the trace from every pick structure
+    int n = s->iArrNextLink[i], b = s->iArrPrevLink[i];
+    s->iArrNextLink[b] = n;
+    s->iArrPrevLink[n] = b;
+    if (s->iNext == i) s->iNext = n;
+
+    ticketAdd(s, i, -(int64_t)p->i32Weight);
+
+    int x = s->iArrHeapPos[i];
+    s->iArrHeapPos[i] = -1;
+    if (--s->iHeapSize > x) {
+        s->iArrHeap[x] = s->iArrHeap[s->iHeapSize];
+        s->iArrHeapPos[s->iArrHeap[x]] = x;
+        int m = s->iArrHeap[x];
+        heapSiftUp(s, x);
+        heapSiftDown(s, s->iArrHeapPos[m]);
+    }
+}
+
+void schedRestore(struct Scheduler *s,
+                  const struct SchedProc *procs,
+                  int iNext,
+                  uint64_t i64RandState)
+{
+    // quanta and weights stay as configured for this run
+    for (int i = 0; i < s->iNumProcs; i++) {
+        struct SchedProc *p = &s->procs[i];
+        int32_t si32Quantum = p->si32Quantum;
+        uint32_t i32Weight  = p->i32Weight;
+        *p = procs[i];
+        p->si32Quantum = si32Quantum;
+        p->i32Weight   = i32Weight;
+        p->bFinished   = false;
+    }
+    s->iActive = s->iNumProcs;
+    s->bBuilt  = false;
+    if (s->iNumProcs > 0) buildIndex(s);
+
+    for (int i = 0; i < s->iNumProcs; i++) {
+        if (procs[i].bFinished) schedFinish(s, i, procs[i].i64Finish);
+    }
+    s->iNext        = iNext;
+    s->i64RandState = i64RandState;
+}
@@ -0,0 +1,84 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    SCHED_RR,           // round robin in -f order
+    SCHED_LOTTERY,      // random pick weighted by tickets
+    SCHED_SRT,          // shortest remaining trace first
+    SCHED_CFS           // smallest weighted virtual runtime first
+} SchedPolicy;
+
+#define SCHED_NICE_0_WEIGHT 1024    // CFS weight of a trace with weight 1
+
+struct SchedProc {
+    int32_t  si32Quantum;       // instructions per slice, -1 = run to the end
+    uint32_t i32Weight;         // lottery tickets / CFS weight
+    bool     bFinished;
+
+    uint64_t i64Remaining;      // work left, set by the simulator (SRT)
+    uint64_t i64VRuntime;       // CFS virtual runtime
+
+    uint64_t i64Executed;       // instructions run so far
+    uint64_t i64Slices;
+    bool     bStarted;
+    uint64_t i64FirstRun;       // cycle of the first dispatch
+    uint64_t i64Finish;         // cycle the trace ran out
+};
+
+/*
+ * Picks cost O(1) for round robin and O(log n) for the others, so runs
+ * with thousands of traces never rescan finished ones:
+ *   RR       circular list of the active traces, in -f order
+ *   lottery  Fenwick tree over the active tickets
+ *   SRT/CFS  min-heap on (key, index), ties go to the lower index
+ */
+struct Scheduler {
+    SchedPolicy policy;
+    int      iNumProcs;
+    int      iActive;
+    int      iNext;             // round robin cursor
+    uint64_t i64RandState;      // lottery draws
+    struct SchedProc *procs;
+
+    int      *iArrNextLink;     // RR active list
+    int      *iArrPrevLink;
+    uint64_t *i64ArrTickets;    // lottery Fenwick tree, 1-based
+    int      *iArrHeap;         // SRT/CFS heap of proc indices
+    int      *iArrHeapPos;      // heap slot of each proc, -1 once out
+    int      iHeapSize;
+    bool     bBuilt;            // built on the first pick, after weights are set
+};
+
+void initScheduler(struct Scheduler *s,
+                   SchedPolicy policy,
+                   int iNumProcs,
+                   int32_t si32DefaultQuantum);
+
+void freeScheduler(struct Scheduler *s);
+
+/* index of the next trace to run, -1 once every trace is finished */
+int schedPickNext(struct Scheduler *s, uint64_t i64Now);
+
+/* book a finished slice of i64Executed instructions */
+void schedAccount(struct Scheduler *s, int i, uint64_t i64Executed);
+
+/* update the SRT work estimate of trace i */
+void schedSetRemaining(struct Scheduler *s, int i, uint64_t i64Remaining);
+
+void schedFinish(struct Scheduler *s, int i, uint64_t i64Now);
+
+/* load per trace state saved by a checkpoint and rebuild the pick
+   structures; the configured quanta and weights are kept */
+void schedRestore(struct Scheduler *s,
+                  const struct SchedProc *procs,
+                  int iNext,
+                  uint64_t i64RandState);
+
+SchedPolicy sched_from_string(const char *s);
+
+const char *sched_name(SchedPolicy policy);
+
+#endif
@@ -0,0 +1,130 @@
+#include "setIndex.h"
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define SKEW_MULTIPLIER 0x9E3779B97F4A7C15ULL   /* odd; each way adds 2 */
+
+SetIndexing set_index_from_string(const char *sIndexCode)
+{
+    if (strcmp(sIndexCode, "xor") == 0)   return SET_INDEX_XOR;
+    if (strcmp(sIndexCode, "prime") == 0) return SET_INDEX_PRIME;
+    if (strcmp(sIndexCode, "skew") == 0)  return SET_INDEX_SKEW;
+    return SET_INDEX_MOD; // default
+}
+
+const char *set_index_name(SetIndexing indexing)
+{
+    switch (indexing) {
+        case SET_INDEX_XOR:   return "XOR Folded";
+        case SET_INDEX_PRIME: return "Prime Modulo";
+        case SET_INDEX_SKEW:  return "Skewed Associative";
+        default:              return "Modulo (Low Bits)";
+    }
+}
+
+static bool isPrime(uint32_t n)
+{
+    if (n < 2) return false;
+    for (uint32_t d = 2; (uint64_t)d * d <= n; d++) {
+        if (n % d == 0) return false;
+    }
+    return true;
+}
+
+uint32_t setIndexSets(SetIndexing indexing, uint32_t i32NumSets)
+{
+    if (indexing != SET_INDEX_PRIME || i32NumSets < 3) return i32NumSets;
+    uint32_t p = i32NumSets;
+    while (!isPrime(p)) p--;
+    return p;
+}
+
+/* XOR of every i32Bits wide chunk of v */
+static uint64_t xorFold(uint64_t v, uint32_t i32Bits)
+{
+    if (i32Bits == 0) return 0;
+    uint64_t mask = ((uint64_t)1 << i32Bits) - 1;
+    uint64_t r = 0;
+    while (v) {
+        r ^= v & mask;
+        v >>= i32Bits;
+    }
+    return r;
+}
+
+uint32_t setIndexOf(SetIndexing indexing,
+                    uint64_t i64Block,
+                    uint32_t i32IndexBits,
+                    uint32_t i32IndexSets,
+                    uint32_t i32Way)
+{
+    uint64_t mask = ((uint64_t)1 << i32IndexBits) - 1;
+    uint64_t hi   = i64Block >> i32IndexBits;
+
+    switch (indexing) {
+        case SET_INDEX_XOR:
+            return (uint32_t)((i64Block ^ xorFold(hi, i32IndexBits)) & mask);
+        case SET_INDEX_PRIME:
+            return (uint32_t)(i64Block % i32IndexSets);
+        case SET_INDEX_SKEW:
+            return (uint32_t)((i64Block ^ xorFold(hi * (SKEW_MULTIPLIER + 2 * (uint64_t)i32Way), i32IndexBits)) & mask);
+        default:
+            return (uint32_t)(i64Block & mask);
+    }
+}
+
+static int compareDesc(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x < y) - (x > y);
+}
+
+void printSetMissDistribution(const uint64_t *i64ArrSetMisses,
+                              uint32_t i32NumSets,
+                              uint32_t i32IndexSets)
+{
+    if (i32NumSets == 0) return;
+
+    uint64_t i64Total = 0, i64Min = UINT64_MAX, i64Max = 0;
+    uint32_t i32Idle = 0;
+    for (uint32_t s = 0; s < i32IndexSets; s++) {
+        uint64_t m = i64ArrSetMisses[s];
+        i64Total += m;
+        if (m < i64Min) i64Min = m;
+        if (m > i64Max) i64Max = m;
+        if (m == 0) i32Idle++;
+    }
+    double dMean = (double)i64Total / i32IndexSets;
+    double dVar = 0.0;
+    for (uint32_t s = 0; s < i32IndexSets; s++) {
+        double d = (double)i64ArrSetMisses[s] - dMean;
+        dVar += d * d;
+    }
+    double dStdDev = sqrt(dVar / i32IndexSets);
+
+    /* share of all misses landing in the busiest tenth of the sets */
+    uint64_t *i64Sorted = malloc(i32IndexSets * sizeof(uint64_t));
+    if (!i64Sorted) {
+        fprintf(stderr, "Failed to allocate set miss distribution\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(i64Sorted, i64ArrSetMisses, i32IndexSets * sizeof(uint64_t));
+    qsort(i64Sorted, i32IndexSets, sizeof(uint64_t), compareDesc);
+    uint32_t i32Hot = (i32IndexSets + 9) / 10;
+    uint64_t i64HotMisses = 0;
+    for (uint32_t s = 0; s < i32Hot; s++) i64HotMisses += i64Sorted[s];
+    free(i64Sorted);
+
+    printf("\n***** SET MISS DISTRIBUTION *****\n\n");
+    if (i32IndexSets < i32NumSets)
+        printf("%-32s%u of %u\n", "Sets Reachable:", i32IndexSets, i32NumSets);
+    printf("%-32s%llu / %.1f / %llu\n", "Misses per Set (min/avg/max):",
+           (unsigned long long)i64Min, dMean, (unsigned long long)i64Max);
+    printf("%-32s%.1f ( CoV %.3f )\n", "Std Deviation:", dStdDev, dMean > 0 ? dStdDev / dMean : 0.0);
+    printf("%-32s%.2f%% of misses\n", "Busiest 10% of Sets:",
+           i64Total ? 100.0 * (double)i64HotMisses / (double)i64Total : 0.0);
+    printf("%-32s%u\n", "Sets Without Misses:", i32Idle);
+}
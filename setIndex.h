@@ -0,0 +1,37 @@
+#ifndef SETINDEX_H
+#define SETINDEX_H
+
+#include <stdint.h>
+
+/*
+ * Cache set index functions. Anything but SET_INDEX_MOD maps blocks
+ * that share their low bits to different sets, so the cache has to keep
+ * the whole block address as the tag.
+ */
+typedef enum {
+    SET_INDEX_MOD,          // low index bits of the block address
+    SET_INDEX_XOR,          // low bits XOR-folded with every higher chunk
+    SET_INDEX_PRIME,        // block address mod the largest prime <= sets
+    SET_INDEX_SKEW          // skewed-associative: a different hash per way
+} SetIndexing;
+
+SetIndexing set_index_from_string(const char *sIndexCode);
+
+const char *set_index_name(SetIndexing indexing);
+
+/* sets the function can reach (fewer than i32NumSets for prime) */
+uint32_t setIndexSets(SetIndexing indexing, uint32_t i32NumSets);
+
+/* set holding block i64Block in way i32Way (the way only matters for skew) */
+uint32_t setIndexOf(SetIndexing indexing,
+                    uint64_t i64Block,
+                    uint32_t i32IndexBits,
+                    uint32_t i32IndexSets,
+                    uint32_t i32Way);
+
+/* spread of misses over the sets: min / mean / max, deviation, hot sets */
+void printSetMissDistribution(const uint64_t *i64ArrSetMisses,
+                              uint32_t i32NumSets,
+                              uint32_t i32IndexSets);
+
+#endif
@@ -0,0 +1,689 @@
+#include "sim.h"
+#include "virtualMem.h"
+#include "cache.h"
+#include "dram.h"
+#include "scheduler.h"
+#include "tracePool.h"
+#include "checkpoint.h"
+#include "intervalStats.h"
+#include "simProfile.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#define SIM_BATCH_STEPS 256     // trace steps read, translated and run per batch
+
+// translation stalls (TLB misses, page fault service) hold up the access
+static uint64_t translateAndStall(struct VM *vm,
+                                  uint64_t virtualAddress,
+                                  bool isWrite,
+                                  uint64_t *pTotalCycles)
+{
+    struct PhysicalMemory *pm = vm->pm;
+    uint64_t i64StartStall = pm->i64TranslateCycles + pm->i64FaultCycles;
+    pm->i64Now = *pTotalCycles;
+    uint64_t physAddr = translateAddress(vm, virtualAddress, isWrite);
+    *pTotalCycles += pm->i64TranslateCycles + pm->i64FaultCycles - i64StartStall;
+    return physAddr;
+}
+
+static bool readTraceStep(FILE *fp, struct TraceStep *st)
+{
+    char lineEIP[256], lineMem[256], blank[8];
+    PROF_BEGIN(PROF_PARSE);
+    bool bRead = fgets(lineEIP, sizeof(lineEIP), fp)      // EOF
+              && fgets(lineMem, sizeof(lineMem), fp);
+    if (bRead) {
+        fgets(blank, sizeof(blank), fp); // skip separator (may hit EOF)
+
+        memset(st, 0, sizeof(*st));
+        // Ahora también leemos la longitud de la instrucción
+        sscanf(lineEIP, "EIP (%d): %" SCNx64, &st->instrLen, &st->eip);
+        sscanf(lineMem, "dstM: %" SCNx64 " %8s   srcM: %" SCNx64 " %8s",
+               &st->dst, st->dstData, &st->src, st->srcData);
+    }
+    PROF_END();
+    return bRead;
+}
+
+// true if nothing is left of the trace, so a slice that used it up ends it
+static bool traceAtEnd(FILE *fp)
+{
+    int c = getc(fp);
+    if (c == EOF) return true;
+    ungetc(c, fp);
+    return false;
+}
+
+static bool processTraceStep(struct VM *vm,
+                             FILE *fp,
+                             struct Cache *cache,
+                             struct TraceStep *pStep,
+                             uint64_t *pTotalCycles,
+                             uint64_t *pTotalInstr)
+{
+    if (!readTraceStep(fp, pStep)) return false;
+
+    cache->pid = vm->i16ProcessId;
+    cache->pc  = pStep->eip;        // signature for SHiP, and recorded
+    struct CacheProcStats *ps = &cache->procStats[cache->pid < cache->numProcs ? cache->pid : 0];
+    uint64_t i64StartCycles = *pTotalCycles;
+    uint64_t i64StartInstr  = *pTotalInstr;
+
+    int instrLen = pStep->instrLen;
+    uint64_t eip = pStep->eip, src = pStep->src, dst = pStep->dst;
+    const char *srcData = pStep->srcData, *dstData = pStep->dstData;
+
+    // 1) Instrucción (EIP)
+    if (eip && instrLen > 0) {
+        uint64_t physEip = translateAndStall(vm, eip, false, pTotalCycles);   // instrucción = read
+        cache->now = *pTotalCycles;
+        cache->fetch = true;
+        uint32_t cyclesCache = cacheAccess(cache, physEip, (uint32_t)instrLen, false);
+        *pTotalCycles += cyclesCache;
+        *pTotalCycles += 2;            // +2 ciclos por ejecutar la instrucción
+        (*pTotalInstr)++;              // contamos una instrucción
+        cache->instrBytes += (uint64_t)instrLen;
+        ps->instrBytes    += (uint64_t)instrLen;
+    }
+
+    // 2) srcM (lectura de 4 bytes)
+    if (strcmp(srcData, "--------") != 0 && src != 0) {
+        uint64_t physSrc = translateAndStall(vm, src, false, pTotalCycles);   // read
+        cache->now = *pTotalCycles;
+        cache->fetch = false;
+        uint32_t cyclesCache = cacheAccess(cache, physSrc, 4, false);
+        *pTotalCycles += cyclesCache;
+        *pTotalCycles += 1;            // +1 ciclo por dirección efectiva
+        cache->srcDstBytes += 4;
+        ps->srcDstBytes    += 4;
+    }
+
+    // 3) dstM (escritura de 4 bytes)
+    if (strcmp(dstData, "--------") != 0 && dst != 0) {
+        uint64_t physDst = translateAndStall(vm, dst, true, pTotalCycles);    // write
+        cache->now = *pTotalCycles;
+        cache->fetch = false;
+        uint32_t cyclesCache = cacheAccess(cache, physDst, 4, true);
+        *pTotalCycles += cyclesCache;
+        *pTotalCycles += 1;            // +1 ciclo por dirección efectiva
+        cache->srcDstBytes += 4;
+        ps->srcDstBytes    += 4;
+    }
+
+    ps->cycles       += *pTotalCycles - i64StartCycles;
+    ps->instructions += *pTotalInstr - i64StartInstr;
+
+    return true;
+}
+
+struct StepBatch;
+
+#ifndef SIM_NO_BATCH
+// the accesses of up to SIM_BATCH_STEPS trace steps, in trace order
+struct StepBatch {
+    uint32_t count;
+    uint64_t virt[3 * SIM_BATCH_STEPS];
+    uint64_t phys[3 * SIM_BATCH_STEPS];
+    uint32_t length[3 * SIM_BATCH_STEPS];
+    uint8_t  isWrite[3 * SIM_BATCH_STEPS];
+    uint8_t  cost[3 * SIM_BATCH_STEPS];     // cycles charged after the access
+    uint32_t stall[3 * SIM_BATCH_STEPS];    // translation cycles before it
+    uint32_t gap[3 * SIM_BATCH_STEPS];
+};
+
+static void batchAdd(struct StepBatch *b, uint64_t virt, uint32_t length, bool isWrite, uint8_t cost)
+{
+    b->virt[b->count]    = virt;
+    b->length[b->count]  = length;
+    b->isWrite[b->count] = isWrite;
+    b->cost[b->count]    = cost;
+    b->count++;
+}
+
+/*
+ * processTraceStep over up to i32Steps steps, with the same results: runs
+ * of accesses whose pages are resident are translated with translateBatch
+ * and then run with cacheAccessBatch. A page fault is taken alone, after
+ * the accesses before it reached the cache, as it may invalidate lines and
+ * its service time depends on the clock. Returns the steps executed;
+ * *pEnded is set if the trace ran out.
+ */
+static uint32_t processTraceBatch(struct VM *vm,
+                                  FILE *fp,
+                                  struct Cache *cache,
+                                  struct StepBatch *b,
+                                  uint32_t i32Steps,
+                                  bool *pEnded,
+                                  uint64_t *pTotalCycles,
+                                  uint64_t *pTotalInstr)
+{
+    cache->pid = vm->i16ProcessId;
+    struct CacheProcStats *ps = &cache->procStats[cache->pid < cache->numProcs ? cache->pid : 0];
+    uint64_t i64StartCycles = *pTotalCycles;
+    uint64_t i64StartInstr  = *pTotalInstr;
+    uint64_t i64InstrBytes = 0, i64SrcDstBytes = 0;
+
+    struct TraceStep st;
+    uint32_t executed = 0;
+    *pEnded = false;
+    while (executed < i32Steps && !*pEnded) {
+        b->count = 0;
+        uint32_t chunk = i32Steps - executed < SIM_BATCH_STEPS ? i32Steps - executed : SIM_BATCH_STEPS;
+        for (uint32_t k = 0; k < chunk; k++) {
+            if (!readTraceStep(fp, &st)) {
+                *pEnded = true;
+                break;
+            }
+            if (st.eip && st.instrLen > 0) {
+                batchAdd(b, st.eip, (uint32_t)st.instrLen, false, 2);   // +2 to execute it
+                (*pTotalInstr)++;
+                i64InstrBytes += (uint64_t)st.instrLen;
+            }
+            if (strcmp(st.srcData, "--------") != 0 && st.src != 0) {
+                batchAdd(b, st.src, 4, false, 1);                       // +1 per effective address
+                i64SrcDstBytes += 4;
+            }
+            if (strcmp(st.dstData, "--------") != 0 && st.dst != 0) {
+                batchAdd(b, st.dst, 4, true, 1);
+                i64SrcDstBytes += 4;
+            }
+            executed++;
+        }
+
+        for (uint32_t pos = 0; pos < b->count; ) {
+            uint32_t n = translateBatch(vm, b->count - pos, &b->virt[pos], &b->isWrite[pos],
+                                        &b->phys[pos], &b->stall[pos]);
+            if (n > 0) {
+                uint64_t i64Gaps = 0;
+                for (uint32_t k = pos; k < pos + n; k++) {
+                    b->gap[k] = b->stall[k] + (k > pos ? b->cost[k - 1] : 0);
+                    i64Gaps  += b->gap[k];
+                }
+                cache->now = *pTotalCycles;
+                *pTotalCycles += cacheAccessBatch(cache, n, &b->phys[pos], &b->length[pos],
+                                                  &b->isWrite[pos], &b->gap[pos]);
+                *pTotalCycles += i64Gaps + b->cost[pos + n - 1];
+                pos += n;
+            }
+            if (pos < b->count) {
+                // page fault
+                uint64_t phys = translateAndStall(vm, b->virt[pos], b->isWrite[pos], pTotalCycles);
+                cache->now = *pTotalCycles;
+                *pTotalCycles += cacheAccess(cache, phys, b->length[pos], b->isWrite[pos]);
+                *pTotalCycles += b->cost[pos];
+                pos++;
+            }
+        }
+    }
+
+    cache->instrBytes  += i64InstrBytes;
+    ps->instrBytes     += i64InstrBytes;
+    cache->srcDstBytes += i64SrcDstBytes;
+    ps->srcDstBytes    += i64SrcDstBytes;
+    ps->cycles         += *pTotalCycles - i64StartCycles;
+    ps->instructions   += *pTotalInstr - i64StartInstr;
+    return executed;
+}
+#endif
+
+static struct SampleProc *sampleProc(struct SampleModel *smp, const struct VM *vm)
+{
+    return &smp->procs[vm->i16ProcessId < smp->iNumProcs ? vm->i16ProcessId : 0];
+}
+
+#ifndef SIM_NO_BATCH
+/*
+ * Functional warming of up to i32Steps steps: page tables, TLB and cache
+ * tags follow the trace with no cache stats. As in processTraceBatch, runs
+ * of resident pages are translated with translateBatch and a page fault is
+ * taken alone; the clock moves once per batch by the trace's unit CPI
+ * measured so far. Returns the steps warmed; *pEnded is set if the trace
+ * ran out.
+ */
+static uint32_t warmTraceBatch(struct VM *vm,
+                               FILE *fp,
+                               struct Cache *cache,
+                               struct SampleModel *smp,
+                               struct StepBatch *b,
+                               uint32_t i32Steps,
+                               bool *pEnded,
+                               uint64_t *pTotalCycles,
+                               uint64_t *pTotalInstr)
+{
+    cache->pid = vm->i16ProcessId;
+    struct CacheProcStats *ps = &cache->procStats[cache->pid < cache->numProcs ? cache->pid : 0];
+    struct SampleProc *sp = sampleProc(smp, vm);
+    double dCpi = sp->i64Instr ? (double)sp->i64Cycles / (double)sp->i64Instr : smp->dCpi;
+
+    struct TraceStep st;
+    uint32_t executed = 0;
+    *pEnded = false;
+    while (executed < i32Steps && !*pEnded) {
+        b->count = 0;
+        uint64_t i64Instr = 0;
+        uint32_t chunk = i32Steps - executed < SIM_BATCH_STEPS ? i32Steps - executed : SIM_BATCH_STEPS;
+        for (uint32_t k = 0; k < chunk; k++) {
+            if (!readTraceStep(fp, &st)) {
+                *pEnded = true;
+                break;
+            }
+            if (st.eip && st.instrLen > 0) {
+                batchAdd(b, st.eip, (uint32_t)st.instrLen, false, 0);
+                i64Instr++;
+            }
+            if (strcmp(st.srcData, "--------") != 0 && st.src != 0) batchAdd(b, st.src, 4, false, 0);
+            if (strcmp(st.dstData, "--------") != 0 && st.dst != 0) batchAdd(b, st.dst, 4, true, 0);
+            executed++;
+        }
+
+        vm->pm->i64Now = *pTotalCycles;
+        for (uint32_t pos = 0; pos < b->count; ) {
+            uint32_t n = translateBatch(vm, b->count - pos, &b->virt[pos], &b->isWrite[pos],
+                                        &b->phys[pos], &b->stall[pos]);
+            for (uint32_t k = pos; k < pos + n; k++)
+                cacheWarm(cache, b->phys[k], b->length[k], b->isWrite[k]);
+            pos += n;
+            if (pos < b->count) {
+                // page fault
+                cacheWarm(cache, translateAddress(vm, b->virt[pos], b->isWrite[pos]),
+                          b->length[pos], b->isWrite[pos]);
+                pos++;
+            }
+        }
+
+        sp->dCycleDebt += dCpi * (double)i64Instr;
+        uint64_t i64Cycles = (uint64_t)sp->dCycleDebt;
+        sp->dCycleDebt -= (double)i64Cycles;
+        *pTotalCycles    += i64Cycles;
+        *pTotalInstr     += i64Instr;
+        ps->cycles       += i64Cycles;
+        ps->instructions += i64Instr;
+    }
+    return executed;
+}
+#else
+// functional warming: page tables, TLB and cache tags follow the trace with
+// no cache stats; the clock moves by the trace's unit CPI measured so far
+static bool warmTraceStep(struct VM *vm,
+                          FILE *fp,
+                          struct Cache *cache,
+                          struct SampleModel *smp,
+                          struct TraceStep *pStep,
+                          uint64_t *pTotalCycles,
+                          uint64_t *pTotalInstr)
+{
+    if (!readTraceStep(fp, pStep)) return false;
+
+    cache->pid = vm->i16ProcessId;
+    struct CacheProcStats *ps = &cache->procStats[cache->pid < cache->numProcs ? cache->pid : 0];
+    vm->pm->i64Now = *pTotalCycles;
+
+    if (pStep->eip && pStep->instrLen > 0) {
+        cacheWarm(cache, translateAddress(vm, pStep->eip, false), (uint32_t)pStep->instrLen, false);
+        (*pTotalInstr)++;
+        ps->instructions++;
+
+        struct SampleProc *sp = sampleProc(smp, vm);
+        sp->dCycleDebt += sp->i64Instr ? (double)sp->i64Cycles / (double)sp->i64Instr : smp->dCpi;
+        uint64_t i64Cycles = (uint64_t)sp->dCycleDebt;
+        sp->dCycleDebt -= (double)i64Cycles;
+        *pTotalCycles += i64Cycles;
+        ps->cycles    += i64Cycles;
+    }
+    if (strcmp(pStep->srcData, "--------") != 0 && pStep->src != 0)
+        cacheWarm(cache, translateAddress(vm, pStep->src, false), 4, false);
+    if (strcmp(pStep->dstData, "--------") != 0 && pStep->dst != 0)
+        cacheWarm(cache, translateAddress(vm, pStep->dst, true), 4, true);
+
+    return true;
+}
+#endif
+
+// a random offset for a unit's warming within its period
+static uint64_t sampleOffset(struct SampleModel *smp)
+{
+    uint64_t x = smp->i64RandState;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    smp->i64RandState = x;
+    return x % (smp->i64Period - smp->i32Warmup - smp->i32Unit + 1);
+}
+
+/*
+ * Up to i32Steps steps of a sampled run: fast-forwarded steps are warmed
+ * together up to the next unit, a unit's steps run one at a time. Returns
+ * the steps run; *pEnded is set if the trace ran out.
+ */
+static uint32_t sampledTraceSteps(struct VM *vm,
+                                  FILE *fp,
+                                  struct Cache *cache,
+                                  struct SampleModel *smp,
+                                  struct StepBatch *b,
+                                  struct TraceStep *pStep,
+                                  uint32_t i32Steps,
+                                  bool *pEnded,
+                                  uint64_t *pTotalCycles,
+                                  uint64_t *pTotalInstr)
+{
+    struct SampleProc *sp = sampleProc(smp, vm);
+    uint64_t i64Detailed = (uint64_t)smp->i32Warmup + smp->i32Unit;
+    *pEnded = false;
+
+    if (sp->i64Pos < sp->i64UnitStart) {
+        uint64_t i64ToUnit = sp->i64UnitStart - sp->i64Pos;
+        uint32_t n = i64ToUnit < i32Steps ? (uint32_t)i64ToUnit : i32Steps;
+#ifndef SIM_NO_BATCH
+        n = warmTraceBatch(vm, fp, cache, smp, b, n, pEnded, pTotalCycles, pTotalInstr);
+#else
+        (void)b;
+        uint32_t k = 0;
+        while (k < n && warmTraceStep(vm, fp, cache, smp, pStep, pTotalCycles, pTotalInstr)) k++;
+        *pEnded = k < n;
+        n = k;
+#endif
+        sp->i64Pos += n;
+        return n;
+    }
+
+    // the unit is measured on the trace's own counters, as other traces may
+    // run in between
+    struct CacheProcStats *ps = &cache->procStats[vm->i16ProcessId < cache->numProcs ? vm->i16ProcessId : 0];
+    uint64_t i64Phase = sp->i64Pos - sp->i64UnitStart;
+    if (i64Phase == smp->i32Warmup) {
+        sp->i64UnitCycles   = ps->cycles;
+        sp->i64UnitInstr    = ps->instructions;
+        sp->i64UnitAccesses = ps->accesses;
+        sp->i64UnitMisses   = ps->misses;
+    }
+    uint64_t i64StartInstr = *pTotalInstr;
+    if (!processTraceStep(vm, fp, cache, pStep, pTotalCycles, pTotalInstr)) {
+        *pEnded = true;
+        return 0;
+    }
+    smp->i64DetailedInstr += *pTotalInstr - i64StartInstr;
+    sp->i64Pos++;
+
+    if (i64Phase < i64Detailed - 1) return 1;
+    if (ps->instructions > sp->i64UnitInstr) {
+        uint64_t i64Cycles = ps->cycles - sp->i64UnitCycles;
+        uint64_t i64Instr  = ps->instructions - sp->i64UnitInstr;
+        double dCpi = (double)i64Cycles / (double)i64Instr;
+        double dAcc = (double)(ps->accesses - sp->i64UnitAccesses);
+        double dMis = (double)(ps->misses - sp->i64UnitMisses);
+        smp->i64Units++;
+        smp->dSumCpi        += dCpi;
+        smp->dSumCpiSq      += dCpi * dCpi;
+        smp->dSumAccesses   += dAcc;
+        smp->dSumMisses     += dMis;
+        smp->dSumAccessesSq += dAcc * dAcc;
+        smp->dSumMissesSq   += dMis * dMis;
+        smp->dSumCross      += dAcc * dMis;
+        smp->dCpi = smp->dSumCpi / (double)smp->i64Units;
+        sp->i64Cycles += i64Cycles;
+        sp->i64Instr  += i64Instr;
+    }
+    sp->i64UnitStart = (sp->i64UnitStart / smp->i64Period + 1) * smp->i64Period + sampleOffset(smp);
+    return 1;
+}
+
+static void contextSwitch(struct PhysicalMemory *pm,
+                          struct VM *vm,
+                          struct Cache *cache,
+                          const struct SwitchModel *sw,
+                          uint64_t *pTotalCycles)
+{
+    struct CacheProcStats *ps = &cache->procStats[vm->i16ProcessId < cache->numProcs ? vm->i16ProcessId : 0];
+
+    *pTotalCycles    += sw->i32Cycles;
+    ps->cycles       += sw->i32Cycles;
+    ps->switchCycles += sw->i32Cycles;
+    ps->switchIns++;
+
+    if (sw->mode == FLUSH_FULL) {
+        cache->now = *pTotalCycles;
+        cacheFlush(cache);
+        if (pm->tlb) tlbFlush(pm->tlb);
+    } else if (sw->mode == FLUSH_ASID && pm->tlb) {
+        tlbActivate(pm->tlb, vm);
+    }
+
+    cache->reloadLeft = sw->i32ReloadWindow;
+}
+
+static void endWarmup(struct PhysicalMemory *pm,
+                      struct VM *vms,
+                      int numFiles,
+                      struct Cache *cache,
+                      struct WarmupModel *wu,
+                      struct IntervalLog *iv,
+                      uint64_t i64Cycles,
+                      uint64_t i64Instr)
+{
+    if (iv) {
+        intervalBeforeReset(iv, cache, pm, -1);
+        for (int k = 0; k < numFiles && !wu->bPerTrace; k++) intervalBeforeReset(iv, cache, pm, k);
+    }
+    resetCacheStats(cache);
+    resetMemoryStats(pm);
+    if (cache->dram) resetDramStats(cache->dram);
+    if (!wu->bPerTrace) {
+        for (int k = 0; k < numFiles; k++) {
+            resetCacheProcStats(cache, k);
+            resetVMStats(&vms[k]);
+        }
+    }
+    wu->bDone           = true;
+    wu->i64Cycles       = i64Cycles;
+    wu->i64Instructions = i64Instr;
+}
+
+// after each step of trace i; bEnded once the trace ran out
+static void checkWarmup(struct PhysicalMemory *pm,
+                        struct VM *vms,
+                        int numFiles,
+                        struct Cache *cache,
+                        struct WarmupModel *wu,
+                        struct IntervalLog *iv,
+                        int i,
+                        const struct TraceStep *st,
+                        bool bEnded,
+                        uint64_t i64Cycles,
+                        uint64_t i64Instr)
+{
+    bool bMarker = !bEnded && wu->i64MarkerEip && st->eip == wu->i64MarkerEip;
+
+    if (!wu->bPerTrace) {
+        if (bMarker || (wu->i64Instr && i64Instr >= wu->i64Instr))
+            endWarmup(pm, vms, numFiles, cache, wu, iv, i64Cycles, i64Instr);
+        return;
+    }
+
+    if (!wu->bArrWarming[i]) return;
+    if (bEnded || bMarker || (wu->i64Instr && cache->procStats[i].instructions >= wu->i64Instr)) {
+        if (iv) intervalBeforeReset(iv, cache, pm, i);
+        resetCacheProcStats(cache, i);
+        resetVMStats(&vms[i]);
+        wu->bArrWarming[i] = false;
+        if (--wu->iWarming == 0)
+            endWarmup(pm, vms, numFiles, cache, wu, iv, i64Cycles, i64Instr);
+    }
+}
+
+void runTraces(struct PhysicalMemory *pm,
+               struct VM *vms,
+               struct TracePool *pool,
+               int numFiles,
+               struct Scheduler *sched,
+               struct Cache *cache,
+               const struct SwitchModel *sw,
+               struct SampleModel *smp,
+               struct WarmupModel *wu,
+               struct IntervalLog *iv,
+               struct CheckpointPlan *ckpt,
+               uint64_t *pTotalCycles,
+               uint64_t *pTotalInstr)
+{
+    // bytes of trace left are the SRT estimate of remaining work
+    for (int i = 0; i < numFiles; i++)
+        schedSetRemaining(sched, i, tracePoolBytesLeft(pool, i));
+
+    struct StepBatch *batch = NULL;
+#ifndef SIM_NO_BATCH
+    batch = malloc(sizeof(struct StepBatch));
+    if (!batch) {
+        fprintf(stderr, "Failed to allocate the access batch\n");
+        exit(EXIT_FAILURE);
+    }
+#endif
+    if (smp && smp->i64Period) {
+        smp->iNumProcs = numFiles > 0 ? numFiles : 1;
+        smp->procs = calloc(smp->iNumProcs, sizeof(struct SampleProc));
+        if (!smp->procs) {
+            fprintf(stderr, "Failed to allocate the sampling state\n");
+            exit(EXIT_FAILURE);
+        }
+        smp->i64RandState = 0x2545F4914F6CDD1DULL;   // deterministic offsets
+        for (int k = 0; k < smp->iNumProcs; k++) smp->procs[k].i64UnitStart = sampleOffset(smp);
+    }
+
+    int running = ckpt ? ckpt->iRunning : -1;
+    bool bFirstSlice = true;
+    struct TraceStep st;
+    int i;
+
+    while ((i = schedPickNext(sched, *pTotalCycles)) >= 0) {
+        if (running != i) {
+            // first dispatch is a cold start, not a switch
+            if (running >= 0) {
+                contextSwitch(pm, &vms[i], cache, sw, pTotalCycles);
+            } else if (sw->mode == FLUSH_ASID && pm->tlb) {
+                tlbActivate(pm->tlb, &vms[i]);
+            }
+            running = i;
+        } else if (bFirstSlice && sw->mode == FLUSH_ASID && pm->tlb) {
+            tlbActivate(pm->tlb, &vms[i]);      // restored: the TLB starts cold
+        }
+        bFirstSlice = false;
+        if ((uint32_t)i < cache->numProcs) cache->procStats[i].slices++;
+
+        int32_t si32Quantum = sched->procs[i].si32Quantum;
+        uint32_t executed = 0;
+        FILE *fp = tracePoolGet(pool, i);
+#ifndef SIM_NO_BATCH
+        // per step models, and SHiP and recording (pc and fetch per access), need the scalar path
+        if (!(smp && smp->i64Period) && !iv && (!wu || wu->bDone)
+            && !cache->record && cache->policy != CACHE_SHIP) {
+            bool bEnded;
+            executed = processTraceBatch(&vms[i], fp, cache, batch,
+                                         si32Quantum == -1 ? UINT32_MAX : (uint32_t)si32Quantum,
+                                         &bEnded, pTotalCycles, pTotalInstr);
+            if (bEnded || traceAtEnd(fp)) {
+                schedFinish(sched, i, *pTotalCycles);
+                freeFramesForProcess(vms[i].pm, vms[i].i16ProcessId);
+                tracePoolClose(pool, i);
+            }
+        }
+        else
+#endif
+        while (executed < (uint32_t)si32Quantum || si32Quantum == -1) {
+            bool bEnded;
+            if (smp && smp->i64Period) {
+                // warming goes on to the end of the slice or of the interval
+                uint32_t i32Left = si32Quantum == -1 ? UINT32_MAX : (uint32_t)si32Quantum - executed;
+                if (iv && iv->i64Next > *pTotalInstr && iv->i64Next - *pTotalInstr < i32Left)
+                    i32Left = (uint32_t)(iv->i64Next - *pTotalInstr);
+                executed += sampledTraceSteps(&vms[i], fp, cache, smp, batch, &st, i32Left,
+                                              &bEnded, pTotalCycles, pTotalInstr);
+            } else {
+                bEnded = !processTraceStep(&vms[i], fp, cache, &st, pTotalCycles, pTotalInstr);
+                if (!bEnded) executed++;
+            }
+            // the trace finishes with its last step, not when next dispatched
+            if (!bEnded && executed == (uint32_t)si32Quantum && traceAtEnd(fp)) bEnded = true;
+            if (iv && *pTotalInstr >= iv->i64Next)
+                intervalRecord(iv, cache, pm, *pTotalCycles, *pTotalInstr);
+            if (wu && !wu->bDone)
+                checkWarmup(pm, vms, numFiles, cache, wu, iv, i, &st, bEnded, *pTotalCycles, *pTotalInstr);
+            if (bEnded) {
+                schedFinish(sched, i, *pTotalCycles);
+                freeFramesForProcess(vms[i].pm, vms[i].i16ProcessId);
+                tracePoolClose(pool, i);
+                break;
+            }
+        }
+        if (executed) schedAccount(sched, i, executed);     // an empty trace ran no slice
+        schedSetRemaining(sched, i, tracePoolBytesLeft(pool, i));
+
+        if (ckpt && ckpt->sSavePath && !ckpt->bSaved && *pTotalInstr >= ckpt->i64SaveAt) {
+            struct SimState st = { pm, vms, numFiles, pool, sched, cache,
+                                   running, *pTotalCycles, *pTotalInstr };
+            writeCheckpoint(ckpt->sSavePath, &st);
+            ckpt->bSaved = true;
+        }
+    }
+#ifndef SIM_NO_BATCH
+    free(batch);
+#endif
+    if (smp && smp->procs) {
+        free(smp->procs);
+        smp->procs = NULL;
+    }
+}
+
+/*
+ * OPT page replacement needs the future reference string. The order of
+ * translations depends only on the traces and the scheduler, so a scratch
+ * run with the same schedule records it before the real run.
+ */
+void recordPageReferences(struct PhysicalMemory *pm,
+                          char *sArrFileNames[],
+                          int numFiles,
+                          const struct Scheduler *sched,
+                          const struct Cache *cache,
+                          uint32_t i32MaxOpen)
+{
+    struct PhysicalMemory rec;
+    initPhysicalMemory(&rec, pm->i64PhysicalMemory, pm->i32PageBytes, pm->dSystemMemoryPerc);
+    rec.bRecordRefs = true;
+
+    struct VM *vms = calloc(numFiles > 0 ? numFiles : 1, sizeof(struct VM));
+    if (!vms) {
+        fprintf(stderr, "Failed to allocate VMs\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < numFiles; i++)
+        initVM(&vms[i], i, 32, 4096, &rec);
+    rec.vms = vms;
+    rec.iNumVMs = numFiles;
+
+    struct Cache scratch;
+    // round robin: a random cache would use up rand() draws of the real run
+    initCache(&scratch, cache->cacheSizeBytes, cache->blockSize, cache->associativity, CACHE_RR);
+    initCacheProcStats(&scratch, numFiles);
+
+    struct Scheduler s;
+    initScheduler(&s, sched->policy, numFiles, 1);
+    for (int i = 0; i < numFiles; i++) {
+        s.procs[i].si32Quantum = sched->procs[i].si32Quantum;
+        s.procs[i].i32Weight   = sched->procs[i].i32Weight;
+    }
+
+    struct TracePool pool;
+    initTracePool(&pool, sArrFileNames, numFiles, i32MaxOpen);
+
+    struct SwitchModel sw = { 0, FLUSH_NONE, 0 };
+    uint64_t i64Cycles = 0, i64Instr = 0;
+    runTraces(&rec, vms, &pool, numFiles, &s, &scratch, &sw, NULL, NULL, NULL, NULL, &i64Cycles, &i64Instr);
+
+    setPageOptTrace(pm, rec.i64RefKeys, rec.i64NumRefKeys);
+
+    freeTracePool(&pool);
+    freeScheduler(&s);
+    freeCache(&scratch);
+    for (int i = 0; i < numFiles; i++) freeVM(&vms[i]);
+    free(vms);
+    freePhysicalMemory(&rec);
+}
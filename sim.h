@@ -0,0 +1,133 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct PhysicalMemory;
+struct VM;
+struct TracePool;
+struct Scheduler;
+struct Cache;
+struct IntervalLog;
+
+/*
+ * The time slice loop shared by cacheSim, ccacheSim and cacheBench: the scheduler
+ * picks a trace, its quantum of instructions is read, translated and run
+ * through the cache, with the optional timing, sampling, warm-up,
+ * interval and checkpoint models hooked in. Callers own the set up of
+ * the cache, physical memory, VMs, trace pool and scheduler.
+ */
+
+// one instruction record of a trace
+struct TraceStep {
+    int instrLen;
+    uint64_t eip, src, dst;
+    char srcData[16], dstData[16];
+};
+
+// one trace's share of the sampled run
+struct SampleProc {
+    uint64_t i64Pos;                // its trace steps so far
+    uint64_t i64UnitStart;          // step its current or next unit's warming starts at
+
+    // its counters when the unit being measured began
+    uint64_t i64UnitCycles, i64UnitInstr, i64UnitAccesses, i64UnitMisses;
+
+    uint64_t i64Cycles, i64Instr;   // over its measured units
+    double   dCycleDebt;            // fraction of a warming cycle not charged yet
+};
+
+/*
+ * SMARTS-style sampling: in every i64Period steps of each trace, i32Warmup
+ * steps run in detail unmeasured, then i32Unit steps are measured; the rest
+ * are fast-forwarded with functional warming only. Positions are counted per
+ * trace and each unit starts at a random offset within its period, so the
+ * units fall evenly over the traces and over their steps whatever the
+ * scheduler's rotation is.
+ */
+struct SampleModel {
+    uint64_t i64Period;         // 0 = simulate everything in detail
+    uint32_t i32Unit;
+    uint32_t i32Warmup;
+
+    uint64_t i64RandState;      // xorshift state for the unit offsets
+    double   dCpi;              // mean unit CPI, for traces not measured yet
+
+    // per trace, set up by runTraces: a fast-forwarded instruction is
+    // charged its own trace's unit CPI
+    struct SampleProc *procs;
+    int iNumProcs;
+
+    // finished units
+    uint64_t i64Units;
+    double   dSumCpi, dSumCpiSq;
+    double   dSumAccesses, dSumMisses;
+    double   dSumAccessesSq, dSumMissesSq, dSumCross;
+    uint64_t i64DetailedInstr;
+};
+
+typedef enum {
+    FLUSH_NONE,         // nothing is flushed on a switch
+    FLUSH_FULL,         // cache and TLB are flushed on every switch
+    FLUSH_ASID          // TLB tagged with a limited pool of ASIDs, cache kept
+} FlushMode;
+
+struct SwitchModel {
+    uint32_t  i32Cycles;        // cycles charged per context switch
+    FlushMode mode;
+    uint32_t  i32ReloadWindow;  // block accesses watched after a switch
+};
+
+/*
+ * Warm-up: the first instructions update every tag, frame and PTE but their
+ * counts are thrown away. Globally, all counters are zeroed once the run
+ * reaches i64Instr instructions or the marker EIP. Per trace, each trace's
+ * own counters are zeroed when it gets there (or ends) and the shared ones
+ * once every trace has.
+ */
+struct WarmupModel {
+    uint64_t i64Instr;          // 0 = no instruction count
+    uint64_t i64MarkerEip;      // 0 = no marker
+    bool     bPerTrace;
+    bool     bDone;             // shared counters zeroed
+    int      iWarming;          // per trace: traces not there yet
+    bool     *bArrWarming;
+    uint64_t i64Cycles;         // clock and instruction count when the shared counters were zeroed
+    uint64_t i64Instructions;
+};
+
+// save the state at the first slice boundary after i64SaveAt instructions
+struct CheckpointPlan {
+    const char *sSavePath;      // NULL = no checkpoint
+    uint64_t i64SaveAt;
+    bool     bSaved;
+    const char *sRestorePath;   // NULL = start from the beginning
+    int      iRunning;          // trace running when the restored state was saved
+};
+
+/* runs every trace to the end; pTotalCycles / pTotalInstr start where a
+   restored checkpoint left them. smp, wu, iv and ckpt may be NULL */
+void runTraces(struct PhysicalMemory *pm,
+               struct VM *vms,
+               struct TracePool *pool,
+               int numFiles,
+               struct Scheduler *sched,
+               struct Cache *cache,
+               const struct SwitchModel *sw,
+               struct SampleModel *smp,
+               struct WarmupModel *wu,
+               struct IntervalLog *iv,
+               struct CheckpointPlan *ckpt,
+               uint64_t *pTotalCycles,
+               uint64_t *pTotalInstr);
+
+/* scratch run recording the page reference string for OPT page replacement */
+void recordPageReferences(struct PhysicalMemory *pm,
+                          char *sArrFileNames[],
+                          int numFiles,
+                          const struct Scheduler *sched,
+                          const struct Cache *cache,
+                          uint32_t i32MaxOpen);
+
+#endif
@@ -0,0 +1,57 @@
+#include "simProfile.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+struct SimProfile simProfile;
+
+static const char *phase_name(int phase)
+{
+    switch (phase) {
+        case PROF_PARSE:      return "Trace Parsing";
+        case PROF_TRANSLATE:  return "Address Translation";
+        case PROF_LOOKUP:     return "Cache Lookup";
+        case PROF_VICTIM:     return "Victim Selection";
+        case PROF_INVALIDATE: return "Invalidation";
+        default:              return "Other";
+    }
+}
+
+void startSimProfile(void)
+{
+    memset(&simProfile, 0, sizeof(simProfile));
+    clock_gettime(CLOCK_MONOTONIC, &simProfile.start);
+    simProfile.i64StartTicks = profTicks();
+}
+
+void printSimProfile(uint64_t i64Instructions, uint64_t i64BlockAccesses)
+{
+    struct SimProfile *p = &simProfile;
+    uint64_t i64Total = profTicks() - p->i64StartTicks;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double dWall = (double)(end.tv_sec - p->start.tv_sec) + (end.tv_nsec - p->start.tv_nsec) / 1e9;
+    double dSecPerTick = i64Total ? dWall / (double)i64Total : 0.0;
+
+    printf("\n***** SIMULATOR PROFILE *****\n\n");
+    printf("%-32s%.3f s\n", "Wall Time:", dWall);
+    printf("%-32s%.0f ( %.2f MIPS )\n", "Instructions / Second:",
+           dWall > 0 ? i64Instructions / dWall : 0.0, dWall > 0 ? i64Instructions / dWall / 1e6 : 0.0);
+    printf("%-32s%.0f\n\n", "Block Accesses / Second:", dWall > 0 ? i64BlockAccesses / dWall : 0.0);
+
+    printf("%-22s %10s %8s %14s\n", "Phase", "Seconds", "Share", "Calls");
+    uint64_t i64Charged = 0;
+    for (int i = 0; i <= PROF_NUM_PHASES; i++) {
+        uint64_t i64Ticks;
+        if (i < PROF_NUM_PHASES) {
+            i64Ticks = p->i64ArrTicks[i];
+            i64Charged += i64Ticks;
+        } else {
+            i64Ticks = i64Total > i64Charged ? i64Total - i64Charged : 0;
+        }
+        printf("%-22s %10.3f %7.2f%% ", phase_name(i), i64Ticks * dSecPerTick,
+               i64Total ? 100.0 * (double)i64Ticks / (double)i64Total : 0.0);
+        if (i < PROF_NUM_PHASES) printf("%14" PRIu64 "\n", p->i64ArrCalls[i]);
+        else                     printf("%14s\n", "-");
+    }
+}
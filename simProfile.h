@@ -0,0 +1,93 @@
+#ifndef SIMPROFILE_H
+#define SIMPROFILE_H
+
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * Where the simulator itself spends its time. Built with -DSIM_PROFILE
+ * the hot paths are bracketed by PROF_BEGIN / PROF_END; without it the
+ * macros are empty and cost nothing.
+ *
+ * Phases nest (translation can invalidate cache blocks, a lookup picks a
+ * victim) and each one is charged only the time not spent in the phases
+ * inside it, so the shares add up to 100% with "other" for the rest.
+ * Ticks come from the TSC on x86 and clock_gettime elsewhere, and are
+ * converted to seconds with the wall time of the whole run.
+ */
+typedef enum {
+    PROF_PARSE,             // reading and scanning trace records
+    PROF_TRANSLATE,         // address translation, TLB and fault handling
+    PROF_LOOKUP,            // cache tag lookup and fill
+    PROF_VICTIM,            // victim selection
+    PROF_INVALIDATE,        // page invalidation and flushes
+    PROF_NUM_PHASES
+} ProfPhase;
+
+#define PROF_MAX_DEPTH 8
+
+struct SimProfile {
+    uint64_t i64ArrTicks[PROF_NUM_PHASES];
+    uint64_t i64ArrCalls[PROF_NUM_PHASES];
+    uint8_t  i8ArrStack[PROF_MAX_DEPTH];
+    int      iDepth;
+    uint64_t i64Last;               // tick the running phase was last charged to
+    uint64_t i64StartTicks;
+    struct timespec start;
+};
+
+extern struct SimProfile simProfile;
+
+static inline uint64_t profTicks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static inline void profBegin(ProfPhase phase)
+{
+    struct SimProfile *p = &simProfile;
+    uint64_t i64Now = profTicks();
+    if (p->iDepth > 0) p->i64ArrTicks[p->i8ArrStack[p->iDepth - 1]] += i64Now - p->i64Last;
+    if (p->iDepth < PROF_MAX_DEPTH) p->i8ArrStack[p->iDepth] = (uint8_t)phase;
+    p->iDepth++;
+    p->i64ArrCalls[phase]++;
+    p->i64Last = i64Now;
+}
+
+static inline void profEnd(void)
+{
+    struct SimProfile *p = &simProfile;
+    uint64_t i64Now = profTicks();
+    p->iDepth--;
+    if (p->iDepth < PROF_MAX_DEPTH) p->i64ArrTicks[p->i8ArrStack[p->iDepth]] += i64Now - p->i64Last;
+    p->i64Last = i64Now;
+}
+
+/* starts the clock for the throughput figures */
+void startSimProfile(void);
+
+/* throughput and the share of each phase */
+void printSimProfile(uint64_t i64Instructions, uint64_t i64BlockAccesses);
+
+#ifdef SIM_PROFILE
+#define PROF_START()                   startSimProfile()
+#define PROF_BEGIN(phase)              profBegin(phase)
+#define PROF_END()                     profEnd()
+#define PROF_REPORT(instr, accesses)   printSimProfile(instr, accesses)
+#else
+#define PROF_START()                   ((void)0)
+#define PROF_BEGIN(phase)              ((void)0)
+#define PROF_END()                     ((void)0)
+#define PROF_REPORT(instr, accesses)   ((void)0)
+#endif
+
+#endif
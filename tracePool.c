@@ -0,0 +1,102 @@
+#include "tracePool.h"
+#include <stdlib.h>
+#include <string.h>
+
+void initTracePool(struct TracePool *pool,
+                   char *sArrPaths[],
+                   int iNumTraces,
+                   uint32_t i32MaxOpen)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->iNumTraces = iNumTraces;
+    pool->i32MaxOpen = i32MaxOpen ? i32MaxOpen : TRACE_POOL_DEFAULT_OPEN;
+
+    pool->traces = calloc(iNumTraces > 0 ? iNumTraces : 1, sizeof(struct TraceFile));
+    if (!pool->traces) {
+        fprintf(stderr, "Failed to allocate trace pool\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* size every trace up front; handles are opened lazily */
+    for (int i = 0; i < iNumTraces; i++) {
+        struct TraceFile *t = &pool->traces[i];
+        t->sPath = sArrPaths[i];
+        FILE *fp = fopen(t->sPath, "r");
+        if (!fp) {
+            fprintf(stderr, "Error: failed to open %s\n", t->sPath);
+            exit(EXIT_FAILURE);
+        }
+        fseek(fp, 0, SEEK_END);
+        long lSize = ftell(fp);
+        t->i64Size = lSize > 0 ? (uint64_t)lSize : 0;
+        fclose(fp);
+    }
+}
+
+void freeTracePool(struct TracePool *pool)
+{
+    for (int i = 0; i < pool->iNumTraces; i++) {
+        if (pool->traces[i].fp) fclose(pool->traces[i].fp);
+    }
+    free(pool->traces);
+    memset(pool, 0, sizeof(*pool));
+}
+
+static void parkTrace(struct TracePool *pool, struct TraceFile *t)
+{
+    long lPos = ftell(t->fp);
+    t->i64Offset = lPos > 0 ? (uint64_t)lPos : 0;
+    fclose(t->fp);
+    t->fp = NULL;
+    pool->i32NumOpen--;
+}
+
+FILE *tracePoolGet(struct TracePool *pool, int i)
+{
+    struct TraceFile *t = &pool->traces[i];
+    t->i64LastUse = ++pool->i64Tick;
+    if (t->fp) return t->fp;
+
+    if (pool->i32NumOpen >= pool->i32MaxOpen) {
+        /* park the least recently used open trace */
+        struct TraceFile *lru = NULL;
+        for (int k = 0; k < pool->iNumTraces; k++) {
+            struct TraceFile *o = &pool->traces[k];
+            if (o->fp && (!lru || o->i64LastUse < lru->i64LastUse)) lru = o;
+        }
+        if (lru) parkTrace(pool, lru);
+    }
+
+    t->fp = fopen(t->sPath, "r");
+    if (!t->fp) {
+        fprintf(stderr, "Error: failed to reopen %s\n", t->sPath);
+        exit(EXIT_FAILURE);
+    }
+    if (t->i64Offset > 0) {
+        fseek(t->fp, (long)t->i64Offset, SEEK_SET);
+        pool->i64Reopens++;
+    }
+    pool->i32NumOpen++;
+    return t->fp;
+}
+
+void tracePoolClose(struct TracePool *pool, int i)
+{
+    struct TraceFile *t = &pool->traces[i];
+    if (!t->fp) return;
+    fclose(t->fp);
+    t->fp = NULL;
+    t->i64Offset = t->i64Size;
+    pool->i32NumOpen--;
+}
+
+uint64_t tracePoolBytesLeft(struct TracePool *pool, int i)
+{
+    struct TraceFile *t = &pool->traces[i];
+    uint64_t i64Pos = t->i64Offset;
+    if (t->fp) {
+        long lPos = ftell(t->fp);
+        i64Pos = lPos > 0 ? (uint64_t)lPos : 0;
+    }
+    return i64Pos < t->i64Size ? t->i64Size - i64Pos : 0;
+}
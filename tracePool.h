@@ -0,0 +1,49 @@
+#ifndef TRACEPOOL_H
+#define TRACEPOOL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TRACE_POOL_DEFAULT_OPEN 64
+
+/*
+ * Keeps at most i32MaxOpen trace files open. A trace whose handle was
+ * closed to make room is reopened and seeked back to where it stopped.
+ */
+struct TraceFile {
+    const char *sPath;
+    FILE    *fp;            // NULL while parked
+    uint64_t i64Offset;     // resume point while parked
+    uint64_t i64Size;       // bytes in the file
+    uint64_t i64LastUse;    // pool tick, for LRU parking
+};
+
+struct TracePool {
+    struct TraceFile *traces;
+    int      iNumTraces;
+    uint32_t i32MaxOpen;
+    uint32_t i32NumOpen;
+    uint64_t i64Tick;
+
+    /* stats */
+    uint64_t i64Reopens;
+};
+
+void initTracePool(struct TracePool *pool,
+                   char *sArrPaths[],
+                   int iNumTraces,
+                   uint32_t i32MaxOpen);
+
+void freeTracePool(struct TracePool *pool);
+
+/* open handle for trace i, positioned where it last stopped */
+FILE *tracePoolGet(struct TracePool *pool, int i);
+
+/* close trace i for good (EOF reached) */
+void tracePoolClose(struct TracePool *pool, int i);
+
+/* bytes of trace i not consumed yet */
+uint64_t tracePoolBytesLeft(struct TracePool *pool, int i);
+
+#endif
@@ -1,5 +1,6 @@
 #include "virtualMem.h"
 #include "cache.h"
+#include "simProfile.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -7,8 +8,27 @@
 #include <math.h>
 #include <assert.h>
 
-#define FLAG_VALID 0x1
-#define FLAG_DIRTY 0x2
+#define FLAG_VALID      0x1
+#define FLAG_DIRTY      0x2
+#define FLAG_REFERENCED 0x4
+#define FLAG_ON_DISK    0x8     // PTE: page was evicted, a refault reads it back
+
+#define TRANSLATE_PREFETCH_AHEAD 8      // accesses between a PTE prefetch and its walk
+
+#if defined(__GNUC__)
+#define PREFETCH(p) __builtin_prefetch(p)
+#else
+#define PREFETCH(p) ((void)(p))
+#endif
+
+static void initReplDomain(struct ReplDomain *d)
+{
+    memset(d, 0, sizeof(*d));
+    d->i32Head   = FRAME_NIL;
+    d->i32Tail   = FRAME_NIL;
+    d->i32Hand   = FRAME_NIL;
+    d->i32Bucket = FRAME_NIL;
+}
 
 static uint32_t log2_int(uint32_t i32InitVal) 
 {
@@ -47,15 +67,203 @@ void initPhysicalMemory(struct PhysicalMemory *pm,
     pm->i64NumPageFaults = 0;
     pm->cache= NULL;
 
+    initReplDomain(&pm->replDomain);
+    pm->replPolicy     = PR_LRU;
+    pm->replScope      = PR_GLOBAL;
+    pm->i64WsWindow    = WSCLOCK_DEFAULT_WINDOW;
+    pm->i64AgingPeriod = PAGE_AGING_PERIOD;
+    pm->i32LfuFree     = FRAME_NIL;
+}
 
+static void freeFrameAllocator(struct PhysicalMemory *pm)
+{
+    free(pm->i64ColorBase);
+    free(pm->i64ColorNext);
+    free(pm->i64ColorFreed);
+    free(pm->i64FrameOrder);
+    free(pm->i64FreedHeap);
+    pm->i64ColorBase  = NULL;
+    pm->i64ColorNext  = NULL;
+    pm->i64ColorFreed = NULL;
+    pm->i64FrameOrder = NULL;
+    pm->i64FreedHeap  = NULL;
 }
 
 void freePhysicalMemory(struct PhysicalMemory *pm)
 {
+    freeFrameAllocator(pm);
+    free(pm->replDomain.i32Heap);
+    free(pm->lfuBuckets);
+    free(pm->i64NextUse);
+    free(pm->i64RefKeys);
     free(pm->frames);
     memset(pm, 0, sizeof(*pm));
 }
 
+FrameAllocPolicy frame_alloc_from_string(const char *sPolicyCode)
+{
+    if (strcmp(sPolicyCode, "random") == 0) return FA_RANDOM;
+    if (strcmp(sPolicyCode, "bin") == 0)    return FA_BIN_HOPPING;
+    if (strcmp(sPolicyCode, "color") == 0)  return FA_PAGE_COLOR;
+    return FA_SEQUENTIAL; // default
+}
+
+/* own generator so frame placement does not disturb the cache's rand() stream */
+static uint64_t i64AllocRandState = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t allocRand(void)
+{
+    uint64_t x = i64AllocRandState;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    i64AllocRandState = x;
+    return x;
+}
+
+void setFrameAllocPolicy(struct PhysicalMemory *pm,
+                         FrameAllocPolicy policy,
+                         uint32_t i32NumColors)
+{
+    freeFrameAllocator(pm);
+
+    /* sequential and random placement ignore colors */
+    if (policy == FA_SEQUENTIAL || policy == FA_RANDOM || i32NumColors == 0)
+        i32NumColors = 1;
+    if (i32NumColors > pm->i64NumFramesUsable && pm->i64NumFramesUsable > 0)
+        i32NumColors = (uint32_t)pm->i64NumFramesUsable;
+
+    pm->allocPolicy   = policy;
+    pm->i32NumColors  = i32NumColors;
+    pm->i32NextColor  = 0;
+
+    pm->i64ColorBase  = calloc(i32NumColors, sizeof(uint64_t));
+    pm->i64ColorNext  = calloc(i32NumColors, sizeof(uint64_t));
+    pm->i64ColorFreed = calloc(i32NumColors, sizeof(uint64_t));
+    pm->i64FrameOrder = calloc(pm->i64NumFramesUsable + 1, sizeof(uint64_t));
+    pm->i64FreedHeap  = calloc(pm->i64NumFramesUsable + 1, sizeof(uint64_t));
+    if (!pm->i64ColorBase || !pm->i64ColorNext || !pm->i64ColorFreed ||
+        !pm->i64FrameOrder || !pm->i64FreedHeap)
+    {
+        fprintf(stderr, "Failed to allocate frame allocator\n");
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t i64Slot = 0;
+    for (uint32_t k = 0; k < i32NumColors; k++)
+    {
+        pm->i64ColorBase[k] = i64Slot;
+        for (uint64_t f = k; f < pm->i64NumFramesUsable; f += i32NumColors)
+            pm->i64FrameOrder[i64Slot++] = f;
+    }
+
+    if (policy == FA_RANDOM)
+    {
+        for (uint64_t i = pm->i64NumFramesUsable; i > 1; i--)
+        {
+            uint64_t j = allocRand() % i;
+            uint64_t t = pm->i64FrameOrder[i - 1];
+            pm->i64FrameOrder[i - 1] = pm->i64FrameOrder[j];
+            pm->i64FrameOrder[j] = t;
+        }
+    }
+}
+
+static uint64_t colorSize(struct PhysicalMemory *pm, uint32_t i32Color)
+{
+    uint64_t i64End = (i32Color + 1 < pm->i32NumColors)
+                      ? pm->i64ColorBase[i32Color + 1]
+                      : pm->i64NumFramesUsable;
+    return i64End - pm->i64ColorBase[i32Color];
+}
+
+/* released frames are reused lowest index first, like the old linear scan */
+static void pushFreedFrame(struct PhysicalMemory *pm, uint64_t i64Frame)
+{
+    uint32_t i32Color = (uint32_t)(i64Frame % pm->i32NumColors);
+    uint64_t *heap = &pm->i64FreedHeap[pm->i64ColorBase[i32Color]];
+    uint64_t i = pm->i64ColorFreed[i32Color]++;
+    heap[i] = i64Frame;
+    while (i > 0 && heap[(i - 1) / 2] > heap[i])
+    {
+        uint64_t p = (i - 1) / 2;
+        uint64_t t = heap[p]; heap[p] = heap[i]; heap[i] = t;
+        i = p;
+    }
+}
+
+static uint64_t popFrameOfColor(struct PhysicalMemory *pm, uint32_t i32Color)
+{
+    // never-used frames first
+    if (pm->i64ColorNext[i32Color] < colorSize(pm, i32Color))
+        return pm->i64FrameOrder[pm->i64ColorBase[i32Color] + pm->i64ColorNext[i32Color]++];
+
+    uint64_t n = pm->i64ColorFreed[i32Color];
+    if (n == 0) return UINT64_MAX;
+
+    uint64_t *heap = &pm->i64FreedHeap[pm->i64ColorBase[i32Color]];
+    uint64_t i64Frame = heap[0];
+    heap[0] = heap[--n];
+    pm->i64ColorFreed[i32Color] = n;
+    uint64_t i = 0;
+    for (;;)
+    {
+        uint64_t l = 2 * i + 1, r = l + 1, m = i;
+        if (l < n && heap[l] < heap[m]) m = l;
+        if (r < n && heap[r] < heap[m]) m = r;
+        if (m == i) break;
+        uint64_t t = heap[m]; heap[m] = heap[i]; heap[i] = t;
+        i = m;
+    }
+    return i64Frame;
+}
+
+/* preferred color for the faulting page, per allocation policy */
+static uint32_t preferredColor(struct PhysicalMemory *pm, struct VM *vm, uint64_t vpn)
+{
+    uint32_t i32Colors = pm->i32NumColors;
+    switch (pm->allocPolicy)
+    {
+        case FA_BIN_HOPPING:
+            return pm->i32NextColor++ % i32Colors;
+        case FA_PAGE_COLOR:
+        {
+            uint32_t i32NumProcs = pm->iNumVMs > 0 ? (uint32_t)pm->iNumVMs : 1;
+            if (i32Colors >= i32NumProcs)
+            {
+                // disjoint color range per process, page color follows the VPN inside it
+                uint32_t i32Span = i32Colors / i32NumProcs;
+                uint32_t i32Base = (vm->i16ProcessId % i32NumProcs) * i32Span;
+                return i32Base + (uint32_t)(vpn % i32Span);
+            }
+            return (uint32_t)((vpn + vm->i16ProcessId) % i32Colors);
+        }
+        default:
+            return 0;
+    }
+}
+
+static uint64_t allocateFreeFrame(struct PhysicalMemory *pm, struct VM *vm, uint64_t vpn)
+{
+    if (!pm->i64ColorBase)
+        setFrameAllocPolicy(pm, FA_SEQUENTIAL, 1);
+
+    uint32_t i32Colors = pm->i32NumColors;
+    uint32_t i32Color  = preferredColor(pm, vm, vpn) % i32Colors;
+
+    // preferred color exhausted: take the next color that still has frames
+    for (uint32_t k = 0; k < i32Colors; k++)
+    {
+        uint64_t i64Frame = popFrameOfColor(pm, (i32Color + k) % i32Colors);
+        if (i64Frame != UINT64_MAX)
+        {
+            pm->i64NumFramesUsed++;
+            return i64Frame;
+        }
+    }
+    return UINT64_MAX;
+}
+
 void initVM(struct VM *vm,
             uint16_t _i16PID,
             uint32_t _i32VirtualAddressBits,
@@ -70,9 +278,13 @@ void initVM(struct VM *vm,
     vm->i32VPNBits              = vm->i32VirtualAddressBits - vm->i32OffsetBits;
     vm->i64NumVPages            = (1ULL << vm->i32VPNBits);
 
+    vm->i16Asid                 = _i16PID;
     vm->pm                      = _pm;
-    vm->pageTable               = calloc(vm->i64NumVPages, sizeof(struct PTE));
-    if (!vm->pageTable) 
+    initReplDomain(&vm->replDomain);
+    vm->i32LeafBits             = vm->i32VPNBits < PT_LEAF_BITS ? vm->i32VPNBits : PT_LEAF_BITS;
+    vm->i64NumDirEntries        = vm->i64NumVPages >> vm->i32LeafBits;
+    vm->pageDir                 = calloc(vm->i64NumDirEntries, sizeof(struct PTE *));
+    if (!vm->pageDir) 
     {
         fprintf(stderr, "Failed to allocate memory for VM PID %u\n", _i16PID);
         exit(EXIT_FAILURE);
@@ -81,25 +293,721 @@ void initVM(struct VM *vm,
 
 void freeVM(struct VM *vm)
 {
-    free(vm->pageTable);
+    if (vm->pageDir)
+    {
+        for (uint64_t d = 0; d < vm->i64NumDirEntries; d++)
+            free(vm->pageDir[d]);
+    }
+    free(vm->pageDir);
+    free(vm->replDomain.i32Heap);
     memset(vm, 0, sizeof(*vm));
 }
 
-static uint64_t selectVictimFrameLRU(struct PhysicalMemory *pm)
+struct PTE *lookupPTE(struct VM *vm, uint64_t vpn, bool bCreate)
 {
-    uint64_t i64OldestTick = UINT64_MAX;
-    uint64_t i64Victim = 0;
-    for (uint64_t i = 0; i < pm->i64NumFramesUsed; i++) 
+    uint64_t i64Dir = vpn >> vm->i32LeafBits;
+    struct PTE *leaf = vm->pageDir[i64Dir];
+    if (!leaf)
     {
-        if ((pm->frames[i].i8Flags & FLAG_VALID) &&
-            pm->frames[i].i64Tick < i64OldestTick)
+        if (!bCreate) return NULL;
+        leaf = calloc(1ULL << vm->i32LeafBits, sizeof(struct PTE));
+        if (!leaf)
         {
-            i64OldestTick = pm->frames[i].i64Tick;
-            i64Victim = i;
+            fprintf(stderr, "Failed to allocate page table leaf for VM PID %u\n", vm->i16ProcessId);
+            exit(EXIT_FAILURE);
         }
+        vm->pageDir[i64Dir] = leaf;
     }
-    pm->i64NumEvictions++;
-    return i64Victim;
+    return &leaf[vpn & ((1ULL << vm->i32LeafBits) - 1)];
+}
+
+uint64_t countValidPTEs(const struct VM *vm)
+{
+    uint64_t i64Used = 0;
+    uint64_t i64LeafSize = 1ULL << vm->i32LeafBits;
+    for (uint64_t d = 0; d < vm->i64NumDirEntries; d++)
+    {
+        const struct PTE *leaf = vm->pageDir[d];
+        if (!leaf) continue;
+        for (uint64_t p = 0; p < i64LeafSize; p++)
+            if (leaf[p].i8Flags & FLAG_VALID) i64Used++;
+    }
+    return i64Used;
+}
+
+void initTLB(struct TLB *tlb, uint32_t i32NumEntries, uint32_t i32Ways, uint32_t i32NumAsids)
+{
+    memset(tlb, 0, sizeof(*tlb));
+    if (i32Ways == 0 || i32Ways > i32NumEntries) i32Ways = i32NumEntries;
+    tlb->i32NumEntries = i32NumEntries;
+    tlb->i32Ways       = i32Ways;
+    tlb->i32NumSets    = i32NumEntries / i32Ways;
+    tlb->i32NumAsids   = i32NumAsids;
+
+    tlb->entries = calloc((uint64_t)tlb->i32NumSets * i32Ways, sizeof(struct TLBEntry));
+    if (i32NumAsids > 0)
+    {
+        tlb->asidOwner   = malloc(i32NumAsids * sizeof(int32_t));
+        tlb->asidLastUse = calloc(i32NumAsids, sizeof(uint64_t));
+        if (tlb->asidOwner)
+            for (uint32_t a = 0; a < i32NumAsids; a++) tlb->asidOwner[a] = -1;
+    }
+    if (!tlb->entries || (i32NumAsids > 0 && (!tlb->asidOwner || !tlb->asidLastUse)))
+    {
+        fprintf(stderr, "Failed to allocate TLB\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void freeTLB(struct TLB *tlb)
+{
+    free(tlb->entries);
+    free(tlb->asidOwner);
+    free(tlb->asidLastUse);
+    memset(tlb, 0, sizeof(*tlb));
+}
+
+void tlbFlush(struct TLB *tlb)
+{
+    uint64_t n = (uint64_t)tlb->i32NumSets * tlb->i32Ways;
+    for (uint64_t i = 0; i < n; i++) tlb->entries[i].i8Valid = 0;
+    tlb->i64Flushes++;
+}
+
+static void tlbFlushAsid(struct TLB *tlb, uint16_t i16Asid)
+{
+    uint64_t n = (uint64_t)tlb->i32NumSets * tlb->i32Ways;
+    for (uint64_t i = 0; i < n; i++)
+        if (tlb->entries[i].i16Asid == i16Asid) tlb->entries[i].i8Valid = 0;
+}
+
+bool tlbActivate(struct TLB *tlb, struct VM *vm)
+{
+    if (tlb->i32NumAsids == 0) return false;
+
+    tlb->i64Tick++;
+    uint32_t i32Victim = 0;
+    for (uint32_t a = 0; a < tlb->i32NumAsids; a++)
+    {
+        if (tlb->asidOwner[a] == (int32_t)vm->i16ProcessId)
+        {
+            tlb->asidLastUse[a] = tlb->i64Tick;
+            vm->i16Asid = (uint16_t)a;
+            return false;
+        }
+        if (tlb->asidOwner[a] < 0 ||
+            (tlb->asidOwner[i32Victim] >= 0 && tlb->asidLastUse[a] < tlb->asidLastUse[i32Victim]))
+        {
+            i32Victim = a;
+        }
+    }
+
+    // no ASID of its own: take a free one or the least recently run
+    bool bFlushed = false;
+    if (tlb->asidOwner[i32Victim] >= 0)
+    {
+        tlbFlushAsid(tlb, (uint16_t)i32Victim);
+        tlb->i64AsidRecycles++;
+        bFlushed = true;
+    }
+    tlb->asidOwner[i32Victim]   = vm->i16ProcessId;
+    tlb->asidLastUse[i32Victim] = tlb->i64Tick;
+    vm->i16Asid = (uint16_t)i32Victim;
+    return bFlushed;
+}
+
+/* shootdown of a single translation when its frame goes away */
+static void tlbInvalidatePage(struct TLB *tlb, uint16_t i16Asid, uint64_t vpn)
+{
+    struct TLBEntry *set = &tlb->entries[(vpn % tlb->i32NumSets) * tlb->i32Ways];
+    for (uint32_t w = 0; w < tlb->i32Ways; w++)
+        if (set[w].i8Valid && set[w].i16Asid == i16Asid && set[w].i64VirtualPage == vpn)
+            set[w].i8Valid = 0;
+}
+
+/* returns true on a TLB hit, fills the entry on a miss */
+static bool tlbLookup(struct TLB *tlb, struct VM *vm, uint64_t vpn, uint64_t i64Frame)
+{
+    struct TLBEntry *set = &tlb->entries[(vpn % tlb->i32NumSets) * tlb->i32Ways];
+    tlb->i64Tick++;
+
+    uint32_t i32Victim = 0;
+    for (uint32_t w = 0; w < tlb->i32Ways; w++)
+    {
+        if (set[w].i8Valid && set[w].i16Asid == vm->i16Asid && set[w].i64VirtualPage == vpn)
+        {
+            set[w].i64Tick = tlb->i64Tick;
+            tlb->i64Hits++;
+            return true;
+        }
+        if (!set[w].i8Valid ||
+            (set[i32Victim].i8Valid && set[w].i64Tick < set[i32Victim].i64Tick))
+        {
+            i32Victim = w;
+        }
+    }
+
+    tlb->i64Misses++;
+    set[i32Victim].i8Valid        = 1;
+    set[i32Victim].i16Asid        = vm->i16Asid;
+    set[i32Victim].i64VirtualPage = vpn;
+    set[i32Victim].i64FrameNumber = i64Frame;
+    set[i32Victim].i64Tick        = tlb->i64Tick;
+    return false;
+}
+
+PageReplPolicy page_repl_from_string(const char *sPolicyCode)
+{
+    if (strcmp(sPolicyCode, "fifo") == 0)    return PR_FIFO;
+    if (strcmp(sPolicyCode, "sc") == 0)      return PR_SECOND_CHANCE;
+    if (strcmp(sPolicyCode, "clock") == 0)   return PR_CLOCK;
+    if (strcmp(sPolicyCode, "wsclock") == 0) return PR_WSCLOCK;
+    if (strcmp(sPolicyCode, "aging") == 0)   return PR_AGING;
+    if (strcmp(sPolicyCode, "lfu") == 0)     return PR_LFU;
+    if (strcmp(sPolicyCode, "opt") == 0)     return PR_OPT;
+    return PR_LRU; // default
+}
+
+const char *page_repl_name(PageReplPolicy policy)
+{
+    switch (policy)
+    {
+        case PR_FIFO:          return "FIFO";
+        case PR_SECOND_CHANCE: return "Second Chance";
+        case PR_CLOCK:         return "Clock";
+        case PR_WSCLOCK:       return "WSClock";
+        case PR_AGING:         return "Aging";
+        case PR_LFU:           return "Least Frequently Used";
+        case PR_OPT:           return "Optimal (Belady)";
+        default:               return "Least Recently Used";
+    }
+}
+
+void setPageReplPolicy(struct PhysicalMemory *pm,
+                       PageReplPolicy policy,
+                       PageReplScope scope,
+                       uint64_t i64WsWindow)
+{
+    pm->replPolicy  = policy;
+    pm->replScope   = scope;
+    pm->i64WsWindow = i64WsWindow ? i64WsWindow : WSCLOCK_DEFAULT_WINDOW;
+
+    // one sweep over the frames per period keeps aging amortised O(1)
+    pm->i64AgingPeriod = pm->i64NumFramesUsable > PAGE_AGING_PERIOD
+                         ? pm->i64NumFramesUsable : PAGE_AGING_PERIOD;
+
+    free(pm->lfuBuckets);
+    pm->lfuBuckets = NULL;
+    pm->i32LfuFree = FRAME_NIL;
+    if (policy == PR_LFU)
+    {
+        // every bucket holds a frame, plus one being created during a move
+        uint64_t i64NumBuckets = pm->i64NumFramesUsable + 2;
+        pm->lfuBuckets = calloc(i64NumBuckets, sizeof(struct LfuBucket));
+        if (!pm->lfuBuckets)
+        {
+            fprintf(stderr, "Failed to allocate LFU buckets\n");
+            exit(EXIT_FAILURE);
+        }
+        for (uint64_t b = i64NumBuckets; b-- > 0; )
+        {
+            pm->lfuBuckets[b].i32Next = pm->i32LfuFree;
+            pm->i32LfuFree = (uint32_t)b;
+        }
+    }
+}
+
+void setPageOptTrace(struct PhysicalMemory *pm,
+                     const uint64_t *i64Keys,
+                     uint64_t i64NumKeys)
+{
+    free(pm->i64NextUse);
+    pm->i64NextUse = malloc((i64NumKeys ? i64NumKeys : 1) * sizeof(uint64_t));
+    pm->i64NumRefs = i64NumKeys;
+    pm->i64RefPos  = 0;
+
+    // last position of each key seen so far, walking backwards; keys are stored +1 so 0 is empty
+    uint64_t i64Cap = 1024, i64Used = 0;
+    uint64_t *i64Slots = calloc(2 * i64Cap, sizeof(uint64_t));
+    if (!pm->i64NextUse || !i64Slots)
+    {
+        fprintf(stderr, "Failed to allocate OPT next-use index\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (uint64_t i = i64NumKeys; i-- > 0; )
+    {
+        if (2 * (i64Used + 1) > i64Cap)
+        {
+            uint64_t i64NewCap = i64Cap * 2;
+            uint64_t *i64NewSlots = calloc(2 * i64NewCap, sizeof(uint64_t));
+            if (!i64NewSlots)
+            {
+                fprintf(stderr, "Failed to allocate OPT next-use index\n");
+                exit(EXIT_FAILURE);
+            }
+            for (uint64_t k = 0; k < i64Cap; k++)
+            {
+                if (!i64Slots[2 * k]) continue;
+                uint64_t h = (i64Slots[2 * k] * 0x9E3779B97F4A7C15ULL) & (i64NewCap - 1);
+                while (i64NewSlots[2 * h]) h = (h + 1) & (i64NewCap - 1);
+                i64NewSlots[2 * h]     = i64Slots[2 * k];
+                i64NewSlots[2 * h + 1] = i64Slots[2 * k + 1];
+            }
+            free(i64Slots);
+            i64Slots = i64NewSlots;
+            i64Cap   = i64NewCap;
+        }
+
+        uint64_t i64Key = i64Keys[i] + 1;
+        uint64_t h = (i64Key * 0x9E3779B97F4A7C15ULL) & (i64Cap - 1);
+        while (i64Slots[2 * h] && i64Slots[2 * h] != i64Key) h = (h + 1) & (i64Cap - 1);
+        if (i64Slots[2 * h])
+        {
+            pm->i64NextUse[i] = i64Slots[2 * h + 1];
+        }
+        else
+        {
+            pm->i64NextUse[i] = UINT64_MAX;     // never used again
+            i64Slots[2 * h] = i64Key;
+            i64Used++;
+        }
+        i64Slots[2 * h + 1] = i;
+    }
+    free(i64Slots);
+}
+
+void setFaultModel(struct PhysicalMemory *pm, const struct FaultModel *model)
+{
+    pm->faultModel = *model;
+}
+
+/* queue one page transfer on the swap device, returns the cycle it completes */
+static uint64_t swapTransfer(struct PhysicalMemory *pm)
+{
+    const struct FaultModel *fm = &pm->faultModel;
+    uint64_t i64Service = fm->i32SwapLatency;
+    if (fm->i32SwapBytesPerCycle)
+        i64Service += (pm->i32PageBytes + fm->i32SwapBytesPerCycle - 1) / fm->i32SwapBytesPerCycle;
+
+    uint64_t i64Start = pm->i64SwapFreeAt > pm->i64Now ? pm->i64SwapFreeAt : pm->i64Now;
+    pm->i64SwapFreeAt = i64Start + i64Service;
+    return pm->i64SwapFreeAt;
+}
+
+static struct ReplDomain *replDomainOf(struct PhysicalMemory *pm, uint16_t i16Pid)
+{
+    if (pm->replScope == PR_LOCAL && i16Pid < pm->iNumVMs)
+        return &pm->vms[i16Pid].replDomain;
+    return &pm->replDomain;
+}
+
+/* ---- intrusive frame lists ---- */
+
+static void listUnlink(struct PhysicalMemory *pm, uint32_t *pHead, uint32_t *pTail, uint32_t i)
+{
+    struct Frame *f = &pm->frames[i];
+    if (f->i32Prev != FRAME_NIL) pm->frames[f->i32Prev].i32Next = f->i32Next;
+    else                         *pHead = f->i32Next;
+    if (f->i32Next != FRAME_NIL) pm->frames[f->i32Next].i32Prev = f->i32Prev;
+    else                         *pTail = f->i32Prev;
+    f->i32Prev = FRAME_NIL;
+    f->i32Next = FRAME_NIL;
+}
+
+// insert before frame i32Before, FRAME_NIL appends at the tail
+static void listInsertBefore(struct PhysicalMemory *pm, uint32_t *pHead, uint32_t *pTail,
+                             uint32_t i, uint32_t i32Before)
+{
+    struct Frame *f = &pm->frames[i];
+    f->i32Next = i32Before;
+    f->i32Prev = (i32Before == FRAME_NIL) ? *pTail : pm->frames[i32Before].i32Prev;
+    if (f->i32Prev != FRAME_NIL) pm->frames[f->i32Prev].i32Next = i;
+    else                         *pHead = i;
+    if (i32Before != FRAME_NIL)  pm->frames[i32Before].i32Prev = i;
+    else                         *pTail = i;
+}
+
+// clock hand successor, wrapping around
+static uint32_t clockNext(struct PhysicalMemory *pm, struct ReplDomain *d, uint32_t i)
+{
+    uint32_t n = pm->frames[i].i32Next;
+    return n != FRAME_NIL ? n : d->i32Head;
+}
+
+/* ---- LFU: O(1) frequency buckets ---- */
+
+static uint32_t lfuNewBucket(struct PhysicalMemory *pm, struct ReplDomain *d,
+                             uint64_t i64Count, uint32_t i32After)
+{
+    struct LfuBucket *bk = pm->lfuBuckets;
+    uint32_t b = pm->i32LfuFree;
+    pm->i32LfuFree = bk[b].i32Next;
+
+    bk[b].i64Count = i64Count;
+    bk[b].i32Head  = FRAME_NIL;
+    bk[b].i32Tail  = FRAME_NIL;
+    bk[b].i32Prev  = i32After;
+    bk[b].i32Next  = (i32After == FRAME_NIL) ? d->i32Bucket : bk[i32After].i32Next;
+    if (i32After != FRAME_NIL) bk[i32After].i32Next = b;
+    else                       d->i32Bucket = b;
+    if (bk[b].i32Next != FRAME_NIL) bk[bk[b].i32Next].i32Prev = b;
+    return b;
+}
+
+static void lfuDropIfEmpty(struct PhysicalMemory *pm, struct ReplDomain *d, uint32_t b)
+{
+    struct LfuBucket *bk = pm->lfuBuckets;
+    if (bk[b].i32Head != FRAME_NIL) return;
+    if (bk[b].i32Prev != FRAME_NIL) bk[bk[b].i32Prev].i32Next = bk[b].i32Next;
+    else                            d->i32Bucket = bk[b].i32Next;
+    if (bk[b].i32Next != FRAME_NIL) bk[bk[b].i32Next].i32Prev = bk[b].i32Prev;
+    bk[b].i32Next = pm->i32LfuFree;
+    pm->i32LfuFree = b;
+}
+
+static void lfuMove(struct PhysicalMemory *pm, uint32_t i, uint32_t b)
+{
+    struct LfuBucket *k = &pm->lfuBuckets[b];
+    listInsertBefore(pm, &k->i32Head, &k->i32Tail, i, FRAME_NIL);
+    pm->frames[i].i64ReplKey = b;
+}
+
+/* ---- OPT: max-heap on next use ---- */
+
+static bool optAbove(struct PhysicalMemory *pm, uint32_t a, uint32_t b)
+{
+    uint64_t ka = pm->frames[a].i64ReplKey, kb = pm->frames[b].i64ReplKey;
+    return ka > kb || (ka == kb && a < b);
+}
+
+static void optSwap(struct PhysicalMemory *pm, struct ReplDomain *d, uint64_t x, uint64_t y)
+{
+    uint32_t a = d->i32Heap[x], b = d->i32Heap[y];
+    d->i32Heap[x] = b; pm->frames[b].i32HeapPos = (uint32_t)x;
+    d->i32Heap[y] = a; pm->frames[a].i32HeapPos = (uint32_t)y;
+}
+
+static void optSift(struct PhysicalMemory *pm, struct ReplDomain *d, uint64_t x)
+{
+    while (x > 0 && optAbove(pm, d->i32Heap[x], d->i32Heap[(x - 1) / 2]))
+    {
+        optSwap(pm, d, x, (x - 1) / 2);
+        x = (x - 1) / 2;
+    }
+    for (;;)
+    {
+        uint64_t l = 2 * x + 1, r = l + 1, m = x;
+        if (l < d->i64Count && optAbove(pm, d->i32Heap[l], d->i32Heap[m])) m = l;
+        if (r < d->i64Count && optAbove(pm, d->i32Heap[r], d->i32Heap[m])) m = r;
+        if (m == x) break;
+        optSwap(pm, d, x, m);
+        x = m;
+    }
+}
+
+/* ---- aging: lazy tick, then a counting sort of the domain list ---- */
+
+static void ageDomain(struct PhysicalMemory *pm, struct ReplDomain *d)
+{
+    uint64_t i64Epoch = pm->i64Tick / pm->i64AgingPeriod;
+    if (i64Epoch == d->i64AgedEpoch) return;
+    uint64_t i64Shift = i64Epoch - d->i64AgedEpoch;
+    d->i64AgedEpoch = i64Epoch;
+
+    // ticks missed since the last fault fold into one shift
+    uint32_t i32Head[256], i32Tail[256];
+    for (int k = 0; k < 256; k++) i32Head[k] = i32Tail[k] = FRAME_NIL;
+
+    uint32_t i = d->i32Head;
+    while (i != FRAME_NIL)
+    {
+        struct Frame *f = &pm->frames[i];
+        uint32_t n = f->i32Next;
+        f->i64ReplKey = (i64Shift >= 8) ? 0 : (f->i64ReplKey >> i64Shift);
+        if (f->i8Flags & FLAG_REFERENCED) f->i64ReplKey |= 0x80;
+        f->i8Flags &= ~FLAG_REFERENCED;
+        f->i32Prev = f->i32Next = FRAME_NIL;
+        listInsertBefore(pm, &i32Head[f->i64ReplKey], &i32Tail[f->i64ReplKey], i, FRAME_NIL);
+        i = n;
+    }
+
+    // smallest counter first, load order among equals
+    d->i32Head = d->i32Tail = FRAME_NIL;
+    for (int k = 0; k < 256; k++)
+    {
+        if (i32Head[k] == FRAME_NIL) continue;
+        if (d->i32Tail == FRAME_NIL) d->i32Head = i32Head[k];
+        else
+        {
+            pm->frames[d->i32Tail].i32Next = i32Head[k];
+            pm->frames[i32Head[k]].i32Prev = d->i32Tail;
+        }
+        d->i32Tail = i32Tail[k];
+    }
+}
+
+/* ---- policy dispatch ---- */
+
+static void replInsert(struct PhysicalMemory *pm, struct ReplDomain *d, uint32_t i)
+{
+    struct Frame *f = &pm->frames[i];
+    f->i32Prev    = FRAME_NIL;
+    f->i32Next    = FRAME_NIL;
+    f->i64ReplKey = 0;
+
+    switch (pm->replPolicy)
+    {
+        case PR_CLOCK:
+        case PR_WSCLOCK:
+            // new pages go right behind the hand
+            listInsertBefore(pm, &d->i32Head, &d->i32Tail, i, d->i32Hand);
+            break;
+        case PR_LFU:
+        {
+            uint32_t b = d->i32Bucket;
+            if (b == FRAME_NIL || pm->lfuBuckets[b].i64Count != 0)
+                b = lfuNewBucket(pm, d, 0, FRAME_NIL);
+            lfuMove(pm, i, b);
+            break;
+        }
+        case PR_OPT:
+            if (d->i64Count == d->i64HeapCap)
+            {
+                d->i64HeapCap = d->i64HeapCap ? d->i64HeapCap * 2 : 64;
+                d->i32Heap = realloc(d->i32Heap, d->i64HeapCap * sizeof(uint32_t));
+                if (!d->i32Heap)
+                {
+                    fprintf(stderr, "Failed to allocate OPT heap\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            d->i32Heap[d->i64Count] = i;
+            f->i32HeapPos = (uint32_t)d->i64Count;
+            d->i64Count++;
+            optSift(pm, d, f->i32HeapPos);
+            return;
+        default:
+            listInsertBefore(pm, &d->i32Head, &d->i32Tail, i, FRAME_NIL);
+            break;
+    }
+    d->i64Count++;
+}
+
+static void replRemove(struct PhysicalMemory *pm, struct ReplDomain *d, uint32_t i)
+{
+    struct Frame *f = &pm->frames[i];
+
+    switch (pm->replPolicy)
+    {
+        case PR_LFU:
+        {
+            uint32_t b = (uint32_t)f->i64ReplKey;
+            struct LfuBucket *k = &pm->lfuBuckets[b];
+            listUnlink(pm, &k->i32Head, &k->i32Tail, i);
+            lfuDropIfEmpty(pm, d, b);
+            break;
+        }
+        case PR_OPT:
+        {
+            uint64_t x = f->i32HeapPos;
+            d->i64Count--;
+            if (x < d->i64Count)
+            {
+                d->i32Heap[x] = d->i32Heap[d->i64Count];
+                pm->frames[d->i32Heap[x]].i32HeapPos = (uint32_t)x;
+                optSift(pm, d, x);
+            }
+            return;
+        }
+        default:
+            if (d->i32Hand == i)
+            {
+                uint32_t n = clockNext(pm, d, i);
+                d->i32Hand = (n == i) ? FRAME_NIL : n;
+            }
+            listUnlink(pm, &d->i32Head, &d->i32Tail, i);
+            break;
+    }
+    d->i64Count--;
+}
+
+// bookkeeping for a translation that used frame i
+static void replTouch(struct PhysicalMemory *pm, struct ReplDomain *d, uint32_t i, uint64_t i64RefPos)
+{
+    struct Frame *f = &pm->frames[i];
+    f->i8Flags |= FLAG_REFERENCED;
+
+    switch (pm->replPolicy)
+    {
+        case PR_LRU:
+            if (d->i32Tail != i)
+            {
+                listUnlink(pm, &d->i32Head, &d->i32Tail, i);
+                listInsertBefore(pm, &d->i32Head, &d->i32Tail, i, FRAME_NIL);
+            }
+            break;
+        case PR_LFU:
+        {
+            uint32_t b = (uint32_t)f->i64ReplKey;
+            struct LfuBucket *k = &pm->lfuBuckets[b];
+            uint32_t nb = k->i32Next;
+            if (nb == FRAME_NIL || pm->lfuBuckets[nb].i64Count != k->i64Count + 1)
+                nb = lfuNewBucket(pm, d, k->i64Count + 1, b);
+            listUnlink(pm, &k->i32Head, &k->i32Tail, i);
+            lfuMove(pm, i, nb);
+            lfuDropIfEmpty(pm, d, b);
+            break;
+        }
+        case PR_OPT:
+            f->i64ReplKey = (i64RefPos < pm->i64NumRefs) ? pm->i64NextUse[i64RefPos] : UINT64_MAX;
+            optSift(pm, d, f->i32HeapPos);
+            break;
+        default:
+            break;
+    }
+}
+
+static uint32_t selectVictimFrame(struct PhysicalMemory *pm, struct ReplDomain *d)
+{
+    switch (pm->replPolicy)
+    {
+        case PR_SECOND_CHANCE:
+            // each pass over a referenced page clears its bit, so this ends within one lap
+            for (;;)
+            {
+                uint32_t i = d->i32Head;
+                struct Frame *f = &pm->frames[i];
+                if (!(f->i8Flags & FLAG_REFERENCED)) return i;
+                f->i8Flags &= ~FLAG_REFERENCED;
+                listUnlink(pm, &d->i32Head, &d->i32Tail, i);
+                listInsertBefore(pm, &d->i32Head, &d->i32Tail, i, FRAME_NIL);
+            }
+        case PR_CLOCK:
+        {
+            if (d->i32Hand == FRAME_NIL) d->i32Hand = d->i32Head;
+            for (;;)
+            {
+                struct Frame *f = &pm->frames[d->i32Hand];
+                if (!(f->i8Flags & FLAG_REFERENCED)) return d->i32Hand;
+                f->i8Flags &= ~FLAG_REFERENCED;
+                d->i32Hand = clockNext(pm, d, d->i32Hand);
+            }
+        }
+        case PR_WSCLOCK:
+        {
+            if (d->i32Hand == FRAME_NIL) d->i32Hand = d->i32Head;
+            uint32_t i32Clean = FRAME_NIL;
+            for (uint64_t k = 0; k < d->i64Count; k++)
+            {
+                uint32_t i = d->i32Hand;
+                struct Frame *f = &pm->frames[i];
+                if (f->i8Flags & FLAG_REFERENCED)
+                {
+                    f->i8Flags &= ~FLAG_REFERENCED;
+                }
+                else if (pm->i64Tick - f->i64Tick > pm->i64WsWindow)
+                {
+                    // out of the working set: evict if clean, else start writing it out
+                    if (!(f->i8Flags & FLAG_DIRTY)) return i;
+                    f->i8Flags &= ~FLAG_DIRTY;
+                    pm->i64PageCleanings++;
+                    pm->i64SwapWrites++;
+                    swapTransfer(pm);       // written in the background
+                }
+                else if (i32Clean == FRAME_NIL && !(f->i8Flags & FLAG_DIRTY))
+                {
+                    i32Clean = i;
+                }
+                d->i32Hand = clockNext(pm, d, i);
+            }
+            // whole working set resident: oldest clean page seen, else the hand
+            return i32Clean != FRAME_NIL ? i32Clean : d->i32Hand;
+        }
+        case PR_AGING:
+            ageDomain(pm, d);
+            return d->i32Head;
+        case PR_LFU:
+            return pm->lfuBuckets[d->i32Bucket].i32Head;
+        case PR_OPT:
+            return d->i32Heap[0];
+        default:
+            // LRU and FIFO keep the victim at the head
+            return d->i32Head;
+    }
+}
+
+// local scope takes from the faulting process unless it holds no frames
+static struct ReplDomain *victimDomain(struct PhysicalMemory *pm, struct VM *vm)
+{
+    if (pm->replScope != PR_LOCAL || pm->iNumVMs == 0) return &pm->replDomain;
+    if (vm->replDomain.i64Count > 0) return &vm->replDomain;
+
+    struct ReplDomain *d = &vm->replDomain;
+    for (int i = 0; i < pm->iNumVMs; i++)
+        if (pm->vms[i].replDomain.i64Count > d->i64Count) d = &pm->vms[i].replDomain;
+    pm->i64LocalSteals++;
+    return d;
+}
+
+static void recordReference(struct PhysicalMemory *pm, struct VM *vm, uint64_t vpn)
+{
+    if (pm->i64NumRefKeys == pm->i64RefKeysCap)
+    {
+        pm->i64RefKeysCap = pm->i64RefKeysCap ? pm->i64RefKeysCap * 2 : (1u << 16);
+        pm->i64RefKeys = realloc(pm->i64RefKeys, pm->i64RefKeysCap * sizeof(uint64_t));
+        if (!pm->i64RefKeys)
+        {
+            fprintf(stderr, "Failed to allocate reference log\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    pm->i64RefKeys[pm->i64NumRefKeys++] = ((uint64_t)vm->i16ProcessId << 48) | vpn;
+}
+
+/* the page is in the frame its PTE points at */
+static bool pageResident(struct PhysicalMemory *pm, struct VM *vm, const struct PTE *pte, uint64_t vpn)
+{
+    if (!(pte->i8Flags & FLAG_VALID)) return false;
+    uint64_t i64FrameIndex = pte->i64FrameNumber;
+    if (i64FrameIndex >= pm->i64NumFramesUsable) return false;
+    const struct Frame *f = &pm->frames[i64FrameIndex];
+    return (f->i8Flags & FLAG_VALID) &&
+           f->i16ProcessId == vm->i16ProcessId &&
+           f->i64VirtualPage == vpn;
+}
+
+/* TLB, replacement and dirty state of a resident page; returns the physical address */
+static uint64_t finishTranslation(struct PhysicalMemory *pm, struct VM *vm, struct PTE *pte,
+                                  uint64_t vpn, uint64_t offset, uint64_t i64GlobalTick,
+                                  uint64_t i64RefPos, bool isWrite)
+{
+    // TLB: the walk above is the page walk a miss would have to pay for
+    if (pm->tlb)
+    {
+        if (tlbLookup(pm->tlb, vm, vpn, pte->i64FrameNumber))
+        {
+            vm->i64TlbHits++;
+        }
+        else
+        {
+            vm->i64TlbMisses++;
+            pm->i64TranslateCycles += TLB_MISS_CYCLES;
+        }
+    }
+
+    // Update access info
+    struct Frame *frame = &pm->frames[pte->i64FrameNumber];
+    frame->i64Tick = i64GlobalTick;
+    pte->i64Tick   = i64GlobalTick;
+    replTouch(pm, replDomainOf(pm, vm->i16ProcessId), (uint32_t)pte->i64FrameNumber, i64RefPos);
+    if (isWrite) 
+    {
+        frame->i8Flags |= FLAG_DIRTY;
+        pte->i8Flags   |= FLAG_DIRTY;
+    }
+
+    return (pte->i64FrameNumber * vm->i32PageBytes) + offset;
 }
 
 uint64_t translateAddress(struct VM *vm,
@@ -107,76 +1015,99 @@ uint64_t translateAddress(struct VM *vm,
                           bool isWrite)
 {
     struct PhysicalMemory *pm = vm->pm;
+    PROF_BEGIN(PROF_TRANSLATE);
     pm->i64NumAccesses++;
-    uint64_t i64GlobalTick = pm->i64NumAccesses;
+    vm->i64NumAccesses++;
+    uint64_t i64GlobalTick = ++pm->i64Tick;
+    uint64_t i64RefPos = pm->i64RefPos++;       // position in the OPT reference string
 
     uint64_t i64OffsetMask = (1ULL << vm->i32OffsetBits) - 1ULL;
     uint64_t vpn = virtualAddress >> vm->i32OffsetBits;
     uint64_t offset = virtualAddress & i64OffsetMask;
 
-    struct PTE *pte = &vm->pageTable[vpn];
+    if (pm->bRecordRefs) recordReference(pm, vm, vpn);
 
-    bool bHit = false;
-    if (pte->i8Flags & FLAG_VALID) 
-    {
-        uint64_t i64FrameIndex = pte->i64FrameNumber;
-        if (i64FrameIndex < pm->i64NumFramesUsed) 
-        {
-            struct Frame *f = &pm->frames[i64FrameIndex];
-            if ((f->i8Flags & FLAG_VALID) &&
-                 f->i16ProcessId == vm->i16ProcessId &&
-                 f->i64VirtualPage == vpn) 
-            {
-                bHit = true;
-            }
-        }
-    }
+    struct PTE *pte = lookupPTE(vm, vpn, true);
 
     // Miss | Allocate from Free or Evict
-    if (!bHit) {
+    if (!pageResident(pm, vm, pte, vpn)) {
+        bool bMajor = (pte->i8Flags & FLAG_ON_DISK) != 0;
+        uint64_t i64StallUntil = pm->i64Now;
 
-        uint64_t i64FrameIndex = UINT64_MAX;
+        // Allocate from Free (placement decided by the frame allocation policy)
+        uint64_t i64FrameIndex = allocateFreeFrame(pm, vm, vpn);
 
-        if (pm->i64NumFramesUsed < pm->i64NumFramesUsable) 
+        if (i64FrameIndex != UINT64_MAX) 
         {
-            // Allocate from Free
-            i64FrameIndex = pm->i64NumFramesUsed++;
             pm->i64PagesFromFree++;
+            vm->i64PagesFromFree++;
         } 
         else 
         {
-            // Try to find a truly free (invalid) frame first.
-            for (uint64_t i = 0; i < pm->i64NumFramesUsable; i++) 
+            // No free frame left → must evict (replacement policy)
+            struct ReplDomain *d = victimDomain(pm, vm);
+            i64FrameIndex = selectVictimFrame(pm, d);
+            replRemove(pm, d, (uint32_t)i64FrameIndex);
+            pm->i64NumEvictions++;
+            struct Frame *victim = &pm->frames[i64FrameIndex];
+            if (victim->i16ProcessId < pm->iNumVMs)
+                pm->vms[victim->i16ProcessId].i64NumEvicted++;
+
+            // the old owner's page now lives on disk; a dirty one is written out first
+            if (victim->i16ProcessId < pm->iNumVMs)
             {
-                if (!(pm->frames[i].i8Flags & FLAG_VALID)) 
-                {
-                    i64FrameIndex = i;
-                    pm->i64PagesFromFree++;
-                    break;
-                }
+                struct PTE *old = lookupPTE(&pm->vms[victim->i16ProcessId], victim->i64VirtualPage, false);
+                if (old) old->i8Flags |= FLAG_ON_DISK;
             }
-
-            // Case 3: No invalid frame found → must evict LRU
-            if (i64FrameIndex == UINT64_MAX) 
+            // Avisar al caché: esta página física se va. Its dirty lines
+            // reach memory before the page is written out
+            if (pm->cache) {
+                uint64_t physBase = i64FrameIndex * vm->i32PageBytes;
+                uint64_t i64Writebacks = pm->cache->writebacks;
+                pm->cache->now = pm->i64Now;
+                cacheInvalidateRange(pm->cache, physBase, vm->i32PageBytes);
+                pm->i64EvictWritebacks += pm->cache->writebacks - i64Writebacks;
+            }
+            if (victim->i8Flags & FLAG_DIRTY)
             {
-                i64FrameIndex = selectVictimFrameLRU(pm);
-                struct Frame *victim = &pm->frames[i64FrameIndex];
+                pm->i64SwapWrites++;
+                i64StallUntil = swapTransfer(pm);
+                pm->i64SwapOutCycles += i64StallUntil - pm->i64Now;
+            }
 
-                // invalidar frame
-                victim->i8Flags &= ~FLAG_VALID;
+            // invalidar frame
+            victim->i8Flags &= ~FLAG_VALID;
 
-                // Avisar al caché: esta página física se va
-                if (pm->cache) {
-                    uint64_t physBase = i64FrameIndex * vm->i32PageBytes;
-                    cacheInvalidateRange(pm->cache, physBase, vm->i32PageBytes);
-                }
+            // drop the stale translation of the old owner
+            if (pm->tlb && victim->i16ProcessId < pm->iNumVMs)
+                tlbInvalidatePage(pm->tlb, pm->vms[victim->i16ProcessId].i16Asid, victim->i64VirtualPage);
 
-                // Page fault global y por VM
-                vm->i64NumPageFaults++;
-                pm->i64NumPageFaults++;
-            }
 
+            // Page fault global y por VM
+            vm->i64NumPageFaults++;
+            pm->i64NumPageFaults++;
+        }
+
+        // fault service: handling, then the swap read for a major fault
+        uint64_t i64Stall = pm->faultModel.i32MinorCycles;
+        if (bMajor)
+        {
+            pm->i64MajorFaults++;
+            vm->i64MajorFaults++;
+            pm->i64SwapReads++;
+            uint64_t i64ReadDone = swapTransfer(pm);
+            pm->i64SwapInCycles += i64ReadDone - i64StallUntil;
+            i64StallUntil = i64ReadDone;
         }
+        else
+        {
+            pm->i64MinorFaults++;
+            vm->i64MinorFaults++;
+        }
+        i64Stall += i64StallUntil - pm->i64Now;
+        pm->i64MinorFaultCycles += pm->faultModel.i32MinorCycles;
+        pm->i64FaultCycles      += i64Stall;
+        vm->i64FaultCycles      += i64Stall;
 
         struct Frame *frame     = &pm->frames[i64FrameIndex];
         frame->i64VirtualPage   = vpn;
@@ -187,24 +1118,62 @@ uint64_t translateAddress(struct VM *vm,
         pte->i64FrameNumber     = i64FrameIndex;
         pte->i8Flags            = FLAG_VALID;
         pte->i64Tick            = i64GlobalTick;
-    }
 
-    // Update access info
-    struct Frame *frame = &pm->frames[pte->i64FrameNumber];
-    frame->i64Tick = i64GlobalTick;
-    pte->i64Tick   = i64GlobalTick;
-    if (isWrite) 
+        replInsert(pm, replDomainOf(pm, vm->i16ProcessId), (uint32_t)i64FrameIndex);
+    }
+    else
     {
-        frame->i8Flags |= FLAG_DIRTY;
-        pte->i8Flags   |= FLAG_DIRTY;
+        vm->i64PageTableHits++;
     }
 
-    uint64_t physAddr = (pte->i64FrameNumber * vm->i32PageBytes) + offset;
+    uint64_t physAddr = finishTranslation(pm, vm, pte, vpn, offset, i64GlobalTick, i64RefPos, isWrite);
+    PROF_END();
     return physAddr;
 }
 
+uint32_t translateBatch(struct VM *vm,
+                        uint32_t i32Count,
+                        const uint64_t *i64ArrVirtual,
+                        const uint8_t *i8ArrIsWrite,
+                        uint64_t *i64ArrPhys,
+                        uint32_t *i32ArrStall)
+{
+    struct PhysicalMemory *pm = vm->pm;
+    PROF_BEGIN(PROF_TRANSLATE);
+    uint64_t i64OffsetMask = (1ULL << vm->i32OffsetBits) - 1ULL;
+    uint64_t i64LeafMask   = (1ULL << vm->i32LeafBits) - 1ULL;
+
+    uint32_t n = 0;
+    for (; n < i32Count; n++) {
+        // the PTE a few accesses ahead, so its line is in by the time it is walked
+        if (n + TRANSLATE_PREFETCH_AHEAD < i32Count) {
+            uint64_t i64Ahead = i64ArrVirtual[n + TRANSLATE_PREFETCH_AHEAD] >> vm->i32OffsetBits;
+            const struct PTE *leaf = vm->pageDir[i64Ahead >> vm->i32LeafBits];
+            if (leaf) PREFETCH(&leaf[i64Ahead & i64LeafMask]);
+        }
+
+        uint64_t vpn = i64ArrVirtual[n] >> vm->i32OffsetBits;
+        struct PTE *pte = lookupPTE(vm, vpn, false);
+        if (!pte || !pageResident(pm, vm, pte, vpn)) break;   // faults go through translateAddress
+
+        uint64_t i64GlobalTick = ++pm->i64Tick;
+        uint64_t i64RefPos = pm->i64RefPos++;
+        if (pm->bRecordRefs) recordReference(pm, vm, vpn);
+        vm->i64PageTableHits++;
+
+        uint64_t i64StartStall = pm->i64TranslateCycles;
+        i64ArrPhys[n] = finishTranslation(pm, vm, pte, vpn, i64ArrVirtual[n] & i64OffsetMask,
+                                          i64GlobalTick, i64RefPos, i8ArrIsWrite[n]);
+        i32ArrStall[n] = (uint32_t)(pm->i64TranslateCycles - i64StartStall);
+    }
+    pm->i64NumAccesses += n;
+    vm->i64NumAccesses += n;
+    PROF_END();
+    return n;
+}
+
 void freeFramesForProcess(struct PhysicalMemory *pm, uint16_t pid) {
-    for (uint64_t i = 0; i < pm->i64NumFramesUsed; i++) {
+    for (uint64_t i = 0; i < pm->i64NumFramesUsable; i++) {
         struct Frame *fr = &pm->frames[i];
         if ((fr->i8Flags & FLAG_VALID) && fr->i16ProcessId == pid) {
             // invalidar caché de esa página física
@@ -212,7 +1181,62 @@ void freeFramesForProcess(struct PhysicalMemory *pm, uint16_t pid) {
                 uint64_t physBase = i * pm->i32PageBytes; // ojo: nombre del campo
                 cacheInvalidateRange(pm->cache, physBase, pm->i32PageBytes);
             }
+            replRemove(pm, replDomainOf(pm, pid), (uint32_t)i);
             fr->i8Flags = 0;
+            if (pm->i64ColorBase) {
+                pushFreedFrame(pm, i);
+                pm->i64NumFramesUsed--;
+            }
         }
     }
+
+    // the process is gone: drop its translations and give back its ASID
+    if (pm->tlb && pid < pm->iNumVMs) {
+        uint16_t i16Asid = pm->vms[pid].i16Asid;
+        tlbFlushAsid(pm->tlb, i16Asid);
+        if (pm->tlb->i32NumAsids > 0 && i16Asid < pm->tlb->i32NumAsids &&
+            pm->tlb->asidOwner[i16Asid] == (int32_t)pid)
+            pm->tlb->asidOwner[i16Asid] = -1;
+    }
+}
+
+void resetMemoryStats(struct PhysicalMemory *pm)
+{
+    pm->i64NumAccesses      = 0;
+    pm->i64NumEvictions     = 0;
+    pm->i64PageCleanings    = 0;
+    pm->i64LocalSteals      = 0;
+    pm->i64NumPageFaults    = 0;
+    pm->i64PagesFromFree    = 0;
+    pm->i64TranslateCycles  = 0;
+    pm->i64MinorFaults      = 0;
+    pm->i64MajorFaults      = 0;
+    pm->i64SwapReads        = 0;
+    pm->i64SwapWrites       = 0;
+    pm->i64EvictWritebacks  = 0;
+    pm->i64FaultCycles      = 0;
+    pm->i64MinorFaultCycles = 0;
+    pm->i64SwapInCycles     = 0;
+    pm->i64SwapOutCycles    = 0;
+
+    if (pm->tlb) {
+        pm->tlb->i64Hits         = 0;
+        pm->tlb->i64Misses       = 0;
+        pm->tlb->i64Flushes      = 0;
+        pm->tlb->i64AsidRecycles = 0;
+    }
+}
+
+void resetVMStats(struct VM *vm)
+{
+    vm->i64NumPageFaults = 0;
+    vm->i64NumAccesses   = 0;
+    vm->i64PageTableHits = 0;
+    vm->i64PagesFromFree = 0;
+    vm->i64TlbHits       = 0;
+    vm->i64TlbMisses     = 0;
+    vm->i64NumEvicted    = 0;
+    vm->i64MinorFaults   = 0;
+    vm->i64MajorFaults   = 0;
+    vm->i64FaultCycles   = 0;
 }
@@ -14,8 +14,110 @@ struct PTE {
 struct Frame {
     uint64_t i64VirtualPage;  // virtual page number that owns this frame
     uint16_t i16ProcessId;    // the process that owns this frame
-    uint8_t  i8Flags;         // valid/dirty bits
+    uint8_t  i8Flags;         // valid/dirty/referenced bits
     uint64_t i64Tick;         // LRU timestamp
+
+    /* page replacement bookkeeping, see ReplDomain */
+    uint32_t i32Prev;         // neighbours in the domain list (LFU: bucket list)
+    uint32_t i32Next;
+    uint32_t i32HeapPos;      // OPT heap slot
+    uint64_t i64ReplKey;      // aging counter, LFU bucket or OPT next use
+};
+
+#define FRAME_NIL UINT32_MAX
+
+typedef enum {
+    PR_LRU,             // least recently used
+    PR_FIFO,            // oldest loaded page
+    PR_SECOND_CHANCE,   // FIFO, referenced pages go back to the tail once
+    PR_CLOCK,           // circular list with a hand, same test as second chance
+    PR_WSCLOCK,         // clock that keeps pages used within the working set window
+    PR_AGING,           // 8 bit reference history shifted every aging period
+    PR_LFU,             // fewest uses, oldest first among equals
+    PR_OPT              // farthest next use (Belady), needs setPageOptTrace
+} PageReplPolicy;
+
+typedef enum {
+    PR_GLOBAL,          // victim from any process
+    PR_LOCAL            // victim from the faulting process' own frames
+} PageReplScope;
+
+#define PAGE_AGING_PERIOD     1024      // minimum translations between aging ticks
+#define WSCLOCK_DEFAULT_WINDOW 50000    // working set window in translations
+
+/*
+ * Frames eligible as victims of one replacement decision: all frames for
+ * global scope, one process' frames for local scope. Depending on the
+ * policy the list is in recency (LRU), load (FIFO, second chance, clock,
+ * WSClock) or aging counter order, and every operation is O(1) or
+ * amortised O(1); OPT keeps a max-heap (O(log n)).
+ */
+struct ReplDomain {
+    uint32_t i32Head;
+    uint32_t i32Tail;
+    uint32_t i32Hand;           // clock hand
+    uint64_t i64Count;          // resident frames
+    uint64_t i64AgedEpoch;      // aging: last tick folded into the counters
+    uint32_t i32Bucket;         // LFU: lowest count bucket
+    uint32_t *i32Heap;          // OPT: frames by next use, farthest on top
+    uint64_t i64HeapCap;
+};
+
+/* LFU: frames with equal use count, buckets kept in increasing count */
+struct LfuBucket {
+    uint64_t i64Count;
+    uint32_t i32Prev;
+    uint32_t i32Next;
+    uint32_t i32Head;
+    uint32_t i32Tail;
+};
+
+typedef enum {
+    FA_SEQUENTIAL,      // next free frame in index order
+    FA_RANDOM,          // random free frame
+    FA_BIN_HOPPING,     // rotate over cache colors in fault order
+    FA_PAGE_COLOR       // each process gets its own range of colors
+} FrameAllocPolicy;
+
+#define TLB_MISS_CYCLES 20          // page walk cost charged on a TLB miss
+
+/*
+ * Page fault service. A minor fault maps a page never seen before (zero
+ * fill), a major fault brings back a page that was evicted and has to be
+ * read from the swap device. Evicting a dirty frame writes it out first.
+ * The swap device serves one page at a time: latency + page / bandwidth.
+ */
+struct FaultModel {
+    uint32_t i32MinorCycles;        // kernel fault handling, every fault
+    uint32_t i32SwapLatency;        // cycles to start a swap transfer
+    uint32_t i32SwapBytesPerCycle;  // 0 = transfer time not modelled
+};
+#define PT_LEAF_BITS    10          // 1024 PTEs per page table leaf
+
+struct TLBEntry {
+    uint64_t i64VirtualPage;
+    uint64_t i64FrameNumber;
+    uint16_t i16Asid;         // address space tag
+    uint8_t  i8Valid;
+    uint64_t i64Tick;         // LRU timestamp
+};
+
+struct TLB {
+    uint32_t i32NumEntries;
+    uint32_t i32Ways;
+    uint32_t i32NumSets;
+    struct TLBEntry *entries;   // [set][way]
+
+    /* ASIDs: 0 = tag entries with the process ID (unlimited tags) */
+    uint32_t i32NumAsids;
+    int32_t  *asidOwner;        // [asid] process holding it, -1 = free
+    uint64_t *asidLastUse;      // [asid] tick of last activation
+
+    uint64_t i64Tick;
+    uint64_t i64Hits;
+    uint64_t i64Misses;
+    uint64_t i64Flushes;        // full flushes
+    uint64_t i64AsidRecycles;   // ASID taken from another process
 };
 
 struct VM;
@@ -29,11 +131,45 @@ struct PhysicalMemory {
 
 
     struct Frame *frames;            
-    uint64_t i64NumFramesUsed;
+    uint64_t i64NumFramesUsed;      // frames currently handed out
+
+    /* frame allocator: frames of color k are k, k + colors, k + 2*colors, ... */
+    FrameAllocPolicy allocPolicy;
+    uint32_t i32NumColors;
+    uint32_t i32NextColor;          // bin hopping cursor
+    uint64_t *i64ColorBase;         // [color] first slot in the arrays below
+    uint64_t *i64ColorNext;         // [color] never-used frames handed out so far
+    uint64_t *i64ColorFreed;        // [color] released frames waiting in the heap
+    uint64_t *i64FrameOrder;        // never-used frames, per color, in hand-out order
+    uint64_t *i64FreedHeap;         // released frames, per color min-heap
+
+    /* page replacement */
+    PageReplPolicy replPolicy;
+    PageReplScope  replScope;
+    uint64_t i64WsWindow;           // WSClock window, translations
+    uint64_t i64AgingPeriod;        // translations per aging tick
+    struct ReplDomain replDomain;   // global scope domain
+    struct LfuBucket *lfuBuckets;
+    uint32_t i32LfuFree;            // free bucket list
+
+    /* OPT: next use of every translation, from a recorded run */
+    uint64_t *i64NextUse;
+    uint64_t i64NumRefs;
+    uint64_t i64RefPos;
 
-    /* statistics */
+    /* recording run for OPT: key (pid << 48 | vpn) of every translation */
+    bool     bRecordRefs;
+    uint64_t *i64RefKeys;
+    uint64_t i64NumRefKeys;
+    uint64_t i64RefKeysCap;
+
+    uint64_t i64Tick;               // translations so far, the clock of frame timestamps
+
+    /* statistics, zeroed by resetMemoryStats */
     uint64_t i64NumAccesses;
     uint64_t i64NumEvictions;
+    uint64_t i64PageCleanings;      // WSClock writes scheduled for old dirty pages
+    uint64_t i64LocalSteals;        // local scope victims taken from another process
     uint64_t i64NumPageFaults;
     uint64_t i64PagesFromFree;
 
@@ -41,6 +177,23 @@ struct PhysicalMemory {
     int      iNumVMs;
 
     struct Cache *cache;
+    struct TLB   *tlb;              // NULL = no TLB modelled
+
+    uint64_t i64TranslateCycles;    // stall cycles spent in translation
+
+    /* fault service, charged like i64TranslateCycles */
+    struct FaultModel faultModel;
+    uint64_t i64Now;                // current cycle, set by the simulator
+    uint64_t i64SwapFreeAt;         // cycle the swap device goes idle
+    uint64_t i64MinorFaults;
+    uint64_t i64MajorFaults;
+    uint64_t i64SwapReads;
+    uint64_t i64SwapWrites;         // dirty evictions and WSClock cleanings
+    uint64_t i64EvictWritebacks;    // dirty cache lines written back from evicted pages
+    uint64_t i64FaultCycles;        // all fault stalls
+    uint64_t i64MinorFaultCycles;   // handling part of i64FaultCycles
+    uint64_t i64SwapInCycles;       // waiting for swap reads
+    uint64_t i64SwapOutCycles;      // waiting for dirty frames to be written
 };
 
 struct VM {
@@ -54,9 +207,27 @@ struct VM {
     uint64_t i64NumVPages;          // 2^(VPN bits)
 
     uint64_t i64Tick;
+    uint16_t i16Asid;               // TLB tag, the process ID unless ASIDs are limited
+
+    /* statistics, zeroed by resetVMStats */
     uint64_t i64NumPageFaults;
+    uint64_t i64NumAccesses;        // translations requested by this process
+    uint64_t i64PageTableHits;
+    uint64_t i64PagesFromFree;
+    uint64_t i64TlbHits;
+    uint64_t i64TlbMisses;
+    uint64_t i64NumEvicted;         // own frames taken away by replacement
+    uint64_t i64MinorFaults;
+    uint64_t i64MajorFaults;
+    uint64_t i64FaultCycles;        // fault stalls of this process
+
+    struct ReplDomain replDomain;   // local scope domain
+
+    /* two level page table: leaves are allocated on first touch */
+    struct PTE  **pageDir;          // [VPN >> leaf bits] -> leaf of PTEs
+    uint32_t i32LeafBits;           // log2(PTEs per leaf)
+    uint64_t i64NumDirEntries;
 
-    struct PTE   *pageTable;        // array of PTEntries indexed by VPN
     struct PhysicalMemory *pm;      // pointer to physical memory
 };
 
@@ -67,6 +238,32 @@ void initPhysicalMemory(struct PhysicalMemory *pm,
 
 void freePhysicalMemory(struct PhysicalMemory *pm);
 
+/* must run before the first translation; i32NumColors comes from the cache
+   geometry: (sets * block size) / page size */
+void setFrameAllocPolicy(struct PhysicalMemory *pm,
+                         FrameAllocPolicy policy,
+                         uint32_t i32NumColors);
+
+FrameAllocPolicy frame_alloc_from_string(const char *s);
+
+/* must run before the first translation; i64WsWindow 0 = default */
+void setPageReplPolicy(struct PhysicalMemory *pm,
+                       PageReplPolicy policy,
+                       PageReplScope scope,
+                       uint64_t i64WsWindow);
+
+PageReplPolicy page_repl_from_string(const char *s);
+
+void setFaultModel(struct PhysicalMemory *pm, const struct FaultModel *model);
+
+const char *page_repl_name(PageReplPolicy policy);
+
+/* OPT: give the translation keys recorded by a run with bRecordRefs set
+   on another PhysicalMemory; the next-use index is built from them */
+void setPageOptTrace(struct PhysicalMemory *pm,
+                     const uint64_t *i64Keys,
+                     uint64_t i64NumKeys);
+
 void initVM(struct VM *vm,
             uint16_t i16PID,
             uint32_t i32VABits,
@@ -75,12 +272,45 @@ void initVM(struct VM *vm,
 
 void freeVM(struct VM *vm);
 
+/* PTE for a VPN; with bCreate false returns NULL if its leaf was never touched */
+struct PTE *lookupPTE(struct VM *vm, uint64_t vpn, bool bCreate);
+
+/* number of valid page table entries of a VM */
+uint64_t countValidPTEs(const struct VM *vm);
+
 uint64_t translateAddress(struct VM *vm, 
                           uint64_t virtualAddress, 
                           bool isWrite);
+
+/* translate a run of accesses in order, the same as translateAddress on
+   each, until one needs a page fault; that one and the rest are left to
+   translateAddress. i32ArrStall gets each access' TLB miss cycles.
+   Returns the number translated. */
+uint32_t translateBatch(struct VM *vm,
+                        uint32_t i32Count,
+                        const uint64_t *i64ArrVirtual,
+                        const uint8_t *i8ArrIsWrite,
+                        uint64_t *i64ArrPhys,
+                        uint32_t *i32ArrStall);
                           
 void freeFramesForProcess(struct PhysicalMemory *pm, uint16_t i16Pid);
 
+/* warm-up: zero the counters, frames, page tables and TLB entries stay.
+   resetMemoryStats covers the shared counters and the TLB's */
+void resetMemoryStats(struct PhysicalMemory *pm);
+
+void resetVMStats(struct VM *vm);
+
+void initTLB(struct TLB *tlb, uint32_t i32NumEntries, uint32_t i32Ways, uint32_t i32NumAsids);
+
+void freeTLB(struct TLB *tlb);
+
+void tlbFlush(struct TLB *tlb);
+
+/* give the VM an ASID before it runs; recycling one flushes its entries.
+   Returns true if entries had to be flushed. */
+bool tlbActivate(struct TLB *tlb, struct VM *vm);
+
 void parseSimulationResults(struct PhysicalMemory *pm, 
                             struct VM *vms, 
                             int numVMs);